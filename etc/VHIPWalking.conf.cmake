@@ -2,6 +2,15 @@
   "initial_plan": "warmup",
   "mpc":
   {
+    "formulation": "Copra", // "Copra" (former formulation, in builds with copra), "Condensed" or "Riccati"
+    "horizon":
+    {
+      "nb_steps": 16, // 16, 32 or 64, read when the controller starts; the condensed formulation supports up to 16
+      "sampling_period": 0.1 // [s]
+    },
+    // "time_grid": {"fine_period": 0.02, "nb_fine_steps": 5, "duration": 1.6}, // multi-rate alternative
+    // "time_budget": 2.0, // [ms], none if omitted or 0; on timeout, Riccati returns its best feasible iterate
+    //                     // and the active-set backend shifts the previous preview
     "weights":
     {
       "jerk": 1.0,
@@ -9,6 +18,10 @@
       "zmp": 1000.0
     }
   },
+  "swing_foot":
+  {
+    "tabulate": true // sample swing trajectories at the control rate when they start
+  },
   "stabilizer":
   {
     "fdqp_weights":
@@ -55,6 +68,14 @@
     "zmpcc":
     {
       "integrator_leak_rate": 0.1
+    },
+    "qp_backend":
+    {
+      "fdqp": "LSSOL", // "LSSOL", "ActiveSet" (opt-in, warm-started), "QLD" or "QuadProg"
+      "vhip": "LSSOL",
+      "compare_with_lssol": false, // benchmark the VHIP backend against LSSOL
+      // "record_vhip": "/tmp/vhip_qps.txt", // record the first minute of VHIP QPs for vhip_walking_controller_qp_comparison, written when the controller stops
+      "explicit_ss": false // explicit solution for single-support distribution, check with vhip_walking_controller_ss_distribution_check first
     }
   },
   "tasks":
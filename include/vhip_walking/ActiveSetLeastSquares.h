@@ -0,0 +1,661 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <limits>
+
+#include <Eigen/Dense>
+
+namespace vhip_walking
+{
+  /** Dense active-set solver for small least-squares problems.
+   *
+   * Solves problems in the same form as Eigen::LSSOL_LS:
+   *
+   *    minimize    |A x - b|^2
+   *    subject to  bl <= [x; C x] <= bu
+   *
+   * where bounds are stacked as in LSSOL: first the NB_VAR variable bounds,
+   * then the NB_CONS general constraints. Rows with bl == bu are treated as
+   * equality constraints.
+   *
+   * The method is the dual active-set algorithm from "A numerically stable
+   * dual method for solving strictly convex quadratic programs" (Goldfarb and
+   * Idnani, 1983). Each equality-constrained subproblem is solved by the
+   * null-space method: a QR decomposition of the normals of the working set,
+   * then a Cholesky decomposition of the reduced Hessian. A small
+   * regularization makes the Hessian positive definite when A does not have
+   * full column rank.
+   *
+   * The working set of the last solve is kept as initial guess for the next
+   * one. As problems solved at each control cycle change little, the initial
+   * guess is often already optimal, in which case solve() boils down to one
+   * subproblem. When C is also the same as in the last solve, the QR
+   * decomposition of this subproblem is reused, and when the Hessian is
+   * unchanged as well so is the reduced Cholesky decomposition.
+   *
+   * All storage is sized at compile time so that solve() does not allocate.
+   *
+   * Iterates of the dual method only become primal feasible at the optimum,
+   * so that a solve stopped at its deadline has no solution to offer.
+   *
+   */
+  template <int NB_VAR, int NB_CONS>
+  struct ActiveSetLeastSquares
+  {
+    static constexpr int NB_ROWS = NB_VAR + NB_CONS;
+    static constexpr unsigned MAX_ITER = 3 * NB_ROWS;
+
+    using ActiveVector = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, NB_VAR, 1>;
+    using NormalMatrix = Eigen::Matrix<double, NB_VAR, Eigen::Dynamic, 0, NB_VAR, NB_VAR>;
+    using ReducedMatrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, NB_VAR, NB_VAR>;
+    using RowVector = Eigen::Matrix<double, NB_ROWS, 1>;
+    using TimePoint = std::chrono::high_resolution_clock::time_point;
+    using VarMatrix = Eigen::Matrix<double, NB_VAR, NB_VAR>;
+    using VarVector = Eigen::Matrix<double, NB_VAR, 1>;
+
+    /** Status of a row of the stacked constraints [x; C x].
+     *
+     */
+    enum class RowStatus
+    {
+      Inactive,
+      Lower,
+      Upper,
+      Equality
+    };
+
+    /** Initialize solver with an empty working set.
+     *
+     */
+    ActiveSetLeastSquares()
+    {
+      resetActiveSet();
+      C_.setZero();
+      H_.setZero();
+      multipliers_.setZero();
+      x_.setZero();
+    }
+
+    /** Forget the working set of the previous solve, along with its
+     * decompositions.
+     *
+     */
+    void resetActiveSet()
+    {
+      for (int i = 0; i < NB_ROWS; i++)
+      {
+        status_[i] = RowStatus::Inactive;
+      }
+      invalidateFactorization();
+    }
+
+    /** Shift the working set over a range of stacked rows.
+     *
+     * \param firstRow First row of the range.
+     *
+     * \param nbRows Number of rows in the range.
+     *
+     * \param shift Non-negative number of rows to shift by: row i takes the
+     * status of row i + shift. Rows shifted in from outside of the range are
+     * inactive.
+     *
+     * This is useful to warm-start receding-horizon problems, where the
+     * constraints of the next problem are those of the last one shifted by a
+     * number of time steps.
+     *
+     */
+    void shiftActiveSet(int firstRow, int nbRows, int shift)
+    {
+      for (int i = firstRow; i < firstRow + nbRows; i++)
+      {
+        int j = i + shift;
+        status_[i] = (j < firstRow + nbRows) ? status_[j] : RowStatus::Inactive;
+      }
+    }
+
+    /** Set the wall-clock deadline of subsequent calls to solve().
+     *
+     * \param deadline Time point after which the solver stops solving
+     * subproblems, or TimePoint::max() to iterate until convergence.
+     *
+     */
+    void deadline(TimePoint deadline)
+    {
+      deadline_ = deadline;
+    }
+
+    /** Solve a new problem, warm-starting from the last working set.
+     *
+     * \param A Cost matrix.
+     *
+     * \param b Cost vector.
+     *
+     * \param C Matrix of general constraints.
+     *
+     * \param bl Lower bounds on variables then general constraints.
+     *
+     * \param bu Upper bounds on variables then general constraints.
+     *
+     * \returns success True if an optimum was found.
+     *
+     * Contrary to LSSOL, input matrices are not modified.
+     *
+     */
+    template <typename MatA, typename VecB, typename MatC, typename VecL, typename VecU>
+    bool solve(const Eigen::MatrixBase<MatA> & A, const Eigen::MatrixBase<VecB> & b, const Eigen::MatrixBase<MatC> & C, const Eigen::MatrixBase<VecL> & bl, const Eigen::MatrixBase<VecU> & bu)
+    {
+      Hnew_.noalias() = A.transpose() * A;
+      Hnew_.diagonal().array() += REGULARIZATION;
+      return solve(Hnew_, A, b, C, bl, bu);
+    }
+
+    /** Solve a new problem whose Hessian was computed beforehand.
+     *
+     * \param H Hessian A^T A of the cost, regularized so that it is positive
+     * definite.
+     *
+     * \param A Cost matrix.
+     *
+     * \param b Cost vector.
+     *
+     * \param C Matrix of general constraints.
+     *
+     * \param bl Lower bounds on variables then general constraints.
+     *
+     * \param bu Upper bounds on variables then general constraints.
+     *
+     * \returns success True if an optimum was found.
+     *
+     * Saves the product A^T A when the caller keeps the Hessian of a cost
+     * matrix that does not change between solves.
+     *
+     */
+    template <typename MatH, typename MatA, typename VecB, typename MatC, typename VecL, typename VecU>
+    bool solve(const Eigen::MatrixBase<MatH> & H, const Eigen::MatrixBase<MatA> & A, const Eigen::MatrixBase<VecB> & b, const Eigen::MatrixBase<MatC> & C, const Eigen::MatrixBase<VecL> & bl, const Eigen::MatrixBase<VecU> & bu)
+    {
+      if (H != H_)
+      {
+        H_ = H;
+        hessianChanged_ = true;
+      }
+      if (C != C_)
+      {
+        C_ = C;
+        invalidateFactorization();
+      }
+      c_.noalias() = -A.transpose() * b;
+      bl_ = bl;
+      bu_ = bu;
+      for (int i = 0; i < NB_ROWS; i++)
+      {
+        if (bu_(i) - bl_(i) < EQUALITY_TOL)
+        {
+          status_[i] = RowStatus::Equality;
+        }
+        else if (status_[i] == RowStatus::Equality)
+        {
+          status_[i] = RowStatus::Inactive;
+        }
+      }
+
+      nbFactorizations_ = 0;
+      nbIter_ = 0;
+      timedOut_ = false;
+      if (!initWorkingSet())
+      {
+        if (timedOut_)
+        {
+          return false;
+        }
+        resetActiveSet(); // previous working set is degenerate for this problem
+        for (int i = 0; i < NB_ROWS; i++)
+        {
+          if (bu_(i) - bl_(i) < EQUALITY_TOL)
+          {
+            status_[i] = RowStatus::Equality;
+          }
+        }
+        if (!initWorkingSet())
+        {
+          return false;
+        }
+      }
+
+      bool workingSetChanged = false;
+      while (nbIter_ < MAX_ITER)
+      {
+        int p;
+        RowStatus side;
+        if (!findViolatedRow(p, side))
+        {
+          return (workingSetChanged) ? initWorkingSet() : true;
+        }
+        if (!addRow(p, side))
+        {
+          return false;
+        }
+        workingSetChanged = true;
+      }
+      return false;
+    }
+
+    /** Number of QR decompositions computed during the last call to solve().
+     *
+     */
+    unsigned factorizations() const
+    {
+      return nbFactorizations_;
+    }
+
+    /** Number of equality-constrained subproblems solved during the last
+     * call to solve().
+     *
+     */
+    unsigned iterations() const
+    {
+      return nbIter_;
+    }
+
+    /** Solution of the last call to solve().
+     *
+     */
+    const VarVector & result() const
+    {
+      return x_;
+    }
+
+    /** Status of a stacked row [x; C x] in the working set of the last
+     * call to solve().
+     *
+     * \param i Row index.
+     *
+     */
+    RowStatus rowStatus(int i) const
+    {
+      return status_[i];
+    }
+
+    /** Did the last call to solve() stop at its deadline?
+     *
+     */
+    bool timedOut() const
+    {
+      return timedOut_;
+    }
+
+  private:
+    /** Add a violated row to the working set (main step of the algorithm).
+     *
+     * \param p Row index.
+     *
+     * \param side Which bound of the row is violated.
+     *
+     * \returns success False if the problem is infeasible.
+     *
+     */
+    bool addRow(int p, RowStatus side)
+    {
+      double sign = (side == RowStatus::Lower) ? +1. : -1.;
+      double b_p = (side == RowStatus::Lower) ? bl_(p) : -bu_(p);
+      rowNormal(p, n_p_);
+      n_p_ *= sign;
+      double u_p = 0.;
+      while (nbIter_ < MAX_ITER)
+      {
+        if (!factorize())
+        {
+          return false;
+        }
+        h_.setZero(nbActive_);
+        solveKKT(n_p_, h_, z_, r_);
+
+        // partial step length: first active multiplier to reach zero
+        double t1 = std::numeric_limits<double>::infinity();
+        int k = -1;
+        for (int j = 0; j < nbActive_; j++)
+        {
+          int i = workingSet_[j];
+          if (status_[i] != RowStatus::Equality && r_(j) > DUAL_TOL)
+          {
+            double t = multipliers_(i) / r_(j);
+            if (t < t1)
+            {
+              t1 = t;
+              k = i;
+            }
+          }
+        }
+
+        // full step length: row p becomes satisfied
+        double t2 = std::numeric_limits<double>::infinity();
+        double zn = z_.dot(n_p_);
+        if (zn > PRIMAL_TOL * PRIMAL_TOL)
+        {
+          t2 = (b_p - n_p_.dot(x_)) / zn;
+        }
+
+        if (k < 0 && std::isinf(t2))
+        {
+          return false; // infeasible problem
+        }
+        double t = std::min(t1, t2);
+        if (!std::isinf(t2))
+        {
+          x_ += t * z_;
+        }
+        for (int j = 0; j < nbActive_; j++)
+        {
+          multipliers_(workingSet_[j]) -= t * r_(j);
+        }
+        u_p += t;
+        if (t2 <= t1)
+        {
+          multipliers_(p) = u_p;
+          status_[p] = side;
+          return true;
+        }
+        multipliers_(k) = 0.;
+        status_[k] = RowStatus::Inactive;
+      }
+      return false;
+    }
+
+    /** Decompose the subproblem of the current working set.
+     *
+     * \returns success False if the working set is degenerate or the
+     * deadline has passed.
+     *
+     * Decompositions from the previous call are reused when the working set
+     * and problem matrices did not change.
+     *
+     */
+    bool factorize()
+    {
+      if (std::chrono::high_resolution_clock::now() > deadline_)
+      {
+        timedOut_ = true;
+        return false;
+      }
+      nbIter_++;
+      nbActive_ = 0;
+      bool sameWorkingSet = factorizationValid_;
+      for (int i = 0; i < NB_ROWS; i++)
+      {
+        sameWorkingSet = sameWorkingSet && (status_[i] == factorizedStatus_[i]);
+        if (status_[i] != RowStatus::Inactive)
+        {
+          if (nbActive_ >= NB_VAR)
+          {
+            return false; // more active rows than variables
+          }
+          workingSet_[nbActive_++] = i;
+        }
+      }
+      if (sameWorkingSet && !hessianChanged_)
+      {
+        return true;
+      }
+
+      const int nbFree = NB_VAR - nbActive_;
+      if (!sameWorkingSet)
+      {
+        nbFactorizations_++;
+        factorizationValid_ = false;
+        N_.resize(NB_VAR, nbActive_);
+        for (int j = 0; j < nbActive_; j++)
+        {
+          int i = workingSet_[j];
+          rowNormal(i, n_j_);
+          N_.col(j) = (status_[i] == RowStatus::Upper) ? -n_j_ : n_j_;
+        }
+        qr_.compute(N_);
+        for (int j = 0; j < nbActive_; j++)
+        {
+          if (std::abs(qr_.matrixQR()(j, j)) <= DEGENERACY_TOL * N_.col(j).norm())
+          {
+            return false; // normals are linearly dependent
+          }
+        }
+        Q_ = qr_.householderQ();
+        for (int i = 0; i < NB_ROWS; i++)
+        {
+          factorizedStatus_[i] = status_[i];
+        }
+      }
+      if (nbFree > 0)
+      {
+        HZ_.noalias() = H_ * Q_.rightCols(nbFree);
+        reducedHessian_.noalias() = Q_.rightCols(nbFree).transpose() * HZ_;
+        reducedLLT_.compute(reducedHessian_);
+        if (reducedLLT_.info() != Eigen::Success)
+        {
+          return false;
+        }
+      }
+      factorizationValid_ = true;
+      hessianChanged_ = false;
+      return true;
+    }
+
+    /** Find the most violated inactive row at the current solution.
+     *
+     * \param p Index of the violated row.
+     *
+     * \param side Violated bound of row p.
+     *
+     * \returns found False if the current solution is feasible.
+     *
+     */
+    bool findViolatedRow(int & p, RowStatus & side) const
+    {
+      double maxViolation = PRIMAL_TOL;
+      p = -1;
+      for (int i = 0; i < NB_ROWS; i++)
+      {
+        if (status_[i] != RowStatus::Inactive)
+        {
+          continue;
+        }
+        double value = (i < NB_VAR) ? x_(i) : C_.row(i - NB_VAR).dot(x_);
+        if (bl_(i) - value > maxViolation)
+        {
+          maxViolation = bl_(i) - value;
+          p = i;
+          side = RowStatus::Lower;
+        }
+        else if (value - bu_(i) > maxViolation)
+        {
+          maxViolation = value - bu_(i);
+          p = i;
+          side = RowStatus::Upper;
+        }
+      }
+      return (p >= 0);
+    }
+
+    /** Compute primal and dual solutions on the current working set.
+     *
+     * Active rows with negative multipliers are dropped one at a time until
+     * all remaining multipliers are non-negative, which yields a valid initial
+     * pair for the dual method.
+     *
+     * \returns success False if the working set is degenerate.
+     *
+     */
+    bool initWorkingSet()
+    {
+      while (nbIter_ < MAX_ITER)
+      {
+        if (!factorize())
+        {
+          return false;
+        }
+        h_.resize(nbActive_);
+        for (int j = 0; j < nbActive_; j++)
+        {
+          int i = workingSet_[j];
+          h_(j) = (status_[i] == RowStatus::Upper) ? -bu_(i) : bl_(i);
+        }
+        g_ = -c_;
+        solveKKT(g_, h_, x_, r_);
+        multipliers_.setZero();
+        int worstRow = -1;
+        double worstMultiplier = -DUAL_TOL;
+        for (int j = 0; j < nbActive_; j++)
+        {
+          int i = workingSet_[j];
+          double u = -r_(j);
+          multipliers_(i) = u;
+          if (status_[i] != RowStatus::Equality && u < worstMultiplier)
+          {
+            worstMultiplier = u;
+            worstRow = i;
+          }
+        }
+        if (worstRow < 0)
+        {
+          return true;
+        }
+        status_[worstRow] = RowStatus::Inactive;
+      }
+      return false;
+    }
+
+    /** Forget decompositions, e.g. after constraint matrix changed.
+     *
+     */
+    void invalidateFactorization()
+    {
+      factorizationValid_ = false;
+      hessianChanged_ = true;
+    }
+
+    /** Get the normal vector of a stacked constraint row.
+     *
+     * \param i Row index.
+     *
+     * \param n Output vector.
+     *
+     */
+    void rowNormal(int i, VarVector & n) const
+    {
+      if (i < NB_VAR)
+      {
+        n.setZero();
+        n(i) = 1.;
+      }
+      else
+      {
+        n = C_.row(i - NB_VAR).transpose();
+      }
+    }
+
+    /** Solve the KKT system of the current working set:
+     *
+     *    [ H   N ] [ x ]   [ g ]
+     *    [ N^T 0 ] [ l ] = [ h ]
+     *
+     * \param g Top right-hand side.
+     *
+     * \param h Bottom right-hand side.
+     *
+     * \param x Primal output.
+     *
+     * \param l Dual output.
+     *
+     * With N = [Y Z] [R; 0], the primal solution is x = Y R^-T h + Z w where
+     * (Z^T H Z) w = Z^T (g - H Y R^-T h), and the dual is l = R^-1 Y^T (g - H x).
+     *
+     */
+    void solveKKT(const VarVector & g, const ActiveVector & h, VarVector & x, ActiveVector & l)
+    {
+      const int nbFree = NB_VAR - nbActive_;
+      const NormalMatrix & QR = qr_.matrixQR();
+      auto R = QR.topLeftCorner(nbActive_, nbActive_).template triangularView<Eigen::Upper>();
+      auto Rt = QR.topLeftCorner(nbActive_, nbActive_).transpose().template triangularView<Eigen::Lower>();
+      l = h;
+      Rt.solveInPlace(l);
+      x.noalias() = Q_.leftCols(nbActive_) * l;
+      if (nbFree > 0)
+      {
+        gradient_ = g;
+        gradient_.noalias() -= H_ * x;
+        w_.noalias() = Q_.rightCols(nbFree).transpose() * gradient_;
+        reducedLLT_.solveInPlace(w_);
+        x.noalias() += Q_.rightCols(nbFree) * w_;
+      }
+      gradient_ = g;
+      gradient_.noalias() -= H_ * x;
+      l.noalias() = Q_.leftCols(nbActive_).transpose() * gradient_;
+      R.solveInPlace(l);
+    }
+
+  private:
+    static constexpr double DEGENERACY_TOL = 1e-9;
+    static constexpr double DUAL_TOL = 1e-12;
+    static constexpr double EQUALITY_TOL = 1e-12;
+    static constexpr double PRIMAL_TOL = 1e-9;
+    static constexpr double REGULARIZATION = 1e-10;
+
+  private:
+    ActiveVector h_;
+    ActiveVector r_;
+    ActiveVector w_;
+    Eigen::HouseholderQR<NormalMatrix> qr_;
+    Eigen::LLT<ReducedMatrix> reducedLLT_;
+    Eigen::Matrix<double, NB_CONS, NB_VAR> C_;
+    NormalMatrix HZ_;
+    NormalMatrix N_;
+    ReducedMatrix reducedHessian_;
+    RowStatus factorizedStatus_[NB_ROWS];
+    RowStatus status_[NB_ROWS];
+    RowVector bl_;
+    RowVector bu_;
+    RowVector multipliers_; /**< Multipliers u >= 0 of active inequalities, written as n^T x >= b */
+    VarMatrix H_;
+    VarMatrix Hnew_;
+    VarMatrix Q_;
+    VarVector c_;
+    VarVector g_;
+    VarVector gradient_;
+    VarVector n_j_;
+    VarVector n_p_;
+    VarVector x_;
+    VarVector z_;
+    TimePoint deadline_ = TimePoint::max();
+    bool factorizationValid_ = false;
+    bool hessianChanged_ = true;
+    bool timedOut_ = false;
+    int nbActive_ = 0;
+    int workingSet_[NB_ROWS];
+    unsigned nbFactorizations_ = 0;
+    unsigned nbIter_ = 0;
+  };
+}
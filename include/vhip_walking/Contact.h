@@ -303,12 +303,14 @@ namespace vhip_walking
     }
 
     /** Halfspace representation of contact area in the contact frame.
+     *
+     * \param localHrepMat Output halfspace matrix.
+     *
+     * \param localHrepVec Output halfspace vector.
      *
      */
-    Eigen::HrepXd localHrep() const
+    void localHrep(Eigen::Matrix<double, 4, 2> & localHrepMat, Eigen::Matrix<double, 4, 1> & localHrepVec) const
     {
-      Eigen::Matrix<double, 4, 2> localHrepMat;
-      Eigen::Matrix<double, 4, 1> localHrepVec;
       localHrepMat <<
         +1, 0,
         -1, 0,
@@ -319,26 +321,51 @@ namespace vhip_walking
         halfLength,
         halfWidth,
         halfWidth;
+    }
+
+    /** Halfspace representation of contact area in the contact frame.
+     *
+     */
+    Eigen::HrepXd localHrep() const
+    {
+      Eigen::Matrix<double, 4, 2> localHrepMat;
+      Eigen::Matrix<double, 4, 1> localHrepVec;
+      localHrep(localHrepMat, localHrepVec);
       return Eigen::HrepXd(localHrepMat, localHrepVec);
     }
 
     /** Halfspace representation of contact area in the world frame.
+     *
+     * \param worldHrepMat Output halfspace matrix.
+     *
+     * \param worldHrepVec Output halfspace vector.
+     *
+     * This overload does not allocate.
      *
      */
-    Eigen::HrepXd hrep() const
+    void hrep(Eigen::Matrix<double, 4, 2> & worldHrepMat, Eigen::Matrix<double, 4, 1> & worldHrepVec) const
     {
-      Eigen::Matrix<double, 4, 2> worldHrepMat;
-      Eigen::Matrix<double, 4, 1> worldHrepVec;
-      Eigen::HrepXd local = localHrep();
-      auto & localHrepMat = local.first;
-      auto & localHrepVec = local.second;
+      Eigen::Matrix<double, 4, 2> localHrepMat;
+      Eigen::Matrix<double, 4, 1> localHrepVec;
+      localHrep(localHrepMat, localHrepVec);
       if ((normal() - world::e_z).norm() > 1e-3)
       {
         mc_rtc::log::warning("Contact is not horizontal");
       }
       const sva::PTransformd & X_0_c = pose;
-      worldHrepMat = localHrepMat * X_0_c.rotation().topLeftCorner<2, 2>();
-      worldHrepVec = worldHrepMat * X_0_c.translation().head<2>() + localHrepVec;
+      worldHrepMat.noalias() = localHrepMat * X_0_c.rotation().topLeftCorner<2, 2>();
+      worldHrepVec = localHrepVec;
+      worldHrepVec.noalias() += worldHrepMat * X_0_c.translation().head<2>();
+    }
+
+    /** Halfspace representation of contact area in the world frame.
+     *
+     */
+    Eigen::HrepXd hrep() const
+    {
+      Eigen::Matrix<double, 4, 2> worldHrepMat;
+      Eigen::Matrix<double, 4, 1> worldHrepVec;
+      hrep(worldHrepMat, worldHrepVec);
       return Eigen::HrepXd(worldHrepMat, worldHrepVec);
     }
 
@@ -43,7 +43,7 @@
 #include <vhip_walking/Contact.h>
 #include <vhip_walking/FloatingBaseObserver.h>
 #include <vhip_walking/FootstepPlan.h>
-#include <vhip_walking/ModelPredictiveControl.h>
+#include <vhip_walking/ModelPredictiveControlPipeline.h>
 #include <vhip_walking/NetWrenchObserver.h>
 #include <vhip_walking/Pendulum.h>
 #include <vhip_walking/Sole.h>
@@ -55,10 +55,20 @@
 
 namespace vhip_walking
 {
-  /** Preview update period, same as MPC sampling period.
+  /** Preview update period, same as the default MPC sampling period.
    *
    */
-  constexpr double PREVIEW_UPDATE_PERIOD = ModelPredictiveControl::SAMPLING_PERIOD;
+  constexpr double PREVIEW_UPDATE_PERIOD = ModelPredictiveControlBase::SAMPLING_PERIOD;
+
+  /** Outcome of an asynchronous preview update.
+   *
+   */
+  enum class PreviewUpdate
+  {
+    None, // no new preview this cycle
+    Success,
+    Failure
+  };
 
   // The following constants depend on the robot model (here HRP-4)
   constexpr double MAX_CHEST_P = +0.4; // [rad], DOF limit is +0.5 [rad]
@@ -156,10 +166,64 @@ namespace vhip_walking
     void stopLogSegment();
 
     /** Update horizontal MPC preview.
+     *
+     * The MPC problem is solved on the calling thread, unless a speculative
+     * branch posted by postPreviewBranch() matches it, and any preview update
+     * still in flight on the worker thread is discarded.
      *
      */
     bool updatePreview();
 
+    /** Solve ahead of time the MPC problem set in mpc() for a possible
+     * transition.
+     *
+     * \param branch Transition the problem is set for.
+     *
+     * \param state Pendulum state predicted at transition time.
+     *
+     * \returns posted False if the worker of this branch is still busy, in
+     * which case the caller should retry at a later cycle.
+     *
+     * The problem set in mpc() is overwritten by the next preview update.
+     *
+     */
+    bool postPreviewBranch(PreviewBranch branch, const Pendulum & state);
+
+    /** Post the MPC problem set in mpc() to the worker thread.
+     *
+     * \returns posted False if the worker is still busy with a previous
+     * problem, in which case the caller should retry at a later cycle.
+     *
+     * The problem should be set for the state of the pendulum at the end of
+     * the current cycle, i.e. after integration of the current preview. The
+     * solution is then picked up by pickUpPreviewUpdate() from the next cycle
+     * on.
+     *
+     */
+    bool postPreviewUpdate();
+
+    /** Switch to the preview computed by the worker thread, if available.
+     *
+     * \returns update Outcome of the last posted update, or None if it is
+     * not available yet.
+     *
+     * If the solution arrives after the cycle it was posted for, its
+     * playback is fast-forwarded by the number of late cycles.
+     *
+     */
+    PreviewUpdate pickUpPreviewUpdate();
+
+    /** Discard any asynchronous preview update still in flight.
+     *
+     * Its solution will be ignored by pickUpPreviewUpdate(), for instance
+     * when its problem was set by the previous state.
+     *
+     */
+    void discardPreviewUpdate()
+    {
+      previewRequestId_++;
+    }
+
     /** Update measured robot's floating base from kinematic observer.
      *
      */
@@ -191,16 +255,8 @@ namespace vhip_walking
      */
     double doubleSupportDuration()
     {
-      double duration;
-      if (doubleSupportDurationOverride_ > 0.)
-      {
-        duration = doubleSupportDurationOverride_;
-        doubleSupportDurationOverride_ = -1.;
-      }
-      else
-      {
-        duration = plan.doubleSupportDuration();
-      }
+      double duration = nextDoubleSupportDuration();
+      doubleSupportDurationOverride_ = -1.;
       return duration;
     }
 
@@ -243,9 +299,9 @@ namespace vhip_walking
     /** Get model predictive control solver.
      *
      */
-    ModelPredictiveControl & mpc()
+    ModelPredictiveControlPipelineBase & mpc()
     {
-      return mpc_;
+      return *mpc_;
     }
 
     /** Net contact wrench observer.
@@ -264,6 +320,14 @@ namespace vhip_walking
       return plan.nextContact();
     }
 
+    /** Get next DSP duration without consuming its override.
+     *
+     */
+    double nextDoubleSupportDuration() const
+    {
+      return (doubleSupportDurationOverride_ > 0.) ? doubleSupportDurationOverride_ : plan.doubleSupportDuration();
+    }
+
     /** Override next DSP duration.
      *
      * \param duration Custom DSP duration.
@@ -335,12 +399,26 @@ namespace vhip_walking
     bool emergencyStop = false;
     bool pauseWalking = false;
     bool pauseWalkingRequested = false;
+    bool tabulateSwingFoot = true; /**< Play back swing foot trajectories from tables sampled at the control rate */
     std::shared_ptr<Preview> preview;
     std::shared_ptr<mc_tasks::OrientationTask> pelvisTask;
     std::shared_ptr<mc_tasks::OrientationTask> torsoTask;
     std::vector<std::vector<double>> halfSitPose;
 
   private: /* hidden from FSM states */
+    /** Count the outcome of an MPC solve.
+     *
+     * \param status Outcome of the solve.
+     *
+     * \returns success False if the MPC failed.
+     *
+     * Solutions obtained after the time budget ran out are counted apart
+     * from failures.
+     *
+     */
+    bool countMPCStatus(WalkingMPC::SolveStatus status);
+
+  private:
     Eigen::Matrix3d pelvisOrientation_ = Eigen::Matrix3d::Identity(); // keep pelvis upright
     Eigen::Vector3d controlCom_;
     Eigen::Vector3d controlComd_;
@@ -348,7 +426,7 @@ namespace vhip_walking
     Eigen::Vector3d realComd_;
     FloatingBaseObserver floatingBaseObs_;
     LowPassVelocityFilter<Eigen::Vector3d> comVelFilter_;
-    ModelPredictiveControl mpc_;
+    std::unique_ptr<ModelPredictiveControlPipelineBase> mpc_; // horizon selected from the configuration
     NetWrenchObserver netWrenchObs_;
     Pendulum pendulum_;
     Sole sole_;
@@ -360,11 +438,16 @@ namespace vhip_walking
     double leftFootRatio_ = 0.5;
     double maxCoMHeight_ = 2.;
     double minCoMHeight_ = 0.;
+    double previewRequestTime_ = 0.; // [s] controller time the last posted MPC problem was set for
     double torsoPitch_;
     mc_rtc::Configuration mpcConfig_;
     mc_rtc::Configuration plans_;
     std::string segmentName_ = "";
     unsigned nbLogSegments_ = 100;
+    unsigned nbMPCBestFeasible_ = 0; // solves that ran out of time budget with a feasible iterate
     unsigned nbMPCFailures_ = 0;
+    unsigned nbMPCShiftedPrevious_ = 0; // solves that ran out of time budget without feasible iterate
+    unsigned nbPreviewLateCycles_ = 0; // cycles between request and pick up of the last asynchronous preview
+    unsigned long previewRequestId_ = 0;
   };
 }
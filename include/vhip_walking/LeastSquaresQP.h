@@ -0,0 +1,509 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+
+#include <eigen-lssol/LSSOL_LS.h>
+#include <eigen-qld/QLD.h>
+#include <eigen-quadprog/QuadProg.h>
+
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/ActiveSetLeastSquares.h>
+
+namespace vhip_walking
+{
+  /** Solver used for a stabilizer or MPC quadratic program.
+   *
+   */
+  enum class QPBackend
+  {
+    ActiveSet,
+    LSSOL,
+    QLD,
+    QuadProg
+  };
+
+  /** All QP backends, in the order of their labels.
+   *
+   */
+  inline const QPBackend QP_BACKENDS[4] =
+  {
+    QPBackend::ActiveSet,
+    QPBackend::LSSOL,
+    QPBackend::QLD,
+    QPBackend::QuadProg
+  };
+
+  /** Labels of QP backends used in configuration files, logs and GUI.
+   *
+   */
+  inline const std::string QP_BACKEND_LABELS[4] =
+  {
+    "ActiveSet",
+    "LSSOL",
+    "QLD",
+    "QuadProg"
+  };
+
+  /** Get label of a QP backend.
+   *
+   * \param backend QP backend.
+   *
+   */
+  inline const std::string & qpBackendToString(QPBackend backend)
+  {
+    return QP_BACKEND_LABELS[static_cast<unsigned>(backend)];
+  }
+
+  /** Get QP backend from its label, defaulting to LSSOL.
+   *
+   * \param str Backend label.
+   *
+   */
+  inline QPBackend qpBackendFromString(const std::string & str)
+  {
+    for (unsigned i = 0; i < 4; i++)
+    {
+      if (str == QP_BACKEND_LABELS[i])
+      {
+        return QP_BACKENDS[i];
+      }
+    }
+    if (str == "QuadProgDense") // label of copra solver flags
+    {
+      return QPBackend::QuadProg;
+    }
+    mc_rtc::log::warning("Unknown QP backend \"{}\", using LSSOL", str);
+    return QPBackend::LSSOL;
+  }
+
+  /** Least-squares problem of fixed dimensions solved by a selectable backend.
+   *
+   * Problems are written in the same form as Eigen::LSSOL_LS:
+   *
+   *    minimize    |A x - b|^2
+   *    subject to  bl <= [x; C x] <= bu
+   *
+   * LSSOL and the in-house active-set solver take this form directly. For
+   * QLD and QuadProg, the problem is rewritten as a QP with Hessian A^T A,
+   * regularized so that it is positive definite, and bounds are split into
+   * equalities (bl == bu) and single-sided inequalities. Bounds larger than
+   * INFINITE_BOUND in absolute value are skipped. Inequalities are padded
+   * to a fixed count with rows that are never active, and the workspaces of
+   * QLD and QuadProg are sized once for this count, so that solving does not
+   * reallocate them when the number of finite bounds changes.
+   *
+   * When the selected backend fails, the problem is solved again with LSSOL.
+   * The durations of the two solves are measured separately, so that the
+   * solve time of a backend does not include its fallback.
+   *
+   * A wall-clock deadline can be set for the active-set backend, which then
+   * stops iterating without fallback when it reaches it. Other backends
+   * can't be interrupted and ignore the deadline.
+   *
+   */
+  template <int NB_VAR, int NB_CONS>
+  struct LeastSquaresQP
+  {
+    static constexpr double INFINITE_BOUND = 1e5;
+    static constexpr int NB_ROWS = NB_VAR + NB_CONS;
+
+    using EqMatrix = Eigen::Matrix<double, Eigen::Dynamic, NB_VAR, 0, NB_ROWS, NB_VAR>;
+    using EqVector = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, NB_ROWS, 1>;
+    using IneqMatrix = Eigen::Matrix<double, Eigen::Dynamic, NB_VAR, 0, 2 * NB_ROWS, NB_VAR>;
+    using IneqVector = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, 2 * NB_ROWS, 1>;
+    using VarMatrix = Eigen::Matrix<double, NB_VAR, NB_VAR>;
+    using VarVector = Eigen::Matrix<double, NB_VAR, 1>;
+    using TimePoint = typename ActiveSetLeastSquares<NB_VAR, NB_CONS>::TimePoint;
+
+    /** Hessian of a least-squares cost along with its Cholesky factors.
+     *
+     * Problems that share the same cost matrix A can compute it once and
+     * pass it to solve(), so that QLD and QuadProg skip both the product
+     * A^T A and its decomposition.
+     *
+     */
+    struct Hessian
+    {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      /** Compute Hessian and decompositions from a cost matrix.
+       *
+       * \param A Cost matrix.
+       *
+       */
+      template <typename MatA>
+      void compute(const Eigen::MatrixBase<MatA> & A)
+      {
+        Q.noalias() = A.transpose() * A;
+        Q.diagonal().array() += REGULARIZATION;
+        Eigen::LLT<VarMatrix> llt(Q);
+        R = llt.matrixU();
+        Rinv.setIdentity();
+        llt.matrixU().solveInPlace(Rinv);
+      }
+
+      VarMatrix Q; /**< Regularized Hessian A^T A */
+      VarMatrix R; /**< Upper triangular Cholesky factor such that Q = R^T R */
+      VarMatrix Rinv; /**< Inverse of the Cholesky factor R */
+    };
+
+    /** Solve a new problem with the selected backend.
+     *
+     * \param A Cost matrix.
+     *
+     * \param b Cost vector.
+     *
+     * \param C Matrix of general constraints.
+     *
+     * \param bl Lower bounds on variables then general constraints.
+     *
+     * \param bu Upper bounds on variables then general constraints.
+     *
+     * \returns success True if the backend, or LSSOL as fallback, found an
+     * optimum.
+     *
+     */
+    template <typename MatA, typename VecB, typename MatC, typename VecL, typename VecU>
+    bool solve(const Eigen::MatrixBase<MatA> & A, const Eigen::MatrixBase<VecB> & b, const Eigen::MatrixBase<MatC> & C, const Eigen::MatrixBase<VecL> & bl, const Eigen::MatrixBase<VecU> & bu)
+    {
+      return solve(nullptr, A, b, C, bl, bu);
+    }
+
+    /** Solve a new problem whose Hessian was computed beforehand.
+     *
+     * \param hessian Hessian of the cost matrix A, or nullptr to compute it.
+     *
+     * \param A Cost matrix.
+     *
+     * \param b Cost vector.
+     *
+     * \param C Matrix of general constraints.
+     *
+     * \param bl Lower bounds on variables then general constraints.
+     *
+     * \param bu Upper bounds on variables then general constraints.
+     *
+     * \returns success True if the backend, or LSSOL as fallback, found an
+     * optimum.
+     *
+     * LSSOL works directly on A. The active-set backend uses the Hessian
+     * itself, QLD and QuadProg its Cholesky factor or inverse.
+     *
+     */
+    template <typename MatA, typename VecB, typename MatC, typename VecL, typename VecU>
+    bool solve(const Hessian * hessian, const Eigen::MatrixBase<MatA> & A, const Eigen::MatrixBase<VecB> & b, const Eigen::MatrixBase<MatC> & C, const Eigen::MatrixBase<VecL> & bl, const Eigen::MatrixBase<VecU> & bu)
+    {
+      using namespace std::chrono;
+      auto startTime = high_resolution_clock::now();
+      bool success = false;
+      fallbackTime_ = 0.;
+      switch (backend_)
+      {
+        case QPBackend::ActiveSet:
+          success = (hessian) ? activeSet_.solve(hessian->Q, A, b, C, bl, bu) : activeSet_.solve(A, b, C, bl, bu);
+          if (success)
+          {
+            x_ = activeSet_.result();
+          }
+          else
+          {
+            activeSet_.resetActiveSet();
+          }
+          break;
+        case QPBackend::QLD:
+          updateQP(hessian, A, b, C, bl, bu);
+          if (Aeq_.rows() != qldNbEq_)
+          {
+            qldNbEq_ = Aeq_.rows();
+            qld_.problem(NB_VAR, qldNbEq_, Aineq_.rows());
+          }
+          success = qld_.solve((hessian) ? hessian->R : Q_, c_, Aeq_, beq_, Aineq_, bineq_, bl.template head<NB_VAR>(), bu.template head<NB_VAR>(), /* isDecomp = */ hessian != nullptr);
+          if (success)
+          {
+            x_ = qld_.result();
+          }
+          break;
+        case QPBackend::QuadProg:
+          updateQP(hessian, A, b, C, bl, bu, /* boundsAsInequalities = */ true);
+          if (Aeq_.rows() != quadProgNbEq_)
+          {
+            quadProgNbEq_ = Aeq_.rows();
+            quadProg_.problem(NB_VAR, quadProgNbEq_, Aineq_.rows());
+          }
+          success = quadProg_.solve((hessian) ? hessian->Rinv : Q_, c_, Aeq_, beq_, Aineq_, bineq_, /* isDecomp = */ hessian != nullptr);
+          if (success)
+          {
+            x_ = quadProg_.result();
+          }
+          break;
+        case QPBackend::LSSOL:
+          success = lssol_.solve(A, b, C, bl, bu);
+          if (success)
+          {
+            x_ = lssol_.result();
+          }
+          break;
+      }
+      auto endTime = high_resolution_clock::now();
+      solveTime_ = 1000. * duration_cast<duration<double>>(endTime - startTime).count();
+      if (!success && !timedOut() && backend_ != QPBackend::LSSOL)
+      {
+        nbFallbacks_++;
+        success = lssol_.solve(A, b, C, bl, bu);
+        if (success)
+        {
+          x_ = lssol_.result();
+        }
+        auto fallbackEndTime = high_resolution_clock::now();
+        fallbackTime_ = 1000. * duration_cast<duration<double>>(fallbackEndTime - endTime).count();
+      }
+      return success;
+    }
+
+    /** Get selected backend.
+     *
+     */
+    QPBackend backend() const
+    {
+      return backend_;
+    }
+
+    /** Select backend.
+     *
+     * \param backend New backend.
+     *
+     */
+    void backend(QPBackend backend)
+    {
+      if (backend != backend_)
+      {
+        activeSet_.resetActiveSet();
+      }
+      backend_ = backend;
+    }
+
+    /** Set the wall-clock deadline of subsequent solves by the active-set
+     * backend.
+     *
+     * \param deadline Time point after which the backend stops iterating, or
+     * TimePoint::max() to iterate until convergence.
+     *
+     */
+    void deadline(TimePoint deadline)
+    {
+      activeSet_.deadline(deadline);
+    }
+
+    /** Did the last solve stop at its deadline?
+     *
+     */
+    bool timedOut() const
+    {
+      return backend_ == QPBackend::ActiveSet && activeSet_.timedOut();
+    }
+
+    /** Number of QR decompositions in the last active-set solve.
+     *
+     */
+    unsigned factorizations() const
+    {
+      return activeSet_.factorizations();
+    }
+
+    /** Number of subproblems in the last active-set solve.
+     *
+     */
+    unsigned iterations() const
+    {
+      return activeSet_.iterations();
+    }
+
+    /** Number of times LSSOL was used as fallback since the last reset.
+     *
+     */
+    unsigned nbFallbacks() const
+    {
+      return nbFallbacks_;
+    }
+
+    /** Forget warm-start information and reset fallback counter.
+     *
+     */
+    void reset()
+    {
+      activeSet_.resetActiveSet();
+      nbFallbacks_ = 0;
+    }
+
+    /** Forget the working set of the active-set backend.
+     *
+     * Call this function when the constraints of the problem change
+     * discontinuously, e.g. after a contact switch.
+     *
+     */
+    void resetActiveSet()
+    {
+      activeSet_.resetActiveSet();
+    }
+
+    /** Shift the working set of the active-set backend over a range of
+     * stacked rows [x; C x].
+     *
+     * \param firstRow First row of the range.
+     *
+     * \param nbRows Number of rows in the range.
+     *
+     * \param shift Non-negative number of rows to shift by.
+     *
+     * See ActiveSetLeastSquares::shiftActiveSet().
+     *
+     */
+    void shiftActiveSet(int firstRow, int nbRows, int shift)
+    {
+      activeSet_.shiftActiveSet(firstRow, nbRows, shift);
+    }
+
+    /** Solution of the last call to solve().
+     *
+     */
+    const VarVector & result() const
+    {
+      return x_;
+    }
+
+    /** Duration in [ms] of the selected backend in the last call to
+     * solve(), excluding the LSSOL fallback.
+     *
+     */
+    double solveTime() const
+    {
+      return solveTime_;
+    }
+
+    /** Duration in [ms] of the LSSOL fallback in the last call to solve(),
+     * zero if there was no fallback.
+     *
+     */
+    double fallbackTime() const
+    {
+      return fallbackTime_;
+    }
+
+  private:
+    /** Rewrite least-squares problem as a QP for QLD and QuadProg.
+     *
+     * \param hessian Precomputed Hessian, or nullptr to compute it in Q_.
+     *
+     * \param boundsAsInequalities Add variable bounds to inequality
+     * constraints, for backends that don't handle them separately.
+     *
+     */
+    template <typename MatA, typename VecB, typename MatC, typename VecL, typename VecU>
+    void updateQP(const Hessian * hessian, const Eigen::MatrixBase<MatA> & A, const Eigen::MatrixBase<VecB> & b, const Eigen::MatrixBase<MatC> & C, const Eigen::MatrixBase<VecL> & bl, const Eigen::MatrixBase<VecU> & bu, bool boundsAsInequalities = false)
+    {
+      if (!hessian)
+      {
+        Q_.noalias() = A.transpose() * A;
+        Q_.diagonal().array() += REGULARIZATION;
+      }
+      c_.noalias() = -A.transpose() * b;
+      int nbEq = 0;
+      int nbIneq = 0;
+      Aeq_.resize(NB_ROWS, NB_VAR);
+      beq_.resize(NB_ROWS);
+      Aineq_.resize(2 * NB_ROWS, NB_VAR);
+      bineq_.resize(2 * NB_ROWS);
+      for (int i = (boundsAsInequalities) ? 0 : NB_VAR; i < NB_ROWS; i++)
+      {
+        if (i < NB_VAR)
+        {
+          n_.setZero();
+          n_(i) = 1.;
+        }
+        else
+        {
+          n_ = C.row(i - NB_VAR).transpose();
+        }
+        if (bu(i) - bl(i) < EQUALITY_TOL)
+        {
+          Aeq_.row(nbEq) = n_.transpose();
+          beq_(nbEq++) = bu(i);
+          continue;
+        }
+        if (bu(i) < INFINITE_BOUND)
+        {
+          Aineq_.row(nbIneq) = n_.transpose();
+          bineq_(nbIneq++) = bu(i);
+        }
+        if (bl(i) > -INFINITE_BOUND)
+        {
+          Aineq_.row(nbIneq) = -n_.transpose();
+          bineq_(nbIneq++) = -bl(i);
+        }
+      }
+      const int maxNbIneq = 2 * ((boundsAsInequalities) ? NB_ROWS : NB_CONS);
+      for (; nbIneq < maxNbIneq; nbIneq++)
+      {
+        Aineq_.row(nbIneq).setZero();
+        Aineq_(nbIneq, nbIneq % NB_VAR) = 1.;
+        bineq_(nbIneq) = INFINITE_BOUND;
+      }
+      Aeq_.conservativeResize(nbEq, NB_VAR);
+      beq_.conservativeResize(nbEq);
+      Aineq_.conservativeResize(nbIneq, NB_VAR);
+      bineq_.conservativeResize(nbIneq);
+    }
+
+  private:
+    static constexpr double EQUALITY_TOL = 1e-12;
+    static constexpr double REGULARIZATION = 1e-8;
+
+  private:
+    ActiveSetLeastSquares<NB_VAR, NB_CONS> activeSet_;
+    EqMatrix Aeq_;
+    EqVector beq_;
+    Eigen::LSSOL_LS lssol_;
+    VarMatrix Q_;
+    Eigen::QLD qld_;
+    Eigen::QuadProgDense quadProg_;
+    IneqMatrix Aineq_;
+    IneqVector bineq_;
+    QPBackend backend_ = QPBackend::LSSOL;
+    VarVector c_;
+    VarVector n_;
+    VarVector x_ = VarVector::Zero();
+    Eigen::Index qldNbEq_ = -1; /**< Number of equalities QLD is sized for */
+    Eigen::Index quadProgNbEq_ = -1; /**< Number of equalities QuadProg is sized for */
+    double fallbackTime_ = 0.; /**< Duration in [ms] of the LSSOL fallback in the last call to solve() */
+    double solveTime_ = 0.; /**< Duration in [ms] of the selected backend in the last call to solve() */
+    unsigned nbFallbacks_ = 0;
+  };
+}
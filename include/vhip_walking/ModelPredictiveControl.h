@@ -25,31 +25,109 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+
 #pragma once
 
-#include <copra/constraints.h>
-#include <copra/costFunctions.h>
-#include <copra/LMPC.h>
-#include <copra/PreviewSystem.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
 
 #include <vhip_walking/Contact.h>
+#include <vhip_walking/LeastSquaresQP.h>
 #include <vhip_walking/Pendulum.h>
 #include <vhip_walking/Preview.h>
+#include <vhip_walking/RiccatiInteriorPoint.h>
 #include <vhip_walking/defs.h>
 
 namespace vhip_walking
 {
+  /** Dimensions and settings shared by model predictive control problems of
+   * all horizons.
+   *
+   */
+  struct ModelPredictiveControlBase
+  {
+    static constexpr double SAMPLING_PERIOD = 0.1; // [s], default sampling period of uniform time grids
+    static constexpr unsigned CACHE_SIZE = 32; // condensed matrices of distinct phase splits
+    static constexpr unsigned INPUT_SIZE = 2; // input is 2D CoM jerk
+    static constexpr unsigned MAX_CONDENSED_STEPS = 16; // longest horizon of the condensed formulation
+    static constexpr unsigned NB_TERM_CONS = 4; // terminal DCM and ZMP
+    static constexpr unsigned NB_ZMP_CONS = 4; // rows of a contact area
+    static constexpr unsigned STATE_SIZE = 6; // state is CoM [pos, vel, accel]
+
+    using HrepMatrix = Eigen::Matrix<double, NB_ZMP_CONS, 2>;
+    using HrepVector = Eigen::Matrix<double, NB_ZMP_CONS, 1>;
+    using InputMatrix = Eigen::Matrix<double, STATE_SIZE, INPUT_SIZE>;
+    using StateMatrix = Eigen::Matrix<double, STATE_SIZE, STATE_SIZE>;
+    using StateVector = Eigen::Matrix<double, STATE_SIZE, 1>;
+    using TimePoint = std::chrono::high_resolution_clock::time_point;
+
+    /** Formulation of the problem passed to the numerical solver.
+     *
+     */
+    enum class Formulation
+    {
+      Condensed, // least squares on stacked inputs, see LeastSquaresQP
+      Riccati, // stage-wise, see RiccatiInteriorPoint
+      Copra // former copra::LMPC formulation, only in builds with copra
+    };
+
+    /** Outcome of a call to solve().
+     *
+     */
+    enum class SolveStatus
+    {
+      Optimal, // solver converged
+      BestFeasible, // time budget ran out, best feasible iterate of the solver
+      ShiftedPrevious, // time budget ran out without feasible iterate, previous solution resumed at its playback time
+      Failed // no solution, zero jerk from the initial state
+    };
+  };
+
   /** Solution to a model predictive control problem.
+   *
+   * \tparam NB_STEPS Number of sampling steps in the preview horizon.
+   *
+   * The CoM trajectory is piecewise cubic: during each sampling step, it is
+   * the cubic polynomial starting from the state of the step with its
+   * constant jerk. Sampling steps may have different durations. The step of
+   * a given time is found in constant time from a table of uniform buckets
+   * over the horizon, for time grids whose step durations are within a
+   * bounded ratio of each other such as two-rate grids. The playback step is
+   * the one whose time interval contains the current playback time.
    *
    */
+  template <unsigned NB_STEPS>
   struct ModelPredictiveControlSolution : Preview
   {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    static constexpr unsigned INPUT_SIZE = ModelPredictiveControlBase::INPUT_SIZE;
+    static constexpr unsigned STATE_SIZE = ModelPredictiveControlBase::STATE_SIZE;
+
+    using InputTraj = Eigen::Matrix<double, INPUT_SIZE * NB_STEPS, 1>;
+    using StateTraj = Eigen::Matrix<double, STATE_SIZE * (NB_STEPS + 1), 1>;
+    using StepTimes = std::array<double, NB_STEPS + 1>;
+
+    /** Empty solution, e.g. for preallocation.
+     *
+     */
+    ModelPredictiveControlSolution() = default;
+
     /** Initialize a zero solution with a given initial state.
      *
      * \param initState Initial state.
      *
+     * \param stepTimes Times of sampling steps from the initial state.
+     *
+     * \param zeta Inverse of the natural frequency squared, in [s]^2.
+     *
      */
-    ModelPredictiveControlSolution(const Eigen::VectorXd & initState);
+    ModelPredictiveControlSolution(const ModelPredictiveControlBase::StateVector & initState, const StepTimes & stepTimes, double zeta);
 
     /** Initialize solution from trajectories.
      *
@@ -57,8 +135,36 @@ namespace vhip_walking
      *
      * \param jerkTraj CoM jerk trajectory.
      *
+     * \param stepTimes Times of sampling steps from the initial state.
+     *
+     * \param zeta Inverse of the natural frequency squared, in [s]^2.
+     *
      */
-    ModelPredictiveControlSolution(const Eigen::VectorXd & stateTraj, const Eigen::VectorXd & jerkTraj);
+    ModelPredictiveControlSolution(const StateTraj & stateTraj, const InputTraj & jerkTraj, const StepTimes & stepTimes, double zeta);
+
+    /** Initialize solution from the playback of a previous one.
+     *
+     * \param previous Previous solution.
+     *
+     * \param playbackTime Time in the previous solution where playback
+     * resumes, in [s].
+     *
+     * The new solution is flagged as shifted.
+     *
+     */
+    ModelPredictiveControlSolution(const ModelPredictiveControlSolution & previous, double playbackTime);
+
+    /** Integrate upcoming control steps of the playback on a given state,
+     * without changing the playback state.
+     *
+     * \param state CoM state to integrate upon.
+     *
+     * \param dt Duration of a control step.
+     *
+     * \param nbSteps Number of control steps.
+     *
+     */
+    void predict(Pendulum & state, double dt, unsigned nbSteps) const override;
 
     /** Integrate playback on reference.
      *
@@ -75,6 +181,10 @@ namespace vhip_walking
      *
      * \param dt Duration.
      *
+     * The jerk of sample() is applied over each sampling step crossed by the
+     * integration interval, and post-playback integration takes over at the
+     * end of the preview horizon.
+     *
      */
     void integratePlayback(Pendulum & state, double dt);
 
@@ -87,17 +197,35 @@ namespace vhip_walking
      */
     void integratePostPlayback(Pendulum & state, double dt);
 
-    /** Fill solution with zeros, except for initial state.
+    /** Sample the piecewise cubic CoM trajectory.
+     *
+     * \param t Time from the initial state, in [s], clamped to the preview
+     * horizon.
+     *
+     */
+    Sample sample(double t) const override;
+
+    /** Index of the sampling step whose time interval contains a given time.
+     *
+     * \param t Time from the initial state, in [s].
+     *
+     * \returns step Step index, NB_STEPS at or after the end of the preview
+     * horizon.
+     *
+     */
+    unsigned stepAt(double t) const;
+
+    /** Set solution to zero jerk from the initial state.
      *
      * \param initState Initial state.
      *
      */
-    void zeroFrom(const Eigen::VectorXd & initState);
+    void zeroFrom(const ModelPredictiveControlBase::StateVector & initState);
 
     /** Get the CoM jerk (input) trajectory.
      *
      */
-    const Eigen::VectorXd & jerkTraj() const
+    const InputTraj & jerkTraj() const
     {
       return jerkTraj_;
     }
@@ -105,14 +233,363 @@ namespace vhip_walking
     /** Get the CoM state trajectory.
      *
      */
-    const Eigen::VectorXd & stateTraj() const
+    const StateTraj & stateTraj() const
     {
       return stateTraj_;
     }
 
+    /** Is this solution a previous one resumed at a later playback time,
+     * rather than the solution to a new problem?
+     *
+     */
+    bool shifted() const
+    {
+      return shifted_;
+    }
+
   private:
-    Eigen::VectorXd jerkTraj_; /**< Stacked vector of CoM jerk trajectory */
-    Eigen::VectorXd stateTraj_; /**< Stacked vector of CoM state trajectory */
+    /** Fill the table of first steps of time buckets.
+     *
+     */
+    void indexSteps();
+
+  private:
+    InputTraj jerkTraj_; /**< Stacked vector of CoM jerk trajectory */
+    StateTraj stateTraj_; /**< Stacked vector of CoM state trajectory */
+    StepTimes stepTimes_; // [s]
+    bool shifted_ = false;
+    double bucketDuration_; // [s]
+    double zeta_; // [s]^2
+    std::array<unsigned, NB_STEPS> bucketSteps_; /**< Step containing the start time of each bucket */
+  };
+
+  /** Fixed pool of preallocated solutions.
+   *
+   * \tparam NB_STEPS Number of sampling steps in the preview horizon.
+   *
+   * Slots are allocated at construction and handed out as shared pointers,
+   * which keep them alive for as long as the controller plays them back. A
+   * slot is recycled once the pool holds its only reference, so that
+   * solutions are neither allocated nor deallocated afterwards, whichever
+   * thread releases them last. Slots are only handed out on the thread that
+   * solves the problem owning the pool.
+   *
+   * The pool has one slot per reference that may be held at the same time:
+   * the last solution of the owning instance, the preview played back by
+   * the controller, the solutions kept by speculative branches when the
+   * instance solves them, and the slot being written. It is never extended:
+   * acquire() fails if all slots are in use.
+   *
+   */
+  template <unsigned NB_STEPS>
+  struct ModelPredictiveControlSolutionPool
+  {
+    using Solution = ModelPredictiveControlSolution<NB_STEPS>;
+
+    static constexpr unsigned MAX_BRANCHES = 3; // see ModelPredictiveControlBranches
+    static constexpr unsigned SIZE = 1 + 1 + MAX_BRANCHES + 1; // last solution, preview played back, branches and slot being written
+
+    /** Allocate all slots.
+     *
+     */
+    ModelPredictiveControlSolutionPool();
+
+    /** Get a slot that is not referenced outside of the pool.
+     *
+     * \returns slot Solution to overwrite, or nullptr if all slots are in
+     * use.
+     *
+     */
+    std::shared_ptr<Solution> acquire();
+
+  private:
+    std::array<std::shared_ptr<Solution>, SIZE> slots_;
+  };
+
+  /** Data of a model predictive control problem, without solver storage.
+   *
+   * This is what a problem set by the FSM amounts to: contacts, phase
+   * splits, CoM height, initial state, weights, time grid, formulation, QP
+   * backend and time budget. It is cheap to copy, so that speculative
+   * problems can be kept and compared without a full ModelPredictiveControl
+   * instance each.
+   *
+   * \tparam NB_STEPS Number of sampling steps in the preview horizon.
+   *
+   */
+  template <unsigned NB_STEPS>
+  struct ModelPredictiveControlProblem
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    using Formulation = ModelPredictiveControlBase::Formulation;
+    using StateVector = ModelPredictiveControlBase::StateVector;
+    using StepTimes = typename ModelPredictiveControlSolution<NB_STEPS>::StepTimes;
+
+    /** Check whether another problem is the same as this one.
+     *
+     * \param other Problem to compare with.
+     *
+     * \param tolerance Maximum deviation of initial state coordinates and of
+     * contact poses and reference velocities, in SI units.
+     *
+     * Time grid, phase splits, CoM height and weights must be equal.
+     * Formulation, QP backend and time budget are not compared.
+     *
+     */
+    bool matches(const ModelPredictiveControlProblem & other, double tolerance) const;
+
+    Contact initContact;
+    Contact nextContact;
+    Contact targetContact;
+    Eigen::Vector2d velWeights;
+    Formulation formulation;
+    QPBackend qpBackend;
+    StateVector initState;
+    StepTimes stepTimes; // [s]
+    double comHeight; // [m]
+    double jerkWeight;
+    double timeBudget; // [ms]
+    double zmpWeight;
+    std::array<unsigned, NB_STEPS + 1> indexToHrep;
+    unsigned nbDoubleSupportSteps;
+    unsigned nbInitSupportSteps;
+    unsigned nbNextDoubleSupportSteps;
+    unsigned nbTargetSupportSteps;
+  };
+
+  template <unsigned NB_STEPS>
+  struct ModelPredictiveControl;
+
+  template <unsigned NB_STEPS>
+  struct CopraFormulation; // defined in builds with copra
+
+  /** Condensed formulation of a model predictive control problem.
+   *
+   * The problem is condensed on the stacked CoM jerk trajectory U, from which
+   * the stacked state trajectory is X = Phi x_0 + Psi U. Prediction matrices
+   * Phi and Psi are computed when the time grid is set, as well as all
+   * problem storage, so that each call to build() only updates numerical
+   * values.
+   *
+   * Cost and constraint operators on the stacked state trajectory are block
+   * diagonal: each step only involves its own state, through a velocity
+   * rotation, the ZMP map or a ZMP area. They are kept per step and applied
+   * to the matching rows of Phi x_0 and Psi, and only to the first columns of
+   * Psi that are non-zero by causality, so that building the problem scales
+   * with the number of non-zeros rather than with the stacked dimensions.
+   *
+   * \tparam NB_STEPS Number of sampling steps in the preview horizon.
+   *
+   */
+  template <unsigned NB_STEPS>
+  struct CondensedFormulation : ModelPredictiveControlBase
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    static constexpr unsigned NB_VAR = INPUT_SIZE * NB_STEPS; // stacked CoM jerk
+    static constexpr unsigned NB_CONS = NB_TERM_CONS + NB_ZMP_CONS * (NB_STEPS + 1); // terminal DCM and ZMP, then ZMP areas
+
+    using InputTraj = typename ModelPredictiveControlSolution<NB_STEPS>::InputTraj;
+    using Problem = ModelPredictiveControl<NB_STEPS>;
+    using QP = LeastSquaresQP<NB_VAR, NB_CONS>;
+    using StateTraj = typename ModelPredictiveControlSolution<NB_STEPS>::StateTraj;
+
+    /** Allocate problem storage.
+     *
+     */
+    CondensedFormulation();
+
+    /** Log solver entries.
+     *
+     * \param logger Logger.
+     *
+     */
+    void addLogEntries(mc_rtc::Logger & logger);
+
+    /** Set discrete-time dynamics over each sampling step.
+     *
+     * \param stateMatrices State matrices.
+     *
+     * \param inputMatrices Input matrices.
+     *
+     */
+    void dynamics(const std::array<StateMatrix, NB_STEPS> & stateMatrices, const std::array<InputMatrix, NB_STEPS> & inputMatrices);
+
+    /** Update cost and constraints from a problem description.
+     *
+     * \param problem Problem description.
+     *
+     */
+    void build(const Problem & problem);
+
+    /** Solve the last problem built.
+     *
+     * \param jerkTraj Output CoM jerk trajectory.
+     *
+     * \param stateTraj Output CoM state trajectory.
+     *
+     * \param deadline Wall-clock deadline of the active-set backend.
+     *
+     */
+    bool solve(InputTraj & jerkTraj, StateTraj & stateTraj, TimePoint deadline);
+
+    /** Did the last solve stop at its deadline?
+     *
+     */
+    bool timedOut() const
+    {
+      return qp_.timedOut();
+    }
+
+    /** Number of iterations of the active-set backend in the last solve.
+     *
+     */
+    unsigned iterations() const
+    {
+      return (qp_.backend() == QPBackend::ActiveSet) ? qp_.iterations() : 0u;
+    }
+
+    /** Duration in [ms] of the last QP solve, including the LSSOL fallback
+     * if there was one.
+     *
+     */
+    double solveTime() const
+    {
+      return qp_.solveTime() + qp_.fallbackTime();
+    }
+
+  private:
+    /** Preallocated vectors of the condensed least-squares problem.
+     *
+     * Cost rows are stacked as jerk, then velocity, then ZMP tracking.
+     * Constraint rows are stacked as terminal DCM, terminal ZMP, then ZMP
+     * areas of the preview steps. Rows of ZMP areas not used by the current
+     * phase durations are left unbounded.
+     *
+     */
+    struct Workspace
+    {
+      static constexpr unsigned JERK_COST_ROW = 0;
+      static constexpr unsigned VEL_COST_ROW = JERK_COST_ROW + NB_VAR;
+      static constexpr unsigned ZMP_COST_ROW = VEL_COST_ROW + 2 * (NB_STEPS + 1);
+      static constexpr unsigned NB_COST_ROWS = ZMP_COST_ROW + 2 * (NB_STEPS + 1);
+      static constexpr unsigned TERM_DCM_CONS_ROW = 0;
+      static constexpr unsigned TERM_ZMP_CONS_ROW = TERM_DCM_CONS_ROW + 2;
+      static constexpr unsigned ZMP_CONS_ROW = TERM_ZMP_CONS_ROW + 2;
+
+      Eigen::Matrix<double, NB_COST_ROWS, 1> b;
+      Eigen::Matrix<double, NB_VAR + NB_CONS, 1> bl;
+      Eigen::Matrix<double, NB_VAR + NB_CONS, 1> bu;
+    };
+
+    /** Everything the condensed matrices of the problem depend on.
+     *
+     * This is the phase split encoded by phaseLabel(), completed by the CoM
+     * height, cost weights and contact orientations. Contact positions and
+     * the initial state only enter cost and constraint vectors.
+     *
+     */
+    struct CondensedKey
+    {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      bool operator==(const CondensedKey & other) const
+      {
+        return nbSteps == other.nbSteps && comHeight == other.comHeight && jerkWeight == other.jerkWeight && velWeights == other.velWeights && zmpWeight == other.zmpWeight && initRotation == other.initRotation && targetRotation == other.targetRotation && nextRotation == other.nextRotation;
+      }
+
+      Eigen::Matrix3d initRotation;
+      Eigen::Matrix3d nextRotation;
+      Eigen::Matrix3d targetRotation;
+      Eigen::Vector2d velWeights;
+      double comHeight;
+      double jerkWeight;
+      double zmpWeight;
+      std::array<unsigned, 4> nbSteps; /**< Numbers of steps in each phase, as in phaseLabel() */
+    };
+
+    /** Condensed cost and constraint matrices, with the Hessian of the cost
+     * and its decompositions.
+     *
+     */
+    struct CondensedMatrices
+    {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      CondensedKey key;
+      Eigen::Matrix<double, Workspace::NB_COST_ROWS, NB_VAR> A;
+      Eigen::Matrix<double, NB_CONS, NB_VAR> C;
+      typename QP::Hessian hessian;
+      bool valid = false; /**< Does this entry hold matrices for its key? */
+      unsigned long lastUse = 0; /**< Solve counter at the last use of this entry */
+    };
+
+    /** Get condensed matrices of the current problem from the cache, or
+     * compute them in place of the least recently used entry.
+     *
+     * \param problem Problem description.
+     *
+     */
+    const CondensedMatrices & condensedMatrices(const Problem & problem);
+
+    /** Compute condensed matrices of the current problem.
+     *
+     * \param problem Problem description.
+     *
+     * \param matrices Output matrices.
+     *
+     */
+    void condense(const Problem & problem, CondensedMatrices & matrices) const;
+
+    /** Rows of Psi that map the input trajectory to the state at a given step.
+     *
+     * \param i Step index.
+     *
+     * Only the inputs before step i are returned, as later ones don't affect
+     * the state at this step.
+     *
+     */
+    Eigen::Block<const Eigen::Matrix<double, STATE_SIZE * (NB_STEPS + 1), NB_VAR>, STATE_SIZE, Eigen::Dynamic> stateFromPastInputs(unsigned i) const
+    {
+      return stateFromInput_.template block<STATE_SIZE, Eigen::Dynamic>(STATE_SIZE * i, 0, STATE_SIZE, INPUT_SIZE * i);
+    }
+
+    void updateTerminalConstraint(const Problem & problem);
+
+    void updateZMPConstraint(const Problem & problem);
+
+    void updateJerkCost();
+
+    void updateVelCost(const Problem & problem);
+
+    void updateZMPCost(const Problem & problem);
+
+    /** Shift the working set of the active-set backend by the number of
+     * sampling steps played back from the last solution.
+     *
+     * ZMP constraints at a given time keep their active status across
+     * solves, which is what the dual active-set method needs as initial
+     * guess. Other backends solve from scratch.
+     *
+     * \param problem Problem description.
+     *
+     */
+    void warmStart(const Problem & problem);
+
+  private:
+    std::array<Eigen::Matrix<double, NB_ZMP_CONS, STATE_SIZE>, NB_STEPS + 1> zmpConsMats_; /**< ZMP area constraints on the state of each step */
+    Eigen::Matrix<double, STATE_SIZE * (NB_STEPS + 1), STATE_SIZE> stateFromInit_; /**< Prediction matrix Phi */
+    Eigen::Matrix<double, STATE_SIZE * (NB_STEPS + 1), NB_VAR> stateFromInput_; /**< Prediction matrix Psi */
+    StateTraj freeStateTraj_; /**< State trajectory Phi x_0 under zero input */
+    const CondensedMatrices * matrices_ = nullptr; /**< Condensed matrices of the last problem built */
+    QP qp_;
+    Workspace workspace_; /**< Preallocated cost and constraint vectors */
+    std::vector<CondensedMatrices, Eigen::aligned_allocator<CondensedMatrices>> cache_; /**< LRU cache of condensed matrices */
+    unsigned warmStartSteps_ = 0; /**< Number of steps the working set was shifted by in the last solve */
+    unsigned long nbCacheHits_ = 0;
+    unsigned long nbCacheMisses_ = 0;
+    unsigned long nbSolves_ = 0;
   };
 
   /** Model predictive control problem.
@@ -121,15 +598,56 @@ namespace vhip_walking
    * control for stable walking in the presence of strong perturbations"
    * (Wieber, Humanoids 2006) with the addition of terminal constraints.
    *
+   * The horizon is a template parameter, so that all problem storage is sized
+   * at compile time. Horizons used by the controller and tools are
+   * explicitly instantiated in ModelPredictiveControl.cpp.
+   *
+   * Sampling steps don't need to have the same duration. A multi-rate time
+   * grid, with fine steps near the present and coarser ones towards the end
+   * of the horizon, improves short-term tracking for a given number of
+   * decision variables. Each step has its own discrete-time dynamics, and
+   * phase boundaries are mapped to the closest step in time. Costs of each
+   * step are weighted by its duration relative to SAMPLING_PERIOD, so that
+   * cost weights keep the same meaning on all grids.
+   *
+   * The problem is solved in one of three formulations. The condensed
+   * formulation (see CondensedFormulation) has a computation time that grows
+   * cubically with the number of steps, and is only available up to
+   * MAX_CONDENSED_STEPS steps. The Riccati formulation keeps CoM states as
+   * stage variables and solves the problem with RiccatiInteriorPoint, whose
+   * computation time grows linearly with the number of steps. It does not
+   * constrain the ZMP of the initial state, which no decision variable can
+   * change anyway. The copra formulation is the one the controller used
+   * before the other two, kept as reference when the project is built with
+   * copra. It only supports uniform time grids.
+   *
+   * Problem and solver storage is allocated at construction: fixed-size
+   * matrices for the problem and condensed formulation, the stages of
+   * RiccatiInteriorPoint (sized once by its resize()) and the slots of the
+   * solution pool. After that, solve() does not allocate with the Riccati
+   * formulation, nor with the condensed formulation and the active-set
+   * backend, which the mpc_allocations test checks. The LSSOL, QLD and
+   * QuadProg backends and the copra formulation may allocate in their
+   * libraries.
+   *
+   * \tparam NB_STEPS_ Number of sampling steps in the preview horizon.
+   *
    */
-  struct ModelPredictiveControl
+  template <unsigned NB_STEPS_>
+  struct ModelPredictiveControl : ModelPredictiveControlBase
   {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-    static constexpr double SAMPLING_PERIOD = 0.1; // [s]
-    static constexpr unsigned INPUT_SIZE = 2; // input is 2D CoM jerk
-    static constexpr unsigned NB_STEPS = 16; // number of sampling steps
-    static constexpr unsigned STATE_SIZE = 6; // state is CoM [pos, vel, accel]
+    static constexpr unsigned NB_STEPS = NB_STEPS_; // number of sampling steps
+    static constexpr bool HAS_CONDENSED = (NB_STEPS <= MAX_CONDENSED_STEPS);
+
+    using InputTraj = typename ModelPredictiveControlSolution<NB_STEPS>::InputTraj;
+    using Problem = ModelPredictiveControlProblem<NB_STEPS>;
+    using RefVec = Eigen::Matrix<double, 2 * (NB_STEPS + 1), 1>;
+    using Solution = ModelPredictiveControlSolution<NB_STEPS>;
+    using StateTraj = typename ModelPredictiveControlSolution<NB_STEPS>::StateTraj;
+    using StepDurations = std::array<double, NB_STEPS>;
+    using StepTimes = typename ModelPredictiveControlSolution<NB_STEPS>::StepTimes;
 
     /** Initialize new problem.
      *
@@ -155,6 +673,36 @@ namespace vhip_walking
      */
     void configure(const mc_rtc::Configuration &);
 
+    /** Copy problem data from a problem.
+     *
+     * \param problem Problem to solve next.
+     *
+     * Solver data such as the cache of condensed matrices and the working
+     * set of the QP are kept.
+     *
+     */
+    void copyProblem(const Problem & problem);
+
+    /** Replace the last solution by a copy that is not referenced outside
+     * of this instance.
+     *
+     * The next call to solve() reads the playback time of the last solution
+     * to warm start, and resumes it when the time budget runs out. When the
+     * last solution is played back on another thread, call this function
+     * on that thread before handing the instance over, so that solve()
+     * reads a copy frozen at the current playback time. If no solution slot
+     * is free, the last solution is dropped instead.
+     *
+     */
+    void detachSolution();
+
+    /** Get problem data.
+     *
+     * \param problem Output problem, see copyProblem().
+     *
+     */
+    void getProblem(Problem & problem) const;
+
     /** Set duration of the initial single-support phase.
      *
      * \param initSupportDuration First SSP duration.
@@ -173,15 +721,67 @@ namespace vhip_walking
      *
      * If their sum exceeds total duration, phase durations are trimmed
      * starting from the last one.
+     *
+     * Each phase ends at the sampling step closest in time to its end.
      */
     void phaseDurations(double initSupportDuration, double doubleSupportDuration, double targetSupportDuration);
 
-    /** Solve the model predictive control problem.
+    /** Set a uniform time grid.
+     *
+     * \param samplingPeriod Duration of all sampling steps, in [s].
+     *
+     */
+    void samplingPeriod(double samplingPeriod);
+
+    /** Set the time grid of the preview horizon.
      *
-     * \returns solutionFound Did the solver find a solution?
+     * \param stepDurations Durations of sampling steps, in [s].
      *
      */
-    bool solve();
+    void timeGrid(const StepDurations & stepDurations);
+
+    /** Set a two-rate time grid.
+     *
+     * \param finePeriod Duration of the first sampling steps, in [s].
+     *
+     * \param nbFineSteps Number of fine sampling steps.
+     *
+     * \param duration Total duration of the preview horizon, in [s].
+     *
+     * Remaining steps share the rest of the horizon evenly.
+     *
+     */
+    void timeGrid(double finePeriod, unsigned nbFineSteps, double duration);
+
+    /** Solve the model predictive control problem within the configured
+     * time budget.
+     *
+     * \returns solutionFound Is a solution available? See status() for its
+     * kind.
+     *
+     */
+    bool solve()
+    {
+      return solve(timeBudget_);
+    }
+
+    /** Solve the model predictive control problem within a time budget.
+     *
+     * \param timeBudget Wall-clock budget for building and solving the
+     * problem, in [ms]. Zero, negative or infinite values mean no budget.
+     *
+     * \returns solutionFound Is a solution available? See status() for its
+     * kind.
+     *
+     * When the budget runs out, the solution is the best feasible iterate
+     * found so far by the solver. If there is none, the solution is the
+     * previous one resumed at its current playback time, and flagged as
+     * shifted. Only the Riccati formulation and the active-set backend of the
+     * condensed formulation can be interrupted, and only the former has
+     * feasible iterates. Other QP backends run to completion.
+     *
+     */
+    bool solve(double timeBudget);
 
     /** Set the target CoM height.
      *
@@ -220,13 +820,72 @@ namespace vhip_walking
      */
     void initState(const Pendulum & pendulum)
     {
-      initState_ = Eigen::VectorXd(6);
       initState_ << 
         pendulum.com().head<2>(), 
         pendulum.comd().head<2>(),
         pendulum.comdd().head<2>();
     }
 
+    /** Outcome of the last call to solve().
+     *
+     */
+    SolveStatus status() const
+    {
+      return status_;
+    }
+
+    /** Wall-clock budget of solve(), in [ms].
+     *
+     */
+    double timeBudget() const
+    {
+      return timeBudget_;
+    }
+
+    /** Set wall-clock budget of solve().
+     *
+     * \param timeBudget New budget in [ms], infinite by default. Zero or
+     * negative values mean no budget as well.
+     *
+     */
+    void timeBudget(double timeBudget)
+    {
+      timeBudget_ = (timeBudget > 0.) ? timeBudget : std::numeric_limits<double>::infinity();
+    }
+
+    /** Duration in [ms] of the last call to solve().
+     *
+     */
+    double buildAndSolveTime() const
+    {
+      return buildAndSolveTime_;
+    }
+
+    /** Duration in [ms] of problem building in the last call to solve(),
+     * that is, everything but the numerical solver.
+     *
+     */
+    double buildTime() const
+    {
+      return buildTime_;
+    }
+
+    /** Duration in [ms] of the numerical solver in the last call to solve().
+     *
+     */
+    double solveTime() const
+    {
+      return solveTime_;
+    }
+
+    /** Number of solver iterations in the last solve.
+     *
+     * Only the active-set backend of the condensed formulation and the
+     * Riccati formulation report iterations. Other backends report zero.
+     *
+     */
+    unsigned iterations() const;
+
     /** Get solution vector.
      *
      */
@@ -235,6 +894,49 @@ namespace vhip_walking
       return solution_;
     }
 
+    /** Get formulation of the problem.
+     *
+     */
+    Formulation formulation() const
+    {
+      return formulation_;
+    }
+
+    /** Select formulation of the problem.
+     *
+     * \param formulation New formulation.
+     *
+     */
+    void formulation(Formulation formulation);
+
+    /** Duration of a sampling step, in [s].
+     *
+     * \param i Step index.
+     *
+     */
+    double stepDuration(unsigned i) const
+    {
+      return stepTimes_[i + 1] - stepTimes_[i];
+    }
+
+    /** Time of a sampling step from the initial state, in [s].
+     *
+     * \param i Step index, from 0 to NB_STEPS.
+     *
+     */
+    double stepTime(unsigned i) const
+    {
+      return stepTimes_[i];
+    }
+
+    /** Total duration of the preview horizon, in [s].
+     *
+     */
+    double horizonDuration() const
+    {
+      return stepTimes_[NB_STEPS];
+    }
+
     unsigned indexToHrep(unsigned i) const
     {
       return indexToHrep_[i];
@@ -250,6 +952,29 @@ namespace vhip_walking
       return nbDoubleSupportSteps_;
     }
 
+    unsigned nbTargetSupportSteps() const
+    {
+      return nbTargetSupportSteps_;
+    }
+
+    /** Get backend of the QP of the condensed formulation.
+     *
+     */
+    QPBackend qpBackend() const
+    {
+      return qpBackend_;
+    }
+
+    /** Select backend of the QP of the condensed formulation.
+     *
+     * \param backend New backend.
+     *
+     */
+    void qpBackend(QPBackend backend)
+    {
+      qpBackend_ = backend;
+    }
+
     std::string phaseLabel() const
     {
       std::stringstream label;
@@ -276,13 +1001,21 @@ namespace vhip_walking
       return nextContact_;
     }
 
-    using RefVec = Eigen::Matrix<double, 2 * (NB_STEPS + 1), 1>;
-
     const RefVec & velRef() const
     {
       return velRef_;
     }
 
+    /** Frame of the reference velocity of a sampling step.
+     *
+     * \param i Step index, from 0 to NB_STEPS.
+     *
+     */
+    const Eigen::Matrix2d & velRotation(unsigned i) const
+    {
+      return velRotations_[i];
+    }
+
     double zeta() const
     {
       return zeta_;
@@ -294,17 +1027,80 @@ namespace vhip_walking
     }
 
   private:
+    friend struct CondensedFormulation<NB_STEPS>;
+    friend struct CopraFormulation<NB_STEPS>;
+
+    using Condensed = std::conditional_t<HAS_CONDENSED, CondensedFormulation<NB_STEPS>, std::nullptr_t>; // no storage beyond MAX_CONDENSED_STEPS
+    using Riccati = RiccatiInteriorPoint<STATE_SIZE, INPUT_SIZE, NB_ZMP_CONS, NB_TERM_CONS>;
+
+    void computeVelRef();
+
     void computeZMPRef();
 
-    void updateTerminalConstraint();
+    /** Progress of a sampling step in a phase, from 0 at the start of the
+     * phase to 1 at its end.
+     *
+     * \param i Step index.
+     *
+     * \param startStep Index of the first step of the phase.
+     *
+     * \param nbPhaseSteps Number of steps in the phase.
+     *
+     * The result is not clamped and is zero for empty phases.
+     *
+     */
+    double phaseProgress(unsigned i, unsigned startStep, unsigned nbPhaseSteps) const
+    {
+      if (nbPhaseSteps < 1)
+      {
+        return 0.;
+      }
+      double startTime = stepTimes_[startStep];
+      return (stepTimes_[i] - startTime) / (stepTimes_[startStep + nbPhaseSteps] - startTime);
+    }
 
-    void updateZMPConstraint();
+    /** Index of the sampling step closest to a given time.
+     *
+     * \param t Time from the initial state, in [s].
+     *
+     */
+    unsigned stepIndex(double t) const;
 
-    void updateJerkCost();
+    /** Formulation used in place of an unavailable one.
+     *
+     */
+    Formulation fallbackFormulation() const
+    {
+      return HAS_CONDENSED ? Formulation::Condensed : Formulation::Riccati;
+    }
+
+    /** Check whether all sampling steps have the same duration.
+     *
+     */
+    bool isUniformGrid() const
+    {
+      return std::all_of(costScales_.begin(), costScales_.end(), [this](double scale) { return scale == costScales_[0]; });
+    }
+
+    /** Set stages and terminal equality of the Riccati formulation.
+     *
+     */
+    void buildRiccati();
 
-    void updateVelCost();
+    /** Solve the Riccati formulation.
+     *
+     * \param deadline Wall-clock deadline of the interior-point solver.
+     *
+     */
+    bool solveRiccati(TimePoint deadline);
 
-    void updateZMPCost();
+    /** Index of the sampling step where terminal constraints apply.
+     *
+     */
+    unsigned terminalStep() const
+    {
+      return (nbTargetSupportSteps_ < 1) ? nbInitSupportSteps_ + nbDoubleSupportSteps_ : NB_STEPS;
+    }
 
   public:
     Eigen::Vector2d velWeights = {10., 10.};
@@ -312,33 +1108,61 @@ namespace vhip_walking
     double zmpWeight = 1000.;
 
   private:
+    Condensed condensed_; /**< Condensed formulation, only for short horizons */
+    std::shared_ptr<CopraFormulation<NB_STEPS>> copra_ = nullptr; /**< Copra formulation, only in builds with copra */
     Contact initContact_;
     Contact nextContact_;
     Contact targetContact_;
-    Eigen::HrepXd hreps_[4];
-    Eigen::Matrix<double, 2 * (NB_STEPS + 1), 1> velRef_;
-    Eigen::Matrix<double, 2 * (NB_STEPS + 1), 1> zmpRef_;
-    Eigen::Matrix<double, 2 * (NB_STEPS + 1), STATE_SIZE * (NB_STEPS + 1)> velCostMat_;
+    HrepMatrix hrepMats_[4]; /**< Halfspace representations of ZMP areas, indexed by indexToHrep_ */
+    HrepVector hrepVecs_[4];
+    RefVec velRef_;
+    RefVec zmpRef_;
     Eigen::Matrix<double, 2, STATE_SIZE> dcmFromState_;
     Eigen::Matrix<double, 2, STATE_SIZE> zmpFromState_;
-    Eigen::VectorXd initState_;
-    copra::SolverFlag solver_ = copra::SolverFlag::QLD;
-    double buildAndSolveTime_ = 0.; // [s]
+    std::array<StateMatrix, NB_STEPS> stateMatrices_; /**< Discrete-time dynamics over each sampling step */
+    std::array<InputMatrix, NB_STEPS> inputMatrices_; /**< Discrete-time input over each sampling step */
+    StateVector initState_;
+    InputTraj jerkTraj_; /**< Stacked CoM jerk trajectory of the last solution */
+    StateTraj stateTraj_; /**< Stacked CoM state trajectory of the last solution */
+    Formulation formulation_ = HAS_CONDENSED ? Formulation::Condensed : Formulation::Riccati;
+    QPBackend qpBackend_ = QPBackend::QLD;
+    Riccati riccati_;
+    SolveStatus status_ = SolveStatus::Failed;
+    double buildAndSolveTime_ = 0.; // [ms]
+    double buildTime_ = 0.; // [ms]
     double comHeight_;
-    double solveTime_ = 0.; // [s]
+    double solveTime_ = 0.; // [ms]
+    double timeBudget_ = std::numeric_limits<double>::infinity(); // [ms]
     double zeta_;
-    std::shared_ptr<ModelPredictiveControlSolution> solution_ = nullptr;
-    std::shared_ptr<copra::ControlCost> jerkCost_;
-    std::shared_ptr<copra::PreviewSystem> previewSystem_;
-    std::shared_ptr<copra::TrajectoryConstraint> termDCMCons_;
-    std::shared_ptr<copra::TrajectoryConstraint> termZMPCons_;
-    std::shared_ptr<copra::TrajectoryConstraint> zmpCons_;
-    std::shared_ptr<copra::TrajectoryCost> velCost_;
-    std::shared_ptr<copra::TrajectoryCost> zmpCost_;
-    unsigned indexToHrep_[NB_STEPS + 1];
+    std::array<Eigen::Matrix2d, NB_STEPS + 1> velRotations_; /**< Frames of reference velocities */
+    std::array<unsigned, NB_STEPS + 1> indexToHrep_;
+    ModelPredictiveControlSolutionPool<NB_STEPS> solutionPool_;
+    std::shared_ptr<Solution> solution_ = nullptr;
+    StepTimes stepTimes_; // [s]
+    std::array<double, NB_STEPS + 1> costScales_; /**< Cost weights of each step relative to a SAMPLING_PERIOD step */
     unsigned nbDoubleSupportSteps_;
     unsigned nbInitSupportSteps_;
     unsigned nbNextDoubleSupportSteps_;
     unsigned nbTargetSupportSteps_;
   };
+
+  extern template struct ModelPredictiveControlSolution<16>;
+  extern template struct ModelPredictiveControlSolution<32>;
+  extern template struct ModelPredictiveControlSolution<64>;
+  extern template struct ModelPredictiveControlSolutionPool<16>;
+  extern template struct ModelPredictiveControlSolutionPool<32>;
+  extern template struct ModelPredictiveControlSolutionPool<64>;
+  extern template struct ModelPredictiveControlProblem<16>;
+  extern template struct ModelPredictiveControlProblem<32>;
+  extern template struct ModelPredictiveControlProblem<64>;
+  extern template struct CondensedFormulation<16>;
+  extern template struct ModelPredictiveControl<16>;
+  extern template struct ModelPredictiveControl<32>;
+  extern template struct ModelPredictiveControl<64>;
+
+  /** Model predictive control problem solved by the walking controller: 16
+   * steps, that is 1.6 s with the default uniform time grid.
+   *
+   */
+  using WalkingMPC = ModelPredictiveControl<16>;
 }
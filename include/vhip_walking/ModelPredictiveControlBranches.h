@@ -0,0 +1,151 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <array>
+
+#include <vhip_walking/ModelPredictiveControlWorker.h>
+
+namespace vhip_walking
+{
+  /** Upcoming FSM transitions whose MPC problems can be solved ahead of
+   * time.
+   *
+   */
+  enum class PreviewBranch
+  {
+    StartWalking, // Standing to DoubleSupport
+    ContinueWalking, // SingleSupport to DoubleSupport followed by a step
+    PauseWalking // SingleSupport to DoubleSupport where walking stops
+  };
+
+  /** Speculative solves of the MPC problems of upcoming transitions.
+   *
+   * States post the problems of the transitions they may take next, set
+   * for the pendulum state predicted at transition time. Branches share a
+   * single worker thread and are solved one after the other, without time
+   * budget since they are off the critical path. Each branch only keeps the
+   * data of its problem and its solution. At the transition, pickUp() looks
+   * for a solved branch whose problem matches the one set by the new state,
+   * so that its solution replaces the inline solve.
+   *
+   * Branches are matched by problem rather than by label, so that a
+   * solution is never used for a problem it was not computed for.
+   *
+   * \tparam NB_STEPS Number of sampling steps in the preview horizon.
+   *
+   */
+  template <unsigned NB_STEPS>
+  struct ModelPredictiveControlBranches
+  {
+    using Problem = ModelPredictiveControlProblem<NB_STEPS>;
+    using SolveStatus = ModelPredictiveControlBase::SolveStatus;
+
+    static constexpr unsigned NB_BRANCHES = 3;
+    static_assert(NB_BRANCHES <= ModelPredictiveControlSolutionPool<NB_STEPS>::MAX_BRANCHES, "Solution pool too small for all branches");
+
+    /** Tolerance on initial state and contacts when matching problems.
+     *
+     * Contact poses may drift by a fraction of a millimeter between
+     * prediction and transition, e.g. when the plan is adjusted to the
+     * actual landing pose of the swing foot. Such deviations are negligible
+     * before ZMP support areas and are corrected at the next preview update.
+     *
+     */
+    static constexpr double MATCH_TOLERANCE = 1e-3;
+
+    /** Log branch entries.
+     *
+     * \param logger Logger.
+     *
+     */
+    void addLogEntries(mc_rtc::Logger & logger);
+
+    /** Post the problem of a branch to the worker.
+     *
+     * \param branch Transition the problem is set for.
+     *
+     * \param problem Problem to solve, copied on the calling thread.
+     *
+     * \returns posted False if the worker is still busy with a previous
+     * problem of any branch, in which case the caller posts again at a later
+     * cycle. Problems matching the last one solved for the branch are not
+     * solved again.
+     *
+     */
+    bool post(PreviewBranch branch, const Problem & problem);
+
+    /** Pick up the solution of a branch matching a given problem.
+     *
+     * \param problem Problem set at transition.
+     *
+     * \param preview Output solution, handed out as is. Solutions that
+     * have started playing back are not served again.
+     *
+     * \param status Output outcome of the solver.
+     *
+     * \returns found True if a solved branch matches the problem.
+     *
+     */
+    bool pickUp(const Problem & problem, std::shared_ptr<Preview> & preview, SolveStatus & status);
+
+  private:
+    /** Speculative problem and its solution.
+     *
+     */
+    struct Branch
+    {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      Problem problem;
+      SolveStatus status = SolveStatus::Failed;
+      bool isPending = false; /**< Problem posted and not picked up from the worker yet */
+      bool isSolved = false; /**< Worker is done with the problem */
+      std::shared_ptr<Preview> solution = nullptr; /**< Shared with the controller once picked up */
+    };
+
+    /** Collect the solution of the pending branch if the worker is done.
+     *
+     * \returns isWorkerBusy True if a branch is still being solved.
+     *
+     */
+    bool collect();
+
+  private:
+    std::array<Branch, NB_BRANCHES> branches_;
+    ModelPredictiveControlWorker<NB_STEPS> worker_; /**< Shared by all branches */
+    unsigned nbHits_ = 0; /**< Inline solves replaced by a branch solution */
+    unsigned nbMisses_ = 0; /**< Inline solves without matching branch */
+    unsigned long nbPosts_ = 0;
+  };
+
+  extern template struct ModelPredictiveControlBranches<16>;
+  extern template struct ModelPredictiveControlBranches<32>;
+  extern template struct ModelPredictiveControlBranches<64>;
+}
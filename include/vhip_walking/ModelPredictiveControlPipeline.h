@@ -0,0 +1,271 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <memory>
+
+#include <vhip_walking/ModelPredictiveControl.h>
+#include <vhip_walking/ModelPredictiveControlBranches.h>
+#include <vhip_walking/ModelPredictiveControlWorker.h>
+
+namespace vhip_walking
+{
+  /** Model predictive control of the walking controller, over a horizon
+   * selected at runtime.
+   *
+   * FSM states set the problem through this interface, then the controller
+   * solves it inline, on the worker thread or from a speculative branch.
+   * Implementations bundle the problem, its worker and its branches, all
+   * instantiated for the same number of sampling steps. Three solver
+   * instances are allocated: one on the control thread, one for preview
+   * updates and one shared by all branches.
+   *
+   */
+  struct ModelPredictiveControlPipelineBase
+  {
+    using SolveStatus = ModelPredictiveControlBase::SolveStatus;
+
+    virtual ~ModelPredictiveControlPipelineBase() = default;
+
+    /** Number of sampling steps in the preview horizon.
+     *
+     */
+    virtual unsigned nbSteps() const = 0;
+
+    /** Read configuration from dictionary.
+     *
+     * \param config Configuration dictionary, see ModelPredictiveControl.
+     *
+     */
+    virtual void configure(const mc_rtc::Configuration & config) = 0;
+
+    /** Add GUI panel.
+     *
+     * \param gui GUI handle.
+     *
+     */
+    virtual void addGUIElements(std::shared_ptr<mc_rtc::gui::StateBuilder> gui) = 0;
+
+    /** Log MPC, worker and branch entries.
+     *
+     * \param logger Logger.
+     *
+     */
+    virtual void addLogEntries(mc_rtc::Logger & logger) = 0;
+
+    /** Set the target CoM height.
+     *
+     */
+    virtual void comHeight(double height) = 0;
+
+    /** Reset contacts.
+     *
+     * \param initContact Contact used during single-support phase.
+     *
+     * \param targetContact Contact used during double-support phases.
+     *
+     * \param nextContact Contact after the target one.
+     *
+     */
+    virtual void contacts(Contact initContact, Contact targetContact, Contact nextContact) = 0;
+
+    /** Set the initial CoM state.
+     *
+     * \param pendulum CoM state.
+     *
+     */
+    virtual void initState(const Pendulum & pendulum) = 0;
+
+    /** Set duration of the initial single-support phase, of the following
+     * double-support phase and of the target single-support phase.
+     *
+     * See ModelPredictiveControl::phaseDurations().
+     *
+     */
+    virtual void phaseDurations(double initSupportDuration, double doubleSupportDuration, double targetSupportDuration) = 0;
+
+    /** Solve the problem on the calling thread.
+     *
+     * \returns solutionFound Is a solution available? See status() for its
+     * kind.
+     *
+     */
+    virtual bool solve() = 0;
+
+    /** Outcome of the last call to solve().
+     *
+     */
+    virtual SolveStatus status() const = 0;
+
+    /** Solution of the last call to solve().
+     *
+     */
+    virtual std::shared_ptr<Preview> solution() = 0;
+
+    /** Post the problem to the worker thread.
+     *
+     * See ModelPredictiveControlWorker::post().
+     *
+     */
+    virtual bool postUpdate(unsigned long id) = 0;
+
+    /** Pick up the solution computed by the worker thread.
+     *
+     * See ModelPredictiveControlWorker::pickUp().
+     *
+     */
+    virtual bool pickUpUpdate(std::shared_ptr<Preview> & preview, SolveStatus & status, unsigned long & id) = 0;
+
+    /** Post the problem of a speculative branch.
+     *
+     * See ModelPredictiveControlBranches::post().
+     *
+     */
+    virtual bool postBranch(PreviewBranch branch) = 0;
+
+    /** Pick up the solution of a branch matching the problem.
+     *
+     * See ModelPredictiveControlBranches::pickUp().
+     *
+     */
+    virtual bool pickUpBranch(std::shared_ptr<Preview> & preview, SolveStatus & status) = 0;
+  };
+
+  /** Model predictive control of the walking controller over a given
+   * horizon.
+   *
+   * \tparam NB_STEPS Number of sampling steps in the preview horizon.
+   *
+   */
+  template <unsigned NB_STEPS>
+  struct ModelPredictiveControlPipeline : ModelPredictiveControlPipelineBase
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    unsigned nbSteps() const override
+    {
+      return NB_STEPS;
+    }
+
+    void configure(const mc_rtc::Configuration & config) override
+    {
+      mpc_.configure(config);
+    }
+
+    void addGUIElements(std::shared_ptr<mc_rtc::gui::StateBuilder> gui) override
+    {
+      mpc_.addGUIElements(gui);
+    }
+
+    void addLogEntries(mc_rtc::Logger & logger) override
+    {
+      logger.addLogEntry("mpc_weights_jerk", [this]() { return mpc_.jerkWeight; });
+      logger.addLogEntry("mpc_weights_vel", [this]() { return mpc_.velWeights; });
+      logger.addLogEntry("mpc_weights_zmp", [this]() { return mpc_.zmpWeight; });
+      mpc_.addLogEntries(logger);
+      branches_.addLogEntries(logger);
+      worker_.addLogEntries(logger);
+    }
+
+    void comHeight(double height) override
+    {
+      mpc_.comHeight(height);
+    }
+
+    void contacts(Contact initContact, Contact targetContact, Contact nextContact) override
+    {
+      mpc_.contacts(initContact, targetContact, nextContact);
+    }
+
+    void initState(const Pendulum & pendulum) override
+    {
+      mpc_.initState(pendulum);
+    }
+
+    void phaseDurations(double initSupportDuration, double doubleSupportDuration, double targetSupportDuration) override
+    {
+      mpc_.phaseDurations(initSupportDuration, doubleSupportDuration, targetSupportDuration);
+    }
+
+    bool solve() override
+    {
+      return mpc_.solve();
+    }
+
+    SolveStatus status() const override
+    {
+      return mpc_.status();
+    }
+
+    std::shared_ptr<Preview> solution() override
+    {
+      return mpc_.solution();
+    }
+
+    bool postUpdate(unsigned long id) override
+    {
+      mpc_.getProblem(problem_);
+      return worker_.post(problem_, id);
+    }
+
+    bool pickUpUpdate(std::shared_ptr<Preview> & preview, SolveStatus & status, unsigned long & id) override
+    {
+      return worker_.pickUp(preview, status, id);
+    }
+
+    bool postBranch(PreviewBranch branch) override
+    {
+      mpc_.getProblem(problem_);
+      return branches_.post(branch, problem_);
+    }
+
+    bool pickUpBranch(std::shared_ptr<Preview> & preview, SolveStatus & status) override
+    {
+      mpc_.getProblem(problem_);
+      return branches_.pickUp(problem_, preview, status);
+    }
+
+  private:
+    ModelPredictiveControl<NB_STEPS> mpc_;
+    ModelPredictiveControlProblem<NB_STEPS> problem_; /**< Problem of mpc_ handed to the worker and branches */
+    ModelPredictiveControlBranches<NB_STEPS> branches_;
+    ModelPredictiveControlWorker<NB_STEPS> worker_;
+  };
+
+  /** Create the model predictive control of the walking controller.
+   *
+   * \param nbSteps Number of sampling steps in the preview horizon, among
+   * those instantiated in ModelPredictiveControl.cpp (16, 32 or 64).
+   *
+   * \throws std::invalid_argument if there is no instance for this number
+   * of steps.
+   *
+   */
+  std::unique_ptr<ModelPredictiveControlPipelineBase> makeModelPredictiveControlPipeline(unsigned nbSteps);
+}
@@ -0,0 +1,144 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <vhip_walking/ModelPredictiveControl.h>
+
+namespace vhip_walking
+{
+  /** Solve model predictive control problems on a dedicated thread.
+   *
+   * The control thread posts a problem with post() and picks up its
+   * solution with pickUp() at a later control cycle, while it keeps
+   * integrating the current preview. The preview being integrated and the
+   * one being computed by the worker form a double buffer: the worker only
+   * touches its own ModelPredictiveControl instance, and ownership of this
+   * instance is handed over through an atomic status, so that neither call
+   * waits on the worker. A solution picked up is not touched by the worker
+   * afterwards: post() gives the worker a copy of it at its current playback
+   * time for warm starting.
+   *
+   * The worker thread sleeps on a condition variable between problems, so
+   * that an idle worker costs no CPU time.
+   *
+   * Only one problem is in flight at a time: post() returns false while the
+   * worker is solving or its last solution has not been picked up yet.
+   *
+   * \tparam NB_STEPS Number of sampling steps in the preview horizon.
+   *
+   */
+  template <unsigned NB_STEPS>
+  struct ModelPredictiveControlWorker
+  {
+    using MPC = ModelPredictiveControl<NB_STEPS>;
+    using Problem = ModelPredictiveControlProblem<NB_STEPS>;
+    using SolveStatus = ModelPredictiveControlBase::SolveStatus;
+
+    /** Start worker thread.
+     *
+     */
+    ModelPredictiveControlWorker();
+
+    /** Stop and join worker thread.
+     *
+     */
+    ~ModelPredictiveControlWorker();
+
+    /** Log worker entries.
+     *
+     * \param logger Logger.
+     *
+     */
+    void addLogEntries(mc_rtc::Logger & logger);
+
+    /** Post a new problem to the worker thread.
+     *
+     * \param problem Problem to solve, copied on the calling thread.
+     *
+     * \param id Identifier returned along with the solution.
+     *
+     * \returns posted False if the worker is busy.
+     *
+     */
+    bool post(const Problem & problem, unsigned long id);
+
+    /** Pick up the solution to the last posted problem, if available.
+     *
+     * \param preview Output solution, unchanged if the solver failed.
+     *
+     * \param status Output outcome of the solver.
+     *
+     * \param id Identifier of the problem passed to post().
+     *
+     * \returns available True if the worker was done with the problem, in
+     * which case the worker is ready for the next post().
+     *
+     */
+    bool pickUp(std::shared_ptr<Preview> & preview, SolveStatus & status, unsigned long & id);
+
+  private:
+    /** Ownership of the worker's problem and solution.
+     *
+     */
+    enum class Status
+    {
+      Idle, // owned by the control thread, nothing to pick up
+      Requested, // owned by the worker thread
+      Done // owned by the control thread, solution to pick up
+    };
+
+    /** Main loop of the worker thread.
+     *
+     */
+    void run();
+
+  private:
+    MPC mpc_;
+    SolveStatus solveStatus_ = SolveStatus::Failed; /**< Outcome of the solver on the last problem */
+    double buildAndSolveTime_ = 0.; /**< Duration in [ms] of the last solve, copied at pick up */
+    double latency_ = 0.; /**< Duration in [ms] from post to pick up of the last solution */
+    std::atomic<Status> status_ = {Status::Idle};
+    std::atomic<bool> stop_ = {false};
+    std::chrono::high_resolution_clock::time_point postTime_;
+    std::condition_variable wakeUp_;
+    std::mutex wakeUpMutex_;
+    unsigned long id_ = 0;
+    std::thread thread_; // last, so that it starts after other members are initialized
+  };
+
+  extern template struct ModelPredictiveControlWorker<16>;
+  extern template struct ModelPredictiveControlWorker<32>;
+  extern template struct ModelPredictiveControlWorker<64>;
+}
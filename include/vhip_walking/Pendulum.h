@@ -99,6 +99,21 @@ namespace vhip_walking
      */
     void resetCoMHeight(double height, const Contact & contact);
 
+    /** Overwrite pendulum state, e.g. when replaying logged references.
+     *
+     * \param com CoM position.
+     *
+     * \param comd CoM velocity.
+     *
+     * \param comdd CoM acceleration.
+     *
+     * \param zmp ZMP position.
+     *
+     * \param omega Natural frequency.
+     *
+     */
+    void setState(const Eigen::Vector3d & com, const Eigen::Vector3d & comd, const Eigen::Vector3d & comdd, const Eigen::Vector3d & zmp, double omega);
+
     /** Get CoM position of the inverted pendulum model.
      *
      */
@@ -123,6 +138,14 @@ namespace vhip_walking
       return comdd_;
     }
 
+    /** Get CoM jerk of the inverted pendulum.
+     *
+     */
+    const Eigen::Vector3d & comddd() const
+    {
+      return comddd_;
+    }
+
     /** Instantaneous Divergent Component of Motion.
      *
      */
@@ -37,6 +37,40 @@ namespace vhip_walking
    */
   struct Preview
   {
+    /** Horizontal CoM state and ZMP at a given time of the preview.
+     *
+     */
+    struct Sample
+    {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      Eigen::Vector2d com;
+      Eigen::Vector2d comd;
+      Eigen::Vector2d comdd;
+      Eigen::Vector2d comddd;
+      Eigen::Vector2d zmp;
+    };
+
+    /** Integrate upcoming control steps of the playback on a given state,
+     * without changing the playback state.
+     *
+     * \param state CoM state to integrate upon.
+     *
+     * \param dt Duration of a control step.
+     *
+     * \param nbSteps Number of control steps.
+     *
+     */
+    virtual void predict(Pendulum & state, double dt, unsigned nbSteps) const = 0;
+
+    /** Sample the preview at a given time, without changing its playback
+     * state.
+     *
+     * \param t Time from the initial state of the preview, in [s].
+     *
+     */
+    virtual Sample sample(double t) const = 0;
+
     /** Integrate preview on a given inverted pendulum state.
      *
      * \param pendulum Inverted pendulum model.
@@ -0,0 +1,680 @@
+/*
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+namespace vhip_walking
+{
+  /** Stage-wise interior-point solver for linear-quadratic optimal control.
+   *
+   * Solves problems over a horizon of N steps in the form:
+   *
+   *    minimize    sum_{k=1}^{N} (x_k^T Q_k x_k / 2 + q_k^T x_k)
+   *                  + sum_{k=0}^{N-1} u_k^T R_k u_k / 2
+   *    subject to  x_{k+1} = A_k x_k + B_k u_k
+   *                D_k x_k <= d_k    for constrained steps k >= 1
+   *                E x_m = e         at a single step m >= 1 (optional)
+   *
+   * where the initial state x_0 is given. States and inputs are kept as
+   * stage variables rather than condensed on the input trajectory, so that
+   * computation time grows linearly with the number of steps N.
+   *
+   * The method is Mehrotra's predictor-corrector primal-dual interior point
+   * algorithm. Each Newton step is an equality-constrained linear-quadratic
+   * problem, where inequalities have been replaced by their barrier Hessian,
+   * solved by a backward Riccati recursion followed by a forward rollout. The
+   * equality constraint is handled by linearity: trajectories are affine in
+   * its Lagrange multiplier, whose value is then found by solving a small
+   * system of NB_EQ equations.
+   *
+   * Storage is allocated by resize() only, so that solve() does not
+   * allocate.
+   *
+   * Iterates are dynamically feasible but may violate inequality constraints
+   * until convergence. When a deadline is set and the solver reaches it, the
+   * feasible iterate of lowest cost found so far, if any, is kept as
+   * solution.
+   *
+   */
+  template <int STATE_SIZE, int INPUT_SIZE, int NB_INEQ, int NB_EQ>
+  struct RiccatiInteriorPoint
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    static constexpr double FEASIBILITY_TOL = 1e-8;
+    static constexpr double MU_TOL = 1e-9;
+    static constexpr double STEP_FACTOR = 0.995; // fraction to the boundary
+    static constexpr unsigned MAX_ITER = 50;
+
+    using EqMatrix = Eigen::Matrix<double, NB_EQ, STATE_SIZE>;
+    using EqVector = Eigen::Matrix<double, NB_EQ, 1>;
+    using IneqMatrix = Eigen::Matrix<double, NB_INEQ, STATE_SIZE>;
+    using IneqVector = Eigen::Matrix<double, NB_INEQ, 1>;
+    using InputMatrix = Eigen::Matrix<double, STATE_SIZE, INPUT_SIZE>;
+    using InputVector = Eigen::Matrix<double, INPUT_SIZE, 1>;
+    using StateMatrix = Eigen::Matrix<double, STATE_SIZE, STATE_SIZE>;
+    using StateVector = Eigen::Matrix<double, STATE_SIZE, 1>;
+    using TimePoint = std::chrono::high_resolution_clock::time_point;
+
+    /** Problem data and solver storage of a step k of the horizon.
+     *
+     * Dynamics and input cost (A, B, R) refer to the transition from step k
+     * to k + 1 and are not used at the last step. State cost and inequality
+     * constraints (Q, q, D, d) are not used at the first step, where the
+     * state is fixed.
+     *
+     */
+    struct Stage
+    {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      StateMatrix A = StateMatrix::Identity();
+      InputMatrix B = InputMatrix::Zero();
+      Eigen::Matrix<double, INPUT_SIZE, INPUT_SIZE> R = Eigen::Matrix<double, INPUT_SIZE, INPUT_SIZE>::Identity();
+      StateMatrix Q = StateMatrix::Zero();
+      StateVector q = StateVector::Zero();
+      IneqMatrix D = IneqMatrix::Zero();
+      IneqVector d = IneqVector::Zero();
+      bool constrained = false; /**< Are inequality constraints enforced at this step? */
+
+    private:
+      friend struct RiccatiInteriorPoint;
+
+      Eigen::LLT<Eigen::Matrix<double, INPUT_SIZE, INPUT_SIZE>> inputHessian; /**< Decomposition of R + B^T P B */
+      Eigen::Matrix<double, INPUT_SIZE, STATE_SIZE> K; /**< Feedback gain of the Riccati recursion */
+      Eigen::Matrix<double, INPUT_SIZE, NB_EQ> inputSens; /**< Sensitivity of u_k to the equality multiplier */
+      Eigen::Matrix<double, STATE_SIZE, NB_EQ> stateSens; /**< Sensitivity of x_k to the equality multiplier */
+      Eigen::Matrix<double, STATE_SIZE, NB_EQ> valueGradSens;
+      InputVector u;
+      InputVector uNewton; /**< Input of the last solution to the Newton system */
+      InputVector uff; /**< Feedforward input of the Riccati recursion */
+      IneqVector ds_aff;
+      IneqVector dz_aff;
+      IneqVector ds;
+      IneqVector dz;
+      IneqVector s; /**< Slack variables of inequality constraints */
+      IneqVector z; /**< Lagrange multipliers of inequality constraints */
+      StateMatrix P; /**< Hessian of the value function */
+      StateMatrix barrierQ; /**< State cost Hessian with barrier terms */
+      StateVector barrierq;
+      StateVector valueGrad; /**< Gradient of the value function */
+      StateVector x;
+      StateVector xNewton; /**< State of the last solution to the Newton system */
+      InputVector uBest; /**< Input of the best feasible iterate */
+      StateVector xBest; /**< State of the best feasible iterate */
+    };
+
+    /** Initialize solver for a given horizon.
+     *
+     * \param nbSteps Number of steps N in the horizon.
+     *
+     */
+    RiccatiInteriorPoint(unsigned nbSteps = 1)
+    {
+      resize(nbSteps);
+      E_.setZero();
+      e_.setZero();
+    }
+
+    /** Change the number of steps in the horizon.
+     *
+     * \param nbSteps New number of steps.
+     *
+     * This is the only function that allocates memory.
+     *
+     */
+    void resize(unsigned nbSteps)
+    {
+      nbSteps_ = std::max(nbSteps, 1u);
+      stages_.resize(nbSteps_ + 1);
+      eqStep_ = std::min(eqStep_, nbSteps_);
+    }
+
+    /** Number of steps N in the horizon.
+     *
+     */
+    unsigned nbSteps() const
+    {
+      return nbSteps_;
+    }
+
+    /** Access problem data of a step of the horizon.
+     *
+     * \param k Step index between 0 and N.
+     *
+     */
+    Stage & stage(unsigned k)
+    {
+      return stages_[k];
+    }
+
+    /** Set the equality constraint E x_m = e.
+     *
+     * \param step Step index m, between 1 and N.
+     *
+     * \param E Constraint matrix.
+     *
+     * \param e Constraint vector.
+     *
+     */
+    void equality(unsigned step, const EqMatrix & E, const EqVector & e)
+    {
+      eqStep_ = std::min(std::max(step, 1u), nbSteps_);
+      E_ = E;
+      e_ = e;
+      hasEquality_ = true;
+    }
+
+    /** Remove the equality constraint.
+     *
+     */
+    void clearEquality()
+    {
+      hasEquality_ = false;
+    }
+
+    /** Set the wall-clock deadline of subsequent calls to solve().
+     *
+     * \param deadline Time point after which the solver stops iterating, or
+     * TimePoint::max() to iterate until convergence.
+     *
+     */
+    void deadline(TimePoint deadline)
+    {
+      deadline_ = deadline;
+    }
+
+    /** Solve problem from a given initial state.
+     *
+     * \param x0 Initial state.
+     *
+     * \returns solutionFound Did the solver converge to a solution?
+     *
+     * If the solver stops at its deadline, this function returns false but
+     * state() and input() hold the best feasible iterate when feasible() is
+     * true.
+     *
+     */
+    bool solve(const StateVector & x0)
+    {
+      using namespace std::chrono;
+      auto startTime = high_resolution_clock::now();
+      timedOut_ = false;
+      bestCost_ = std::numeric_limits<double>::infinity();
+      bool solutionFound = runInteriorPoint(x0);
+      bool hasFeasibleIterate = (bestCost_ < std::numeric_limits<double>::infinity());
+      if (timedOut_ && hasFeasibleIterate)
+      {
+        for (unsigned k = 0; k <= nbSteps_; k++)
+        {
+          Stage & stage = stages_[k];
+          stage.x = stage.xBest;
+          stage.u = stage.uBest;
+        }
+      }
+      feasible_ = solutionFound || (timedOut_ && hasFeasibleIterate);
+      auto endTime = high_resolution_clock::now();
+      solveTime_ = 1000. * duration_cast<duration<double>>(endTime - startTime).count();
+      return solutionFound;
+    }
+
+    /** Did the last call to solve() stop at its deadline?
+     *
+     */
+    bool timedOut() const
+    {
+      return timedOut_;
+    }
+
+    /** Do state() and input() hold a feasible trajectory, either the
+     * solution or the best feasible iterate of an interrupted solve?
+     *
+     */
+    bool feasible() const
+    {
+      return feasible_;
+    }
+
+    /** Optimal input at a given step.
+     *
+     * \param k Step index between 0 and N - 1.
+     *
+     */
+    const InputVector & input(unsigned k) const
+    {
+      return stages_[k].u;
+    }
+
+    /** Optimal state at a given step.
+     *
+     * \param k Step index between 0 and N.
+     *
+     */
+    const StateVector & state(unsigned k) const
+    {
+      return stages_[k].x;
+    }
+
+    /** Number of interior-point iterations in the last solve.
+     *
+     */
+    unsigned iterations() const
+    {
+      return iterations_;
+    }
+
+    /** Duration in [ms] of the last call to solve().
+     *
+     */
+    double solveTime() const
+    {
+      return solveTime_;
+    }
+
+  private:
+    /** Main loop of the interior-point method.
+     *
+     * \param x0 Initial state.
+     *
+     */
+    bool runInteriorPoint(const StateVector & x0)
+    {
+      iterations_ = 0;
+      nbIneq_ = 0;
+      for (unsigned k = 1; k <= nbSteps_; k++)
+      {
+        nbIneq_ += stages_[k].constrained ? NB_INEQ : 0;
+      }
+      stages_[0].x = x0;
+
+      // Initial point: solution without inequality constraints, from which
+      // slack variables are shifted inside the positive orthant
+      for (unsigned k = 1; k <= nbSteps_; k++)
+      {
+        Stage & stage = stages_[k];
+        stage.barrierQ = stage.Q;
+        stage.barrierq = stage.q;
+      }
+      if (!factorize() || !solveNewtonSystem())
+      {
+        return false;
+      }
+      for (unsigned k = 0; k <= nbSteps_; k++)
+      {
+        Stage & stage = stages_[k];
+        stage.x = stage.xNewton;
+        stage.u = stage.uNewton;
+        if (k > 0 && stage.constrained)
+        {
+          stage.s = (stage.d - stage.D * stage.x).cwiseMax(INIT_SLACK);
+          stage.z.setConstant(INIT_MULTIPLIER);
+        }
+      }
+      if (nbIneq_ == 0)
+      {
+        return true;
+      }
+
+      while (iterations_ < MAX_ITER)
+      {
+        double mu = 0.;
+        double primalResidual = 0.;
+        double maxViolation = 0.;
+        for (unsigned k = 1; k <= nbSteps_; k++)
+        {
+          const Stage & stage = stages_[k];
+          if (stage.constrained)
+          {
+            mu += stage.s.dot(stage.z);
+            primalResidual = std::max(primalResidual, (stage.D * stage.x + stage.s - stage.d).cwiseAbs().maxCoeff());
+            maxViolation = std::max(maxViolation, (stage.D * stage.x - stage.d).maxCoeff());
+          }
+        }
+        mu /= nbIneq_;
+        double eqResidual = hasEquality_ ? (E_ * stages_[eqStep_].x - e_).cwiseAbs().maxCoeff() : 0.;
+        if (mu < MU_TOL && primalResidual < FEASIBILITY_TOL && eqResidual < FEASIBILITY_TOL)
+        {
+          return true;
+        }
+        if (maxViolation < FEASIBILITY_TOL && eqResidual < FEASIBILITY_TOL)
+        {
+          saveIfBest();
+        }
+        if (std::chrono::high_resolution_clock::now() > deadline_)
+        {
+          timedOut_ = true;
+          return false;
+        }
+        iterations_++;
+
+        // Barrier Hessian, shared by predictor and corrector steps
+        for (unsigned k = 1; k <= nbSteps_; k++)
+        {
+          Stage & stage = stages_[k];
+          stage.barrierQ = stage.Q;
+          if (stage.constrained)
+          {
+            IneqVector sigma = stage.z.cwiseQuotient(stage.s);
+            stage.barrierQ.noalias() += stage.D.transpose() * sigma.asDiagonal() * stage.D;
+          }
+        }
+        if (!factorize())
+        {
+          return false;
+        }
+
+        // Affine-scaling predictor
+        for (unsigned k = 1; k <= nbSteps_; k++)
+        {
+          Stage & stage = stages_[k];
+          stage.barrierq = stage.q;
+          if (stage.constrained)
+          {
+            IneqVector sigma = stage.z.cwiseQuotient(stage.s);
+            stage.barrierq.noalias() += stage.D.transpose() * sigma.cwiseProduct(stage.s - stage.d);
+          }
+        }
+        if (!solveNewtonSystem())
+        {
+          return false;
+        }
+        computeSlackSteps(0., false);
+        double alphaAff = maxStepLength();
+        double muAff = 0.;
+        for (unsigned k = 1; k <= nbSteps_; k++)
+        {
+          Stage & stage = stages_[k];
+          if (stage.constrained)
+          {
+            stage.ds_aff = stage.ds;
+            stage.dz_aff = stage.dz;
+            muAff += (stage.s + alphaAff * stage.ds).dot(stage.z + alphaAff * stage.dz);
+          }
+        }
+        muAff /= nbIneq_;
+        double sigmaMu = std::pow(muAff / mu, 3) * mu;
+
+        // Centering corrector
+        for (unsigned k = 1; k <= nbSteps_; k++)
+        {
+          Stage & stage = stages_[k];
+          stage.barrierq = stage.q;
+          if (stage.constrained)
+          {
+            IneqVector sigma = stage.z.cwiseQuotient(stage.s);
+            IneqVector centering = (sigmaMu - stage.ds_aff.cwiseProduct(stage.dz_aff).array()).matrix().cwiseQuotient(stage.s);
+            stage.barrierq.noalias() += stage.D.transpose() * (centering + sigma.cwiseProduct(stage.s - stage.d));
+          }
+        }
+        if (!solveNewtonSystem())
+        {
+          return false;
+        }
+        computeSlackSteps(sigmaMu, true);
+        double alpha = std::min(1., STEP_FACTOR * maxStepLength());
+        for (unsigned k = 0; k <= nbSteps_; k++)
+        {
+          Stage & stage = stages_[k];
+          stage.x += alpha * (stage.xNewton - stage.x);
+          stage.u += alpha * (stage.uNewton - stage.u);
+          if (k > 0 && stage.constrained)
+          {
+            stage.s += alpha * stage.ds;
+            stage.z += alpha * stage.dz;
+          }
+        }
+      }
+      return false;
+    }
+
+    /** Cost of the current iterate.
+     *
+     */
+    double cost() const
+    {
+      double cost = 0.;
+      for (unsigned k = 0; k <= nbSteps_; k++)
+      {
+        const Stage & stage = stages_[k];
+        if (k > 0)
+        {
+          cost += stage.x.dot(0.5 * stage.Q * stage.x + stage.q);
+        }
+        if (k < nbSteps_)
+        {
+          cost += 0.5 * stage.u.dot(stage.R * stage.u);
+        }
+      }
+      return cost;
+    }
+
+    /** Save the current iterate if its cost is lower than that of the best
+     * feasible iterate so far.
+     *
+     */
+    void saveIfBest()
+    {
+      double iterateCost = cost();
+      if (iterateCost >= bestCost_)
+      {
+        return;
+      }
+      bestCost_ = iterateCost;
+      for (unsigned k = 0; k <= nbSteps_; k++)
+      {
+        Stage & stage = stages_[k];
+        stage.xBest = stage.x;
+        stage.uBest = stage.u;
+      }
+    }
+
+    /** Backward Riccati recursion on the barrier Hessian.
+     *
+     * When there is an equality constraint, this function also computes
+     * sensitivities of the trajectory to its Lagrange multiplier.
+     *
+     */
+    bool factorize()
+    {
+      stages_[nbSteps_].P = stages_[nbSteps_].barrierQ;
+      for (int k = static_cast<int>(nbSteps_) - 1; k >= 0; k--)
+      {
+        Stage & stage = stages_[k];
+        const StateMatrix & nextP = stages_[k + 1].P;
+        InputMatrix PB = nextP * stage.B;
+        stage.inputHessian.compute(stage.R + stage.B.transpose() * PB);
+        if (stage.inputHessian.info() != Eigen::Success)
+        {
+          return false;
+        }
+        stage.K = -stage.inputHessian.solve(PB.transpose() * stage.A);
+        if (k > 0)
+        {
+          stage.P = stage.barrierQ;
+          stage.P.noalias() += stage.A.transpose() * (nextP * stage.A + PB * stage.K);
+          stage.P = 0.5 * (stage.P + stage.P.transpose()).eval();
+        }
+      }
+      if (!hasEquality_)
+      {
+        return true;
+      }
+
+      // Multiplier lambda adds E^T lambda to the linear cost at step m
+      stages_[eqStep_].valueGradSens = E_.transpose();
+      for (int k = static_cast<int>(eqStep_) - 1; k >= 0; k--)
+      {
+        Stage & stage = stages_[k];
+        const Stage & next = stages_[k + 1];
+        stage.inputSens = -stage.inputHessian.solve(stage.B.transpose() * next.valueGradSens);
+        if (k > 0)
+        {
+          stage.valueGradSens.noalias() = stage.A.transpose() * (next.valueGradSens + next.P * stage.B * stage.inputSens);
+        }
+      }
+      for (unsigned k = eqStep_; k < nbSteps_; k++)
+      {
+        stages_[k].inputSens.setZero();
+      }
+      stages_[0].stateSens.setZero();
+      for (unsigned k = 0; k < nbSteps_; k++)
+      {
+        Stage & stage = stages_[k];
+        stage.inputSens.noalias() += stage.K * stage.stateSens;
+        stages_[k + 1].stateSens.noalias() = stage.A * stage.stateSens + stage.B * stage.inputSens;
+      }
+      eqSensitivity_.compute(E_ * stages_[eqStep_].stateSens);
+      return eqSensitivity_.rcond() > std::numeric_limits<double>::epsilon();
+    }
+
+    /** Solve the linear-quadratic problem with current barrier terms.
+     *
+     * The solution is written to (xNewton, uNewton). As dynamics are linear,
+     * the Newton step on states and inputs goes from the current iterate to
+     * this solution.
+     *
+     */
+    bool solveNewtonSystem()
+    {
+      stages_[nbSteps_].valueGrad = stages_[nbSteps_].barrierq;
+      for (int k = static_cast<int>(nbSteps_) - 1; k >= 0; k--)
+      {
+        Stage & stage = stages_[k];
+        const Stage & next = stages_[k + 1];
+        stage.uff = -stage.inputHessian.solve(stage.B.transpose() * next.valueGrad);
+        if (k > 0)
+        {
+          stage.valueGrad = stage.barrierq;
+          stage.valueGrad.noalias() += stage.A.transpose() * (next.valueGrad + next.P * stage.B * stage.uff);
+        }
+      }
+      stages_[0].xNewton = stages_[0].x;
+      for (unsigned k = 0; k < nbSteps_; k++)
+      {
+        Stage & stage = stages_[k];
+        stage.uNewton = stage.uff;
+        stage.uNewton.noalias() += stage.K * stage.xNewton;
+        stages_[k + 1].xNewton.noalias() = stage.A * stage.xNewton + stage.B * stage.uNewton;
+      }
+      if (hasEquality_)
+      {
+        EqVector lambda = eqSensitivity_.solve(e_ - E_ * stages_[eqStep_].xNewton);
+        for (unsigned k = 0; k <= nbSteps_; k++)
+        {
+          Stage & stage = stages_[k];
+          stage.xNewton.noalias() += stage.stateSens * lambda;
+          if (k < nbSteps_)
+          {
+            stage.uNewton.noalias() += stage.inputSens * lambda;
+          }
+        }
+      }
+      return true;
+    }
+
+    /** Compute Newton steps of slack variables and multipliers.
+     *
+     * \param sigmaMu Centering target of complementarity products.
+     *
+     * \param corrector Add the second-order term of the affine predictor?
+     *
+     */
+    void computeSlackSteps(double sigmaMu, bool corrector)
+    {
+      for (unsigned k = 1; k <= nbSteps_; k++)
+      {
+        Stage & stage = stages_[k];
+        if (stage.constrained)
+        {
+          stage.ds = stage.d - stage.D * stage.xNewton - stage.s;
+          IneqVector complementarity = stage.s.cwiseProduct(stage.z).array() - sigmaMu;
+          if (corrector)
+          {
+            complementarity += stage.ds_aff.cwiseProduct(stage.dz_aff);
+          }
+          stage.dz = -(complementarity + stage.z.cwiseProduct(stage.ds)).cwiseQuotient(stage.s);
+        }
+      }
+    }
+
+    /** Largest step length in [0, 1] keeping slack variables and multipliers
+     * non-negative.
+     *
+     */
+    double maxStepLength() const
+    {
+      double alpha = 1.;
+      for (unsigned k = 1; k <= nbSteps_; k++)
+      {
+        const Stage & stage = stages_[k];
+        if (stage.constrained)
+        {
+          for (int i = 0; i < NB_INEQ; i++)
+          {
+            if (stage.ds(i) < 0.)
+            {
+              alpha = std::min(alpha, -stage.s(i) / stage.ds(i));
+            }
+            if (stage.dz(i) < 0.)
+            {
+              alpha = std::min(alpha, -stage.z(i) / stage.dz(i));
+            }
+          }
+        }
+      }
+      return alpha;
+    }
+
+  private:
+    static constexpr double INIT_MULTIPLIER = 1.;
+    static constexpr double INIT_SLACK = 1e-2;
+
+    EqMatrix E_;
+    EqVector e_;
+    TimePoint deadline_ = TimePoint::max();
+    Eigen::PartialPivLU<Eigen::Matrix<double, NB_EQ, NB_EQ>> eqSensitivity_; /**< Decomposition of E dx_m / dlambda */
+    bool feasible_ = false;
+    bool hasEquality_ = false;
+    bool timedOut_ = false;
+    double bestCost_ = 0.; /**< Cost of the best feasible iterate of the last solve */
+    double solveTime_ = 0.; /**< Duration in [ms] of the last call to solve() */
+    std::vector<Stage, Eigen::aligned_allocator<Stage>> stages_;
+    unsigned eqStep_ = 1;
+    unsigned iterations_ = 0;
+    unsigned nbIneq_ = 0;
+    unsigned nbSteps_ = 0;
+  };
+}
@@ -27,15 +27,19 @@
 
 #pragma once
 
-#include <eigen-lssol/LSSOL_LS.h>
+
 #include <mc_tasks/CoMTask.h>
 #include <mc_tasks/CoPTask.h>
 
+#include <vhip_walking/LeastSquaresQP.h>
 #include <vhip_walking/Pendulum.h>
 #include <vhip_walking/Contact.h>
 #include <vhip_walking/Sole.h>
+#include <vhip_walking/WrenchConeProjectionWorker.h>
 #include <vhip_walking/defs.h>
+#include <vhip_walking/utils/LatencyHistogram.h>
 #include <vhip_walking/utils/LeakyIntegrator.h>
+#include <vhip_walking/utils/cones.h>
 #include <vhip_walking/utils/rotations.h>
 #include <vhip_walking/utils/stats.h>
 
@@ -87,6 +91,12 @@ namespace vhip_walking
     static constexpr double MAX_ALTCC_COM_OFFSET = 0.05; // [m]
     static constexpr double MAX_ZMPCC_COM_OFFSET = 0.05; // [m]
 
+    /* Max difference between two QP solutions deemed in agreement */
+    static constexpr double QP_AGREEMENT_TOL = 1e-6;
+
+    /* VHIP feedback QPs recorded in memory with "record_vhip", i.e. one minute at 200 Hz */
+    static constexpr unsigned MAX_VHIP_RECORDS = 12000;
+
     /** Initialize stabilizer.
      *
      * \param robot Robot model.
@@ -98,6 +108,11 @@ namespace vhip_walking
      */
     Stabilizer(const mc_rbdyn::Robot & robot, const Pendulum & ref, double dt);
 
+    /** Write recorded VHIP feedback QPs, if any.
+     *
+     */
+    ~Stabilizer();
+
     /** Add GUI tab.
      *
      * \param gui GUI handle.
@@ -124,7 +139,7 @@ namespace vhip_walking
      */
     void disable();
 
-    /** Compute ZMP of a wrench in the ZMP frame computed by updateZMPFrame().
+    /** Compute ZMP of a wrench in the ZMP frame computed by updateSupportGeometry().
      *
      * \param wrench Wrench at the origin of the world frame.
      *
@@ -213,6 +228,12 @@ namespace vhip_walking
      */
     void contactState(ContactState contactState)
     {
+      if (contactState != contactState_)
+      {
+        dsQP_.resetActiveSet();
+        ssQP_.resetActiveSet();
+        support_.valid = false;
+      }
       contactState_ = contactState;
     }
 
@@ -247,33 +268,12 @@ namespace vhip_walking
      *
      * \param sole Sole parameters.
      *
-     * See <https://hal.archives-ouvertes.fr/hal-02108449/document> for
-     * technical details on the derivation of this formula.
-     *
      */
     void wrenchFaceMatrix(const Sole & sole)
     {
-      double X = sole.halfLength;
-      double Y = sole.halfWidth;
-      double mu = sole.friction;
-      wrenchFaceMatrix_ <<
-        // mx,  my,  mz,  fx,  fy,            fz,
-            0,   0,   0,  -1,   0,           -mu,
-            0,   0,   0,  +1,   0,           -mu,
-            0,   0,   0,   0,  -1,           -mu,
-            0,   0,   0,   0,  +1,           -mu,
-           -1,   0,   0,   0,   0,            -Y,
-           +1,   0,   0,   0,   0,            -Y,
-            0,  -1,   0,   0,   0,            -X,
-            0,  +1,   0,   0,   0,            -X,
-          +mu, +mu,  -1,  -Y,  -X, -(X + Y) * mu,
-          +mu, -mu,  -1,  -Y,  +X, -(X + Y) * mu,
-          -mu, +mu,  -1,  +Y,  -X, -(X + Y) * mu,
-          -mu, -mu,  -1,  +Y,  +X, -(X + Y) * mu,
-          +mu, +mu,  +1,  +Y,  +X, -(X + Y) * mu,
-          +mu, -mu,  +1,  +Y,  -X, -(X + Y) * mu,
-          -mu, +mu,  +1,  -Y,  +X, -(X + Y) * mu,
-          -mu, -mu,  +1,  -Y,  -X, -(X + Y) * mu;
+      wrenchFaceMatrix_ = rectangularWrenchCone(sole.halfLength, sole.halfWidth, sole.friction);
+      support_.valid = false;
+      updateConeProjection();
     }
 
     /** ZMP target after force distribution.
@@ -289,7 +289,7 @@ namespace vhip_walking
      */
     const sva::PTransformd & zmpFrame() const
     {
-      return zmpFrame_;
+      return support_.zmpFrame;
     }
 
     /** Vertices of the ZMP support polygon in the world frame.
@@ -297,10 +297,26 @@ namespace vhip_walking
      */
     const std::vector<Eigen::Vector3d> & zmpPolygon()
     {
-      return zmpPolygon_;
+      return support_.zmpPolygon;
     }
 
   private:
+    /** Stages of run() whose latencies are measured.
+     *
+     */
+    enum RunStage : unsigned
+    {
+      CHECK_GAINS = 0,
+      CHECK_IN_THE_AIR,
+      UPDATE_SUPPORT_FOOT_GAINS,
+      UPDATE_SUPPORT_GEOMETRY,
+      COMPUTE_DESIRED_WRENCH,
+      DISTRIBUTE_WRENCH,
+      UPDATE_COM_ADMITTANCE_CONTROL,
+      UPDATE_FOOT_FORCE_DIFFERENCE_CONTROL,
+      NB_RUN_STAGES
+    };
+
     /** Weights for force distribution quadratic program (FDQP).
      *
      */
@@ -327,6 +343,48 @@ namespace vhip_walking
       double pressureSqrt;
     };
 
+    /** Preallocated matrices of the VHIP feedback least-squares problem.
+     *
+     * All dimensions are known at compile time so that the VHIP path of run()
+     * does not allocate on the heap.
+     *
+     */
+    struct VHIPWorkspace
+    {
+      static constexpr unsigned NB_VAR = 3 + 1 + 2 + 1 + 3;
+      static constexpr unsigned NB_ZMP_CONS = 4; /**< Rows of the ZMP area */
+      static constexpr unsigned NB_CONS = 3 + 3 + 1 + NB_ZMP_CONS + 1;
+
+      Eigen::Matrix<double, 3, NB_VAR> A;
+      Eigen::Matrix<double, 3, 1> b;
+      Eigen::Matrix<double, NB_CONS, NB_VAR> C;
+      Eigen::Matrix<double, NB_VAR + NB_CONS, 1> bl;
+      Eigen::Matrix<double, NB_VAR + NB_CONS, 1> bu;
+    };
+
+    using VHIPVector = Eigen::Matrix<double, VHIPWorkspace::NB_VAR, 1>;
+
+    /** Support geometry derived from contacts and contact state.
+     *
+     * These quantities only change in setContact(), contactState() and
+     * wrenchFaceMatrix(), which mark the cache as invalid. It is then rebuilt
+     * once at the beginning of the next call to run().
+     *
+     */
+    struct SupportGeometry
+    {
+      Eigen::HrepXd zmpArea; /**< ZMP support area in the ZMP frame */
+      Eigen::Matrix6d leftAnkleDual; /**< Dual matrix of the left ankle transform X_0_lankle */
+      Eigen::Matrix6d leftContactDual; /**< Dual matrix of the left contact transform X_0_lc */
+      Eigen::Matrix6d rightAnkleDual; /**< Dual matrix of the right ankle transform X_0_rankle */
+      Eigen::Matrix6d rightContactDual; /**< Dual matrix of the right contact transform X_0_rc */
+      WrenchFaceMatrix leftWrenchCone; /**< Left contact wrench cone applied to world-frame wrenches */
+      WrenchFaceMatrix rightWrenchCone; /**< Right contact wrench cone applied to world-frame wrenches */
+      bool valid = false; /**< False when the cache needs to be rebuilt */
+      std::vector<Eigen::Vector3d> zmpPolygon; /**< Vertices of the ZMP support polygon in the world frame */
+      sva::PTransformd zmpFrame; /**< Transform X_0_zmp to the ZMP frame */
+    };
+
     /** Check that all gains are within boundaries.
      *
      */
@@ -352,6 +410,46 @@ namespace vhip_walking
      */
     sva::ForceVecd computeVHIPDesiredWrench();
 
+    /** Write VHIP feedback QPs recorded so far to the "record_vhip" file.
+     *
+     * \note Problems are recorded in memory by solveVHIPQP() so that run()
+     * does no I/O. This function writes them to the file and should not be
+     * called from the control loop.
+     *
+     */
+    void flushVHIPRecords();
+
+    /** Solve VHIP feedback QP from the problem stored in vhipWorkspace_.
+     *
+     * \param Delta_x Output solution vector.
+     *
+     * \returns success Did the selected solver (or its fallback) succeed?
+     *
+     * If comparison is enabled and the selected backend is not LSSOL, LSSOL is
+     * also run after a successful solve to measure agreement and timings.
+     *
+     */
+    bool solveVHIPQP(VHIPVector & Delta_x);
+
+    /** Get backend of the wrench distribution QPs.
+     *
+     */
+    QPBackend fdqpBackend() const
+    {
+      return dsQP_.backend();
+    }
+
+    /** Select backend of the wrench distribution QPs.
+     *
+     * \param backend New backend.
+     *
+     */
+    void fdqpBackend(QPBackend backend)
+    {
+      dsQP_.backend(backend);
+      ssQP_.backend(backend);
+    }
+
     /** Distribute a desired wrench to supporting contacts.
      *
      * \param desiredWrench Desired resultant reaction wrench.
@@ -375,6 +473,20 @@ namespace vhip_walking
      */
     void distributeWrenchSS(const sva::ForceVecd & desiredWrench, std::shared_ptr<mc_tasks::force::CoPTask> & footTask);
 
+    /** Enumerate critical regions of the contact wrench cone.
+     *
+     * Regions are enumerated in the contact frame, then expressed in the
+     * inertial frame of the support contact on the worker thread of
+     * coneProjection_ after each contact change. Run
+     * vhip_walking_controller_ss_distribution_check to compare the explicit
+     * solution with LSSOL.
+     *
+     * \note This function is called by wrenchFaceMatrix(). It takes a few
+     * dozen milliseconds and should not be called during walking.
+     *
+     */
+    void updateConeProjection();
+
     /** Reset admittance, damping and stiffness for every foot in contact.
      *
      * \note This function is called at every run().
@@ -427,10 +539,10 @@ namespace vhip_walking
      */
     void updateFootForceDifferenceControl();
 
-    /** Update ZMP frame from contact state.
+    /** Rebuild support geometry from contacts and contact state.
      *
      */
-    void updateZMPFrame();
+    void updateSupportGeometry();
 
     /** Get 6D contact admittance vector from 2D CoP admittance.
      *
@@ -449,9 +561,7 @@ namespace vhip_walking
 
   private:
     ContactState contactState_ = ContactState::DoubleSupport;
-    Eigen::HrepXd zmpArea_;
-    Eigen::LSSOL_LS leastSquares_; /**< Least-squares solver for wrench distribution */
-    Eigen::Matrix<double, 16, 6> wrenchFaceMatrix_;
+    WrenchFaceMatrix wrenchFaceMatrix_;
     Eigen::Vector2d copAdmittance_ = Eigen::Vector2d::Zero();
     Eigen::Vector3d altccCoMAccel_ = Eigen::Vector3d::Zero();
     Eigen::Vector3d altccCoMOffset_ = Eigen::Vector3d::Zero();
@@ -475,8 +585,20 @@ namespace vhip_walking
     FDQPWeights fdqpWeights_;
     LeakyIntegrator<Eigen::Vector3d> altccIntegrator_;
     LeakyIntegrator<Eigen::Vector3d> zmpccIntegrator_;
+    LeastSquaresQP<12, 34> dsQP_; /**< Double-support wrench distribution QP */
+    LeastSquaresQP<6, 16> ssQP_; /**< Single-support wrench distribution QP */
+    LeastSquaresQP<VHIPWorkspace::NB_VAR, VHIPWorkspace::NB_CONS> vhipQP_; /**< VHIP feedback QP */
+    LeastSquaresQP<VHIPWorkspace::NB_VAR, VHIPWorkspace::NB_CONS> vhipReferenceQP_; /**< VHIP feedback QP solved by LSSOL for comparison */
+    SupportGeometry support_; /**< Cached support geometry, read by the hot path of run() */
     TemplateModel model_ = TemplateModel::VariableHeightInvertedPendulum;
+    VHIPWorkspace vhipWorkspace_; /**< Preallocated VHIP feedback problem */
+    WrenchConeProjectionWorker coneProjection_; /**< Explicit solution to the single-support wrench distribution QP */
+    bool compareVHIPSolvers_ = false; /**< Also solve VHIP feedback QP with LSSOL to benchmark the selected backend? */
+    bool coneProjectionValid_ = false; /**< Were critical regions of the explicit solution enumerated? */
+    bool explicitSS_ = false; /**< Use explicit solution for single-support wrench distribution? */
     bool inTheAir_ = false; /**< Is the robot in the air? */
+    bool ssQPBypassed_ = false; /**< Was the last single-support desired wrench already feasible? */
+    bool ssSolvedExplicitly_ = false; /**< Was the last single-support distribution given by the explicit solution? */
     bool zmpccOnlyDS_ = true; /**< Apply ZMPCC only during double support phases? */
     const Pendulum & pendulum_; /**< Reference to desired template model state */
     const mc_rbdyn::Robot & controlRobot_; /**< Control robot model (input to joint position controllers) */
@@ -509,12 +631,17 @@ namespace vhip_walking
     double vhipOmega_ = 0.;
     double vhipRunTime_ = 0.; /**< Measured average duration in [s] of a call to computeVHIPDesiredWrench() */
     mc_rtc::Configuration config_; /**< Stabilizer configuration dictionary */
-    std::vector<Eigen::Vector3d> zmpPolygon_; /**< Vertices of the ZMP support polygon in the world frame */
+    std::array<LatencyHistogram, NB_RUN_STAGES> runStageLatency_; /**< Latencies of the stages of run() over a sliding window */
+    std::string vhipRecordPath_; /**< File where VHIP feedback QPs are written when not empty */
+    std::vector<VHIPWorkspace, Eigen::aligned_allocator<VHIPWorkspace>> vhipRecords_; /**< VHIP feedback QPs recorded since the last flush, preallocated */
     std::vector<std::string> comActiveJoints_; /**< Joints used by CoM IK task */
     sva::ForceVecd distribWrench_ = sva::ForceVecd::Zero();
     sva::ForceVecd measuredWrench_; /**< Measured net contact wrench in the world frame */
     sva::MotionVecd contactDamping_;
     sva::MotionVecd contactStiffness_;
-    sva::PTransformd zmpFrame_;
+    unsigned ssNbBypassed_ = 0; /**< Number of single-support cycles where the desired wrench was feasible */
+    unsigned ssNbSolved_ = 0; /**< Number of single-support cycles where the desired wrench was projected */
+    unsigned vhipNbAgreements_ = 0; /**< Number of comparisons where both solvers agreed */
+    unsigned vhipNbComparisons_ = 0; /**< Number of cycles where both solvers ran */
   };
 }
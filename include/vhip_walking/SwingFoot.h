@@ -27,6 +27,9 @@
 
 #pragma once
 
+#include <vector>
+
+#include <Eigen/StdVector>
 #include <SpaceVecAlg/SpaceVecAlg>
 #include <mc_rtc/log/Logger.h>
 
@@ -41,6 +44,8 @@ namespace vhip_walking
   {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
+    static constexpr double TABLE_TIME_TOL = 1e-6; // [fraction of table period]
+
     /** Add swing foot entries to log.
      *
      * \param logger Logger.
@@ -157,6 +162,20 @@ namespace vhip_walking
       takeoffPitch_ = pitch;
     }
 
+    /** Sample whole trajectories at reset into a table that integrate()
+     * then plays back.
+     *
+     * \param period Sampling period of the table, typically the control
+     * period so that playback times fall on table knots. At playback times
+     * in between, the chunk polynomials are evaluated as without table.
+     * Zero disables the table.
+     *
+     */
+    void tablePeriod(double period)
+    {
+      tablePeriod_ = period;
+    }
+
     /** Get current velocity as motion vector.
      *
      */
@@ -173,6 +192,18 @@ namespace vhip_walking
      */
     void updatePose(double t);
 
+    /** Sample the trajectory at every knot of the table.
+     *
+     */
+    void tabulate();
+
+    /** Update pose from the table to a given playback time.
+     *
+     * \param t Playback time.
+     *
+     */
+    void updatePoseFromTable(double t);
+
     /** Update altitude to a given playback time.
      *
      * \param t Playback time.
@@ -195,6 +226,20 @@ namespace vhip_walking
     void updatePitch(double t);
 
   private:
+    /** Swing foot state at a knot of the table.
+     *
+     */
+    struct TableKnot
+    {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      Eigen::Quaterniond ori;
+      Eigen::Vector3d accel;
+      Eigen::Vector3d pos;
+      Eigen::Vector3d vel;
+      double pitch;
+    };
+
     Eigen::Quaterniond ori_;
     Eigen::Vector3d accel_;
     Eigen::Vector3d pos_;
@@ -216,9 +261,11 @@ namespace vhip_walking
     double pitch_;
     double playback_;
     double takeoffDuration_ = 0.; // [s]
+    double tablePeriod_ = 0.; // [s]
     double takeoffPitch_ = 0.; // [rad]
     sva::PTransformd initPose_;
     sva::PTransformd targetPose_;
     sva::PTransformd touchdownPose_;
+    std::vector<TableKnot, Eigen::aligned_allocator<TableKnot>> table_; /**< Knots every table period, capacity kept across resets */
   };
 }
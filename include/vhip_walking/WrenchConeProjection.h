@@ -0,0 +1,194 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <SpaceVecAlg/SpaceVecAlg>
+
+#include <vhip_walking/utils/cones.h>
+
+namespace vhip_walking
+{
+  /** Explicit solution to the projection of a wrench onto a contact wrench cone.
+   *
+   * The least-squares problem
+   *
+   *    minimize    |w - w_d|^2
+   *    subject to  F w <= 0
+   *
+   * is solved as a multiparametric QP in the parameter w_d, following
+   * "The explicit linear quadratic regulator for constrained systems"
+   * (Bemporad et al., 2002). For each set S of active faces, with F_S of full
+   * row rank, the optimum is the linear map
+   *
+   *    w = (I - F_S^T (F_S F_S^T)^-1 F_S) w_d
+   *
+   * over the critical region where multipliers (F_S F_S^T)^-1 F_S w_d are
+   * non-negative and inactive faces are satisfied. As there is no constant
+   * term, all critical regions are polyhedral cones, described as H w_d <= 0.
+   *
+   * Critical regions are enumerated once in build(). Those with an empty
+   * interior are discarded, and the region where all faces are active (w = 0)
+   * is described by the extreme rays of the cone. Regions may overlap when
+   * more faces than the dimension meet on an edge, but all regions containing
+   * a given parameter yield the same optimum.
+   *
+   * Which active sets give full-dimensional regions only depends on the face
+   * lattice of the cone, which is preserved by a change of coordinates
+   * F -> F X*. When the cone is expressed in a new frame, e.g. the inertial
+   * frame of a new contact, update() recomputes the maps and regions of the
+   * enumerated active sets without enumerating them again. This takes about
+   * 1 us per region, i.e. a few milliseconds in total, so that regions are
+   * recomputed by continueUpdate() off the control thread, see
+   * WrenchConeProjectionWorker, and project() fails until all of them are
+   * done.
+   *
+   * At runtime, project() checks the last region it found first, so that
+   * smoothly-varying inputs are usually handled by a single region test and
+   * one 6x6 matrix-vector product.
+   *
+   */
+  struct WrenchConeProjection
+  {
+    static constexpr unsigned NB_FACES = 16;
+
+    using FaceMatrix = WrenchFaceMatrix;
+
+    /** Enumerate critical regions of a contact wrench cone.
+     *
+     * \param faceMatrix Matrix F of the cone, e.g. from
+     * Stabilizer::wrenchFaceMatrix().
+     *
+     * \returns success False if the cone is degenerate, in which case
+     * project() always fails.
+     *
+     */
+    bool build(const FaceMatrix & faceMatrix);
+
+    /** Start expressing critical regions for the same cone in new
+     * coordinates.
+     *
+     * \param faceMatrix Matrix F X* of the cone enumerated by build(), e.g.
+     * a contact wrench cone in the inertial frame from transformWrenchCone().
+     *
+     */
+    void update(const FaceMatrix & faceMatrix);
+
+    /** Recompute a batch of critical regions after update().
+     *
+     * \param nbRegions Maximum number of regions to recompute.
+     *
+     * \returns ready True when all regions are in the new coordinates.
+     *
+     */
+    bool continueUpdate(unsigned nbRegions);
+
+    /** Compare explicit solution with LSSOL on random wrenches, in the
+     * coordinates of the last call to build() or update().
+     *
+     * \param nbSamples Number of random wrenches.
+     *
+     * \returns nbMismatches Number of samples where the two solutions differ
+     * or where no critical region was found.
+     *
+     */
+    unsigned checkAgainstQP(unsigned nbSamples);
+
+    /** Project a desired wrench onto the contact wrench cone.
+     *
+     * \param desiredWrench Desired wrench w_d.
+     *
+     * \param wrench Output wrench w.
+     *
+     * \returns found False if no critical region contains the desired wrench,
+     * or if regions are being updated.
+     *
+     */
+    bool project(const Eigen::Vector6d & desiredWrench, Eigen::Vector6d & wrench);
+
+    /** Number of critical regions.
+     *
+     */
+    unsigned nbRegions() const
+    {
+      return static_cast<unsigned>(regions_.size());
+    }
+
+  private:
+    /** Critical region and its optimal linear map.
+     *
+     */
+    struct CriticalRegion
+    {
+      FaceMatrix H; /**< Region is H w_d <= 0, with normalized rows */
+      Eigen::Matrix6d P; /**< Optimum w = P w_d */
+      unsigned mask; /**< Bit mask of active faces, all faces for the apex region */
+    };
+
+  private:
+    /** Compute the apex region from extreme rays of the current cone.
+     *
+     * \param region Output region.
+     *
+     */
+    void computeApexRegion(CriticalRegion & region) const;
+
+    /** Compute the critical region of an active set for the current cone.
+     *
+     * \param mask Bit mask of linearly independent active faces.
+     *
+     * \param region Output region.
+     *
+     */
+    void computeRegion(unsigned mask, CriticalRegion & region) const;
+
+    /** Check whether a parameter lies in a critical region.
+     *
+     * \param i Region index.
+     *
+     * \param w_d Parameter.
+     *
+     */
+    bool inRegion(unsigned i, const Eigen::Vector6d & w_d) const
+    {
+      return (wrenchConeMargin(regions_[i].H, w_d) >= -REGION_TOL * w_d.norm());
+    }
+
+  private:
+    static constexpr double REGION_TOL = 1e-9;
+    static constexpr unsigned APEX_MASK = (1u << NB_FACES) - 1;
+
+  private:
+    FaceMatrix faceMatrix_;
+    int lastRegion_ = -1;
+    size_t nbUpdatedRegions_ = 0; /**< Regions expressed in the coordinates of faceMatrix_ */
+    std::vector<CriticalRegion, Eigen::aligned_allocator<CriticalRegion>> regions_;
+    std::vector<unsigned> rayMasks_; /**< Masks of five faces meeting on each extreme ray */
+  };
+}
@@ -0,0 +1,144 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <vhip_walking/WrenchConeProjection.h>
+
+namespace vhip_walking
+{
+  /** Express critical regions of a wrench cone projection in new
+   * coordinates on a dedicated thread.
+   *
+   * Two WrenchConeProjection instances with the same critical regions form
+   * a double buffer: the control thread projects with the front one while
+   * the worker recomputes all regions of the back one, then the two are
+   * swapped at the next call to ready(). Ownership of the back instance is
+   * handed over through an atomic status, so that no call from the control
+   * thread waits on the worker, except build().
+   *
+   * The worker thread sleeps on a condition variable between updates, so
+   * that an idle worker costs no CPU time.
+   *
+   */
+  struct WrenchConeProjectionWorker
+  {
+    using FaceMatrix = WrenchConeProjection::FaceMatrix;
+
+    /** Start worker thread.
+     *
+     */
+    WrenchConeProjectionWorker();
+
+    /** Stop and join worker thread.
+     *
+     */
+    ~WrenchConeProjectionWorker();
+
+    /** Enumerate critical regions of a contact wrench cone.
+     *
+     * \param faceMatrix Matrix F of the cone in the contact frame.
+     *
+     * \returns success False if the cone is degenerate.
+     *
+     * \note This function waits for the worker and takes a few dozen
+     * milliseconds. It should not be called during walking.
+     *
+     */
+    bool build(const FaceMatrix & faceMatrix);
+
+    /** Request critical regions in new coordinates.
+     *
+     * \param faceMatrix Matrix F X* of the cone enumerated by build().
+     *
+     * Projections fail until the worker is done with the latest request.
+     *
+     */
+    void update(const FaceMatrix & faceMatrix);
+
+    /** Pick up the last update from the worker and post pending requests.
+     *
+     * \returns ready True if critical regions are in the coordinates of the
+     * last call to update().
+     *
+     */
+    bool ready();
+
+    /** Project a desired wrench onto the contact wrench cone.
+     *
+     * \param desiredWrench Desired wrench w_d.
+     *
+     * \param wrench Output wrench w.
+     *
+     * \returns found False if critical regions are not ready, or if no
+     * critical region contains the desired wrench.
+     *
+     */
+    bool project(const Eigen::Vector6d & desiredWrench, Eigen::Vector6d & wrench);
+
+    /** Number of critical regions.
+     *
+     */
+    unsigned nbRegions() const
+    {
+      return projections_[front_].nbRegions();
+    }
+
+  private:
+    /** Ownership of the back projection.
+     *
+     */
+    enum class Status
+    {
+      Idle, // owned by the control thread
+      Requested, // owned by the worker thread
+      Done // owned by the control thread, to swap with the front one
+    };
+
+    /** Main loop of the worker thread.
+     *
+     */
+    void run();
+
+  private:
+    FaceMatrix faceMatrix_; /**< Coordinates of the last call to update() */
+    WrenchConeProjection projections_[2];
+    bool pending_ = false; /**< Was the last update not posted to the worker yet? */
+    bool upToDate_ = false; /**< Is the front projection in the coordinates of the last update? */
+    std::atomic<Status> status_ = {Status::Idle};
+    std::atomic<bool> stop_ = {false};
+    std::condition_variable wakeUp_;
+    std::mutex wakeUpMutex_;
+    unsigned front_ = 0; /**< Index of the projection used by the control thread */
+    std::thread thread_; // last, so that it starts after other members are initialized
+  };
+}
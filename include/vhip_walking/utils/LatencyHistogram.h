@@ -0,0 +1,205 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+/** Latency percentiles over a sliding window of samples.
+ *
+ * Samples are counted in logarithmic bins, with eight bins per octave from
+ * 0.1 us to about 1.7 s, so that percentiles are reported with a relative
+ * precision of about 9%. The window is a ring buffer of bin indices: adding a
+ * sample increments its bin and decrements that of the sample it evicts.
+ *
+ * The histogram is lock-free for one writer, typically the control loop, and
+ * any number of readers such as the logger or GUI. Readers may see a window
+ * that is off by one sample, which does not matter for latency statistics.
+ *
+ */
+struct LatencyHistogram
+{
+  static constexpr unsigned BINS_PER_OCTAVE = 8;
+  static constexpr unsigned NB_BINS = 24 * BINS_PER_OCTAVE;
+  static constexpr unsigned WINDOW_SIZE = 1000; /**< Five seconds at 200 Hz */
+  static constexpr double MIN_LATENCY = 1e-4; /**< Lower edge of the first bin, in [ms] */
+
+  static_assert(NB_BINS <= 256, "Bin indices are stored as bytes");
+
+  /** Add new sample to the window.
+   *
+   * \param latency Duration in [ms].
+   *
+   */
+  void add(double latency)
+  {
+    uint8_t bin = binIndex(latency);
+    unsigned head = head_.load(std::memory_order_relaxed);
+    if (size_.load(std::memory_order_relaxed) == WINDOW_SIZE)
+    {
+      counts_[window_[head]].fetch_sub(1, std::memory_order_relaxed);
+    }
+    else
+    {
+      size_.fetch_add(1, std::memory_order_relaxed);
+    }
+    window_[head] = bin;
+    counts_[bin].fetch_add(1, std::memory_order_release);
+    head_.store((head + 1) % WINDOW_SIZE, std::memory_order_relaxed);
+  }
+
+  /** Latency percentile over the window, in [ms].
+   *
+   * \param p Percentile between 0 and 1.
+   *
+   * The returned value is the upper edge of the bin where the percentile
+   * lies, i.e. an upper bound on the exact percentile.
+   *
+   */
+  double percentile(double p) const
+  {
+    unsigned size = size_.load(std::memory_order_acquire);
+    if (size == 0)
+    {
+      return 0.;
+    }
+    unsigned rank = static_cast<unsigned>(std::ceil(p * size));
+    unsigned total = 0;
+    for (unsigned i = 0; i < NB_BINS; i++)
+    {
+      total += counts_[i].load(std::memory_order_relaxed);
+      if (total >= rank && total > 0)
+      {
+        return binUpperEdge(i);
+      }
+    }
+    return binUpperEdge(NB_BINS - 1);
+  }
+
+  /** Median latency over the window, in [ms].
+   *
+   */
+  double p50() const
+  {
+    return percentile(0.5);
+  }
+
+  /** 99th percentile of latency over the window, in [ms].
+   *
+   */
+  double p99() const
+  {
+    return percentile(0.99);
+  }
+
+  /** Maximum latency over the window, in [ms].
+   *
+   */
+  double max() const
+  {
+    for (unsigned i = NB_BINS; i > 0; i--)
+    {
+      if (counts_[i - 1].load(std::memory_order_relaxed) > 0)
+      {
+        return binUpperEdge(i - 1);
+      }
+    }
+    return 0.;
+  }
+
+  /** Empty the window.
+   *
+   * \note This function should not be called while samples are being added.
+   *
+   */
+  void reset()
+  {
+    for (auto & count : counts_)
+    {
+      count.store(0, std::memory_order_relaxed);
+    }
+    head_.store(0, std::memory_order_relaxed);
+    size_.store(0, std::memory_order_release);
+  }
+
+private:
+  static uint8_t binIndex(double latency)
+  {
+    if (!(latency > MIN_LATENCY)) // also catches NaNs
+    {
+      return 0;
+    }
+    double bin = std::floor(BINS_PER_OCTAVE * std::log2(latency / MIN_LATENCY));
+    return static_cast<uint8_t>(std::min(bin, NB_BINS - 1.));
+  }
+
+  static double binUpperEdge(unsigned bin)
+  {
+    return MIN_LATENCY * std::exp2((bin + 1.) / BINS_PER_OCTAVE);
+  }
+
+private:
+  std::array<std::atomic<unsigned>, NB_BINS> counts_ = {};
+  std::array<uint8_t, WINDOW_SIZE> window_ = {};
+  std::atomic<unsigned> head_ = {0};
+  std::atomic<unsigned> size_ = {0};
+};
+
+/** Measure the lifetime of a scope into a latency histogram.
+ *
+ */
+struct ScopedLatencyTimer
+{
+  /** Start timer.
+   *
+   * \param histogram Histogram where the measured duration is added.
+   *
+   */
+  ScopedLatencyTimer(LatencyHistogram & histogram)
+    : histogram_(histogram), startTime_(std::chrono::high_resolution_clock::now())
+  {
+  }
+
+  /** Stop timer and add the measured duration to the histogram.
+   *
+   */
+  ~ScopedLatencyTimer()
+  {
+    using namespace std::chrono;
+    auto endTime = high_resolution_clock::now();
+    histogram_.add(1000. * duration_cast<duration<double>>(endTime - startTime_).count());
+  }
+
+private:
+  LatencyHistogram & histogram_;
+  std::chrono::high_resolution_clock::time_point startTime_;
+};
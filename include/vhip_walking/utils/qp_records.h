@@ -0,0 +1,129 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <istream>
+#include <ostream>
+
+#include <Eigen/Dense>
+
+/** Plain-text records of least-squares problems.
+ *
+ * Problems are in the form of Eigen::LSSOL_LS:
+ *
+ *    minimize    |A x - b|^2
+ *    subject to  bl <= [x; C x] <= bu
+ *
+ * Each record starts with a line "nbVar nbCons nbCostRows", followed by A and
+ * C row by row, then b, bl and bu, all separated by whitespace. Records are
+ * written with full precision, so that a problem read back is bitwise equal
+ * to the one written.
+ *
+ */
+struct LeastSquaresRecord
+{
+  Eigen::MatrixXd A;
+  Eigen::VectorXd b;
+  Eigen::MatrixXd C;
+  Eigen::VectorXd bl;
+  Eigen::VectorXd bu;
+};
+
+/** Write a least-squares problem to a stream.
+ *
+ * \param os Output stream.
+ *
+ * \param A Cost matrix.
+ *
+ * \param b Cost vector.
+ *
+ * \param C Matrix of general constraints.
+ *
+ * \param bl Lower bounds on variables then general constraints.
+ *
+ * \param bu Upper bounds on variables then general constraints.
+ *
+ */
+template <typename MatA, typename VecB, typename MatC, typename VecL, typename VecU>
+void writeLeastSquaresRecord(std::ostream & os, const Eigen::MatrixBase<MatA> & A, const Eigen::MatrixBase<VecB> & b, const Eigen::MatrixBase<MatC> & C, const Eigen::MatrixBase<VecL> & bl, const Eigen::MatrixBase<VecU> & bu)
+{
+  const Eigen::IOFormat format(Eigen::FullPrecision, Eigen::DontAlignCols, " ", "\n");
+  os << A.cols() << " " << C.rows() << " " << A.rows() << "\n";
+  os << A.format(format) << "\n";
+  os << C.format(format) << "\n";
+  os << b.transpose().format(format) << "\n";
+  os << bl.transpose().format(format) << "\n";
+  os << bu.transpose().format(format) << "\n";
+}
+
+/** Read the next least-squares problem from a stream.
+ *
+ * \param is Input stream.
+ *
+ * \param record Problem read.
+ *
+ * \returns success False at the end of the stream or if the record is
+ * truncated.
+ *
+ */
+inline bool readLeastSquaresRecord(std::istream & is, LeastSquaresRecord & record)
+{
+  int nbVar = 0;
+  int nbCons = 0;
+  int nbCostRows = 0;
+  if (!(is >> nbVar >> nbCons >> nbCostRows) || nbVar <= 0 || nbCons < 0 || nbCostRows <= 0)
+  {
+    return false;
+  }
+  record.A.resize(nbCostRows, nbVar);
+  record.C.resize(nbCons, nbVar);
+  record.b.resize(nbCostRows);
+  record.bl.resize(nbVar + nbCons);
+  record.bu.resize(nbVar + nbCons);
+  for (int i = 0; i < record.A.size(); i++)
+  {
+    is >> record.A(i / nbVar, i % nbVar);
+  }
+  for (int i = 0; i < record.C.size(); i++)
+  {
+    is >> record.C(i / nbVar, i % nbVar);
+  }
+  for (int i = 0; i < nbCostRows; i++)
+  {
+    is >> record.b(i);
+  }
+  for (int i = 0; i < nbVar + nbCons; i++)
+  {
+    is >> record.bl(i);
+  }
+  for (int i = 0; i < nbVar + nbCons; i++)
+  {
+    is >> record.bu(i);
+  }
+  return static_cast<bool>(is);
+}
@@ -64,6 +64,14 @@ struct AvgStdEstimator
     return total_ / n_;
   }
 
+  /** Maximum value of the time series.
+   *
+   */
+  double max()
+  {
+    return max_;
+  }
+
   /** Number of samples.
    *
    */
@@ -106,6 +106,16 @@ namespace vhip_walking
     // Read settings from configuration file
     plans_ = config("plans");
     mpcConfig_ = config("mpc");
+    unsigned nbMPCSteps = WalkingMPC::NB_STEPS;
+    if (mpcConfig_.has("horizon"))
+    {
+      mpcConfig_("horizon")("nb_steps", nbMPCSteps);
+    }
+    mpc_ = makeModelPredictiveControlPipeline(nbMPCSteps);
+    if (config.has("swing_foot"))
+    {
+      config("swing_foot")("tabulate", tabulateSwingFoot);
+    }
     sole_ = robotConfig("sole");
     std::string initialPlan = plans_.keys()[0];
     config("initial_plan", initialPlan);
@@ -125,14 +135,14 @@ namespace vhip_walking
     stabilizer_.wrenchFaceMatrix(sole_);
 
     addLogEntries(logger());
-    mpc_.addLogEntries(logger());
+    mpc_->addLogEntries(logger());
     netWrenchObs_.addLogEntries(logger());
     stabilizer_.addLogEntries(logger());
 
     if (gui_)
     {
       addGUIElements(gui_);
-      mpc_.addGUIElements(gui_);
+      mpc_->addGUIElements(gui_);
       stabilizer_.addGUIElements(gui_);
     }
 
@@ -153,9 +163,9 @@ namespace vhip_walking
     logger.addLogEntry("left_foot_ratio", [this]() { return leftFootRatio_; });
     logger.addLogEntry("left_foot_ratio_measured", [this]() { return measuredLeftFootRatio(); });
     logger.addLogEntry("mpc_failures", [this]() { return nbMPCFailures_; });
-    logger.addLogEntry("mpc_weights_jerk", [this]() { return mpc_.jerkWeight; });
-    logger.addLogEntry("mpc_weights_vel", [this]() { return mpc_.velWeights; });
-    logger.addLogEntry("mpc_weights_zmp", [this]() { return mpc_.zmpWeight; });
+    logger.addLogEntry("mpc_timeouts_bestFeasible", [this]() { return nbMPCBestFeasible_; });
+    logger.addLogEntry("mpc_timeouts_shiftedPrevious", [this]() { return nbMPCShiftedPrevious_; });
+    logger.addLogEntry("mpc_preview_lateCycles", [this]() { return nbPreviewLateCycles_; });
     logger.addLogEntry("pendulum_com", [this]() { return pendulum_.com(); });
     logger.addLogEntry("pendulum_comd", [this]() { return pendulum_.comd(); });
     logger.addLogEntry("pendulum_comdd", [this]() { return pendulum_.comdd(); });
@@ -218,7 +228,9 @@ namespace vhip_walking
     controlComd_ = Eigen::Vector3d::Zero();
     leftFootRatioJumped_ = true;
     leftFootRatio_ = 0.5;
+    nbMPCBestFeasible_ = 0;
     nbMPCFailures_ = 0;
+    nbMPCShiftedPrevious_ = 0;
     pauseWalking = false;
     pauseWalkingRequested = false;
 
@@ -366,10 +378,10 @@ namespace vhip_walking
 
     plan = plans_(name);
     plan.name = name;
-    mpc_.configure(mpcConfig_);
+    mpc_->configure(mpcConfig_);
     if (!plan.mpcConfig.empty())
     {
-      mpc_.configure(plan.mpcConfig);
+      mpc_->configure(plan.mpcConfig);
     }
     plan.complete(sole_);
     const sva::PTransformd & X_0_lc = controlRobot().surfacePose("LeftFootCenter");
@@ -398,17 +410,93 @@ namespace vhip_walking
 
   bool Controller::updatePreview()
   {
-    mpc_.initState(pendulum());
-    mpc_.comHeight(plan.comHeight());
-    if (mpc_.solve())
+    discardPreviewUpdate();
+    mpc_->initState(pendulum());
+    mpc_->comHeight(plan.comHeight());
+    std::shared_ptr<Preview> branchPreview;
+    WalkingMPC::SolveStatus branchStatus;
+    if (mpc_->pickUpBranch(branchPreview, branchStatus))
     {
-      preview = mpc_.solution();
+      countMPCStatus(branchStatus);
+      preview = branchPreview;
       return true;
     }
-    else
+    mpc_->solve();
+    if (!countMPCStatus(mpc_->status()))
+    {
+      return false;
+    }
+    if (mpc_->status() != WalkingMPC::SolveStatus::ShiftedPrevious) // otherwise keep playing back the current preview
+    {
+      preview = mpc_->solution();
+    }
+    return true;
+  }
+
+  bool Controller::postPreviewBranch(PreviewBranch branch, const Pendulum & state)
+  {
+    mpc_->initState(state);
+    mpc_->comHeight(plan.comHeight());
+    return mpc_->postBranch(branch);
+  }
+
+  bool Controller::postPreviewUpdate()
+  {
+    mpc_->initState(pendulum());
+    mpc_->comHeight(plan.comHeight());
+    if (!mpc_->postUpdate(previewRequestId_ + 1))
     {
-      nbMPCFailures_++;
       return false;
     }
+    previewRequestId_++;
+    previewRequestTime_ = ctlTime_ + timeStep;
+    return true;
+  }
+
+  PreviewUpdate Controller::pickUpPreviewUpdate()
+  {
+    std::shared_ptr<Preview> newPreview;
+    WalkingMPC::SolveStatus status;
+    unsigned long requestId;
+    if (!mpc_->pickUpUpdate(newPreview, status, requestId) || requestId != previewRequestId_)
+    {
+      return PreviewUpdate::None;
+    }
+    if (!countMPCStatus(status))
+    {
+      return PreviewUpdate::Failure;
+    }
+    if (status == WalkingMPC::SolveStatus::ShiftedPrevious) // current preview is already played back at the right time
+    {
+      return PreviewUpdate::Success;
+    }
+    Pendulum playback = pendulum_;
+    nbPreviewLateCycles_ = 0;
+    while (previewRequestTime_ + (nbPreviewLateCycles_ + 0.5) * timeStep < ctlTime_)
+    {
+      newPreview->integrate(playback, timeStep);
+      nbPreviewLateCycles_++;
+    }
+    preview = newPreview;
+    return PreviewUpdate::Success;
+  }
+
+  bool Controller::countMPCStatus(WalkingMPC::SolveStatus status)
+  {
+    switch (status)
+    {
+      case WalkingMPC::SolveStatus::Optimal:
+        break;
+      case WalkingMPC::SolveStatus::BestFeasible:
+        nbMPCBestFeasible_++;
+        break;
+      case WalkingMPC::SolveStatus::ShiftedPrevious:
+        nbMPCShiftedPrevious_++;
+        break;
+      case WalkingMPC::SolveStatus::Failed:
+        nbMPCFailures_++;
+        return false;
+    }
+    return true;
   }
 }
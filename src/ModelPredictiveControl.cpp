@@ -25,8 +25,17 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <iomanip>
 
+#ifdef VHIP_WALKING_WITH_COPRA
+#include <copra/constraints.h>
+#include <copra/costFunctions.h>
+#include <copra/LMPC.h>
+#include <copra/PreviewSystem.h>
+#endif
+
 #include <vhip_walking/ModelPredictiveControl.h>
 #include <vhip_walking/utils/clamp.h>
 #include <vhip_walking/utils/rotations.h>
@@ -34,36 +43,637 @@
 
 namespace vhip_walking
 {
-  ModelPredictiveControl::ModelPredictiveControl()
-  {
-    velCostMat_.setZero();
-    constexpr double T = SAMPLING_PERIOD;
-    double S = T * T / 2; // "square"
-    double C = T * T * T / 6; // "cube"
-    Eigen::Matrix<double, STATE_SIZE, STATE_SIZE> stateMatrix;
-    stateMatrix <<
-      1, 0, T, 0, S, 0,
-      0, 1, 0, T, 0, S,
-      0, 0, 1, 0, T, 0,
-      0, 0, 0, 1, 0, T,
-      0, 0, 0, 0, 1, 0,
-      0, 0, 0, 0, 0, 1;
-    Eigen::Matrix<double, STATE_SIZE, INPUT_SIZE> inputMatrix;
-    inputMatrix <<
-      C, 0,
-      0, C,
-      S, 0,
-      0, S,
-      T, 0,
-      0, T;
-    Eigen::VectorXd biasVector = Eigen::VectorXd::Zero(6);
-    initState_ = Eigen::VectorXd::Zero(6);
+  namespace
+  {
+    using Formulation = ModelPredictiveControlBase::Formulation;
+
+    const char * FORMULATION_LABELS[] = {"Condensed", "Riccati", "Copra"};
+
+    constexpr double STEP_TIME_TOL = 1e-9; // [s], round-off on playback times accumulated over control timesteps
+
+    std::string formulationToString(Formulation formulation)
+    {
+      return FORMULATION_LABELS[static_cast<int>(formulation)];
+    }
+
+    Formulation formulationFromString(const std::string & label)
+    {
+      if (label == FORMULATION_LABELS[1])
+      {
+        return Formulation::Riccati;
+      }
+      if (label == FORMULATION_LABELS[2])
+      {
+        return Formulation::Copra;
+      }
+      if (label != FORMULATION_LABELS[0])
+      {
+        mc_rtc::log::error("Unknown MPC formulation \"{}\", using condensed formulation", label);
+      }
+      return Formulation::Condensed;
+    }
+  }
+
+  template <unsigned NB_STEPS>
+  CondensedFormulation<NB_STEPS>::CondensedFormulation()
+  {
+    zmpConsMats_.fill(Eigen::Matrix<double, NB_ZMP_CONS, STATE_SIZE>::Zero());
+    stateFromInit_.setZero();
+    stateFromInput_.setZero();
+    freeStateTraj_.setZero();
+    workspace_.b.setZero();
+    workspace_.bl.setConstant(-1e5);
+    workspace_.bu.setConstant(+1e5);
+    cache_.resize(CACHE_SIZE);
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::addLogEntries(mc_rtc::Logger & logger)
+  {
+    logger.addLogEntry("mpc_cache_hits", [this]() { return nbCacheHits_; });
+    logger.addLogEntry("mpc_cache_misses", [this]() { return nbCacheMisses_; });
+    logger.addLogEntry("mpc_qp_factorizations", [this]() { return (qp_.backend() == QPBackend::ActiveSet) ? qp_.factorizations() : 0u; });
+    logger.addLogEntry("mpc_qp_warmStartSteps", [this]() { return warmStartSteps_; });
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::dynamics(const std::array<StateMatrix, NB_STEPS> & stateMatrices, const std::array<InputMatrix, NB_STEPS> & inputMatrices)
+  {
+    stateFromInit_.setZero();
+    stateFromInput_.setZero();
+    stateFromInit_.template topRows<STATE_SIZE>().setIdentity();
+    for (unsigned i = 0; i < NB_STEPS; i++)
+    {
+      unsigned curRow = STATE_SIZE * i;
+      unsigned nextRow = STATE_SIZE * (i + 1);
+      stateFromInit_.template middleRows<STATE_SIZE>(nextRow).noalias() = stateMatrices[i] * stateFromInit_.template middleRows<STATE_SIZE>(curRow);
+      stateFromInput_.template middleRows<STATE_SIZE>(nextRow).noalias() = stateMatrices[i] * stateFromInput_.template middleRows<STATE_SIZE>(curRow);
+      stateFromInput_.template block<STATE_SIZE, INPUT_SIZE>(nextRow, INPUT_SIZE * i) += inputMatrices[i];
+    }
+    for (CondensedMatrices & matrices : cache_)
+    {
+      matrices.valid = false;
+    }
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::updateTerminalConstraint(const Problem & problem)
+  {
+    unsigned i = problem.terminalStep(); // last step in full preview
+    const auto & terminalState = freeStateTraj_.template segment<STATE_SIZE>(STATE_SIZE * i);
+    Eigen::Vector2d dcmTarget = problem.zmpRef_.template tail<2>();
+    Eigen::Vector2d zmpTarget = problem.zmpRef_.template tail<2>();
+
+    auto blCons = workspace_.bl.template tail<NB_CONS>();
+    auto buCons = workspace_.bu.template tail<NB_CONS>();
+    constexpr unsigned DCM_ROW = Workspace::TERM_DCM_CONS_ROW;
+    buCons.template segment<2>(DCM_ROW) = dcmTarget;
+    buCons.template segment<2>(DCM_ROW).noalias() -= problem.dcmFromState_ * terminalState;
+    blCons.template segment<2>(DCM_ROW) = buCons.template segment<2>(DCM_ROW);
+    constexpr unsigned ZMP_ROW = Workspace::TERM_ZMP_CONS_ROW;
+    buCons.template segment<2>(ZMP_ROW) = zmpTarget;
+    buCons.template segment<2>(ZMP_ROW).noalias() -= problem.zmpFromState_ * terminalState;
+    blCons.template segment<2>(ZMP_ROW) = buCons.template segment<2>(ZMP_ROW);
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::updateZMPConstraint(const Problem & problem)
+  {
+    constexpr unsigned NB_ROWS = NB_ZMP_CONS * (NB_STEPS + 1);
+    static_assert(Workspace::ZMP_CONS_ROW + NB_ROWS == NB_CONS, "Invalid number of constraints in MPC problem");
+    constexpr unsigned ZMP_ROW = Workspace::ZMP_CONS_ROW;
+    auto blCons = workspace_.bl.template tail<NB_CONS>().template segment<NB_ROWS>(ZMP_ROW);
+    auto buCons = workspace_.bu.template tail<NB_CONS>().template segment<NB_ROWS>(ZMP_ROW);
+    blCons.setConstant(-1e5);
+    for (long i = 0; i <= NB_STEPS; i++)
+    {
+      auto bu = buCons.template segment<NB_ZMP_CONS>(NB_ZMP_CONS * i);
+      unsigned hrepIndex = problem.indexToHrep_[i];
+      if (hrepIndex % 2 == 0)
+      {
+        zmpConsMats_[i].noalias() = problem.hrepMats_[hrepIndex] * problem.zmpFromState_;
+        bu = problem.hrepVecs_[hrepIndex];
+        bu.noalias() -= zmpConsMats_[i] * freeStateTraj_.template segment<STATE_SIZE>(STATE_SIZE * i);
+      }
+      else // no constraint
+      {
+        zmpConsMats_[i].setZero();
+        bu.setConstant(+1e5);
+      }
+    }
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::updateJerkCost()
+  {
+    workspace_.b.template segment<NB_VAR>(Workspace::JERK_COST_ROW).setZero();
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::updateVelCost(const Problem & problem)
+  {
+    const Eigen::Vector2d sqrtWeights = problem.velWeights.cwiseSqrt();
+    for (long i = 0; i <= NB_STEPS; i++)
+    {
+      auto b = workspace_.b.template segment<2>(Workspace::VEL_COST_ROW + 2 * i);
+      b = problem.velRef_.template segment<2>(2 * i);
+      b.noalias() -= problem.velRotations_[i] * freeStateTraj_.template segment<2>(STATE_SIZE * i + 2);
+      b.array() *= std::sqrt(problem.costScales_[i]) * sqrtWeights.array();
+    }
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::updateZMPCost(const Problem & problem)
+  {
+    for (long i = 0; i <= NB_STEPS; i++)
+    {
+      auto b = workspace_.b.template segment<2>(Workspace::ZMP_COST_ROW + 2 * i);
+      b = problem.zmpRef_.template segment<2>(2 * i);
+      b.noalias() -= problem.zmpFromState_ * freeStateTraj_.template segment<STATE_SIZE>(STATE_SIZE * i);
+      b *= std::sqrt(problem.costScales_[i] * problem.zmpWeight);
+    }
+  }
+
+  template <unsigned NB_STEPS>
+  auto CondensedFormulation<NB_STEPS>::condensedMatrices(const Problem & problem) -> const CondensedMatrices &
+  {
+    CondensedKey key;
+    key.initRotation = problem.initContact_.pose.rotation();
+    key.nextRotation = problem.nextContact_.pose.rotation();
+    key.targetRotation = problem.targetContact_.pose.rotation();
+    key.velWeights = problem.velWeights;
+    key.comHeight = problem.comHeight_;
+    key.jerkWeight = problem.jerkWeight;
+    key.zmpWeight = problem.zmpWeight;
+    key.nbSteps = {problem.nbInitSupportSteps_, problem.nbDoubleSupportSteps_, problem.nbTargetSupportSteps_, problem.nbNextDoubleSupportSteps_};
+
+    CondensedMatrices * leastRecent = &cache_[0];
+    for (CondensedMatrices & matrices : cache_)
+    {
+      if (matrices.valid && matrices.key == key)
+      {
+        nbCacheHits_++;
+        matrices.lastUse = nbSolves_;
+        return matrices;
+      }
+      if (matrices.lastUse < leastRecent->lastUse)
+      {
+        leastRecent = &matrices;
+      }
+    }
+
+    nbCacheMisses_++;
+    CondensedMatrices & matrices = *leastRecent;
+    matrices.key = key;
+    condense(problem, matrices);
+    matrices.valid = true;
+    matrices.lastUse = nbSolves_;
+    return matrices;
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::condense(const Problem & problem, CondensedMatrices & matrices) const
+  {
+    auto & A = matrices.A;
+    A.template middleRows<NB_VAR>(Workspace::JERK_COST_ROW).setZero();
+    const Eigen::Matrix2d sqrtVelWeights = problem.velWeights.cwiseSqrt().asDiagonal();
+    for (unsigned i = 0; i <= NB_STEPS; i++)
+    {
+      const unsigned nbPastInputs = INPUT_SIZE * i;
+      const auto stateFromInput = stateFromPastInputs(i);
+      const double sqrtScale = std::sqrt(problem.costScales_[i]);
+      if (i < NB_STEPS)
+      {
+        A.template middleRows<NB_VAR>(Workspace::JERK_COST_ROW).diagonal().template segment<INPUT_SIZE>(nbPastInputs).setConstant(sqrtScale * std::sqrt(problem.jerkWeight));
+      }
+      const Eigen::Matrix2d velCostMat = sqrtScale * sqrtVelWeights * problem.velRotations_[i];
+      const Eigen::Matrix<double, 2, STATE_SIZE> zmpCostMat = sqrtScale * std::sqrt(problem.zmpWeight) * problem.zmpFromState_;
+      auto velRows = A.template middleRows<2>(Workspace::VEL_COST_ROW + 2 * i);
+      velRows.leftCols(nbPastInputs).noalias() = velCostMat * stateFromInput.template middleRows<2>(2);
+      velRows.rightCols(NB_VAR - nbPastInputs).setZero();
+      auto zmpRows = A.template middleRows<2>(Workspace::ZMP_COST_ROW + 2 * i);
+      zmpRows.leftCols(nbPastInputs).noalias() = zmpCostMat * stateFromInput;
+      zmpRows.rightCols(NB_VAR - nbPastInputs).setZero();
+    }
+
+    auto & C = matrices.C;
+    const unsigned terminalStep = problem.terminalStep();
+    const unsigned nbTerminalInputs = INPUT_SIZE * terminalStep;
+    C.template topRows<NB_TERM_CONS>().setZero();
+    C.template middleRows<2>(Workspace::TERM_DCM_CONS_ROW).leftCols(nbTerminalInputs).noalias() = problem.dcmFromState_ * stateFromPastInputs(terminalStep);
+    C.template middleRows<2>(Workspace::TERM_ZMP_CONS_ROW).leftCols(nbTerminalInputs).noalias() = problem.zmpFromState_ * stateFromPastInputs(terminalStep);
+    for (unsigned i = 0; i <= NB_STEPS; i++)
+    {
+      const unsigned nbPastInputs = INPUT_SIZE * i;
+      auto zmpRows = C.template middleRows<NB_ZMP_CONS>(Workspace::ZMP_CONS_ROW + NB_ZMP_CONS * i);
+      zmpRows.leftCols(nbPastInputs).noalias() = zmpConsMats_[i] * stateFromPastInputs(i);
+      zmpRows.rightCols(NB_VAR - nbPastInputs).setZero();
+    }
+
+    matrices.hessian.compute(A);
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::warmStart(const Problem & problem)
+  {
+    warmStartSteps_ = 0;
+    if (!problem.solution_ || qp_.backend() != QPBackend::ActiveSet)
+    {
+      return;
+    }
+    warmStartSteps_ = problem.stepIndex(problem.solution_->playbackTime());
+    constexpr int ZMP_ROW = NB_VAR + Workspace::ZMP_CONS_ROW;
+    constexpr int NB_ZMP_ROWS = NB_ZMP_CONS * (NB_STEPS + 1);
+    qp_.shiftActiveSet(ZMP_ROW, NB_ZMP_ROWS, NB_ZMP_CONS * std::min(warmStartSteps_, NB_STEPS + 1));
+  }
+
+  template <unsigned NB_STEPS>
+  void CondensedFormulation<NB_STEPS>::build(const Problem & problem)
+  {
+    nbSolves_++;
+    qp_.backend(problem.qpBackend_);
+    freeStateTraj_.noalias() = stateFromInit_ * problem.initState_;
+    updateTerminalConstraint(problem);
+    updateZMPConstraint(problem);
+    updateJerkCost();
+    updateVelCost(problem);
+    updateZMPCost(problem);
+
+    warmStart(problem);
+    matrices_ = &condensedMatrices(problem);
+  }
+
+  template <unsigned NB_STEPS>
+  bool CondensedFormulation<NB_STEPS>::solve(InputTraj & jerkTraj, StateTraj & stateTraj, TimePoint deadline)
+  {
+    const Workspace & w = workspace_;
+    qp_.deadline(deadline);
+    bool solutionFound = qp_.solve(&matrices_->hessian, matrices_->A, w.b, matrices_->C, w.bl, w.bu);
+    if (solutionFound)
+    {
+      jerkTraj = qp_.result();
+      stateTraj = freeStateTraj_;
+      stateTraj.noalias() += stateFromInput_ * jerkTraj;
+    }
+    return solutionFound;
+  }
+
+#ifdef VHIP_WALKING_WITH_COPRA
+  /** Former formulation of the walking MPC with copra.
+   *
+   * The preview system and the copra::LMPC, with its QP solver, are created
+   * once per time grid and kept across solves. copra costs and constraints
+   * hold their data by value without setters, so that those depending on
+   * the problem are swapped in the same LMPC at each solve, while the jerk
+   * cost is kept and only reweighted. Matrices passed to them are
+   * preallocated.
+   *
+   * \tparam NB_STEPS Number of sampling steps in the preview horizon.
+   *
+   */
+  template <unsigned NB_STEPS>
+  struct CopraFormulation : ModelPredictiveControlBase
+  {
+    using InputTraj = typename ModelPredictiveControlSolution<NB_STEPS>::InputTraj;
+    using Problem = ModelPredictiveControl<NB_STEPS>;
+    using StateTraj = typename ModelPredictiveControlSolution<NB_STEPS>::StateTraj;
+
+    static constexpr long NB_STATES = STATE_SIZE * (NB_STEPS + 1);
+
+    /** Preallocate problem matrices.
+     *
+     */
+    CopraFormulation();
+
+    /** Set the dynamics of a uniform time grid.
+     *
+     * \param stateMatrix State matrix of every sampling step.
+     *
+     * \param inputMatrix Input matrix of every sampling step.
+     *
+     */
+    void dynamics(const StateMatrix & stateMatrix, const InputMatrix & inputMatrix);
+
+    /** Update costs and constraints from a problem and solve it.
+     *
+     * \param problem Problem to solve, with references computed.
+     *
+     * \param jerkTraj Output jerk trajectory.
+     *
+     * \param stateTraj Output state trajectory.
+     *
+     * \returns solutionFound True if copra found a solution.
+     *
+     */
+    bool solve(const Problem & problem, InputTraj & jerkTraj, StateTraj & stateTraj);
+
+    /** Duration in [ms] of the last QP solve.
+     *
+     */
+    double solveTime() const
+    {
+      return solveTime_;
+    }
+
+  private:
+    template <typename T>
+    void replaceConstraint(std::shared_ptr<T> & current, std::shared_ptr<T> next)
+    {
+      if (current)
+      {
+        lmpc_->removeConstraint(current);
+      }
+      current = next;
+      lmpc_->addConstraint(current);
+    }
+
+    template <typename T>
+    void replaceCost(std::shared_ptr<T> & current, std::shared_ptr<T> next)
+    {
+      if (current)
+      {
+        lmpc_->removeCost(current);
+      }
+      current = next;
+      lmpc_->addCost(current);
+    }
+
+  private:
+    Eigen::MatrixXd termDCMMat_;
+    Eigen::MatrixXd termZMPMat_;
+    Eigen::MatrixXd velCostMat_;
+    Eigen::MatrixXd zmpConsMat_;
+    Eigen::VectorXd initState_;
+    Eigen::VectorXd velRef_;
+    Eigen::VectorXd zmpConsVec_;
+    Eigen::VectorXd zmpRef_;
+    copra::SolverFlag solver_ = copra::SolverFlag::QLD;
+    double solveTime_ = 0.; // [ms]
+    std::shared_ptr<copra::ControlCost> jerkCost_;
+    std::shared_ptr<copra::PreviewSystem> previewSystem_;
+    std::shared_ptr<copra::TrajectoryConstraint> termDCMCons_;
+    std::shared_ptr<copra::TrajectoryConstraint> termZMPCons_;
+    std::shared_ptr<copra::TrajectoryConstraint> zmpCons_;
+    std::shared_ptr<copra::TrajectoryCost> velCost_;
+    std::shared_ptr<copra::TrajectoryCost> zmpCost_;
+    std::unique_ptr<copra::LMPC> lmpc_;
+  };
+
+  namespace
+  {
+    /** copra solver matching a QP backend, QLD for the active-set backend.
+     *
+     */
+    copra::SolverFlag copraSolver(QPBackend backend)
+    {
+      switch (backend)
+      {
+        case QPBackend::LSSOL:
+          return copra::SolverFlag::LSSOL;
+        case QPBackend::QuadProg:
+          return copra::SolverFlag::QuadProgDense;
+        case QPBackend::ActiveSet:
+        case QPBackend::QLD:
+        default:
+          return copra::SolverFlag::QLD;
+      }
+    }
+  }
+
+  template <unsigned NB_STEPS>
+  CopraFormulation<NB_STEPS>::CopraFormulation()
+    : termDCMMat_(Eigen::MatrixXd::Zero(2, NB_STATES)),
+      termZMPMat_(Eigen::MatrixXd::Zero(2, NB_STATES)),
+      velCostMat_(Eigen::MatrixXd::Zero(2 * (NB_STEPS + 1), NB_STATES)),
+      zmpConsMat_(Eigen::MatrixXd::Zero(NB_ZMP_CONS * (NB_STEPS + 1), NB_STATES)),
+      initState_(Eigen::VectorXd::Zero(STATE_SIZE)),
+      velRef_(Eigen::VectorXd::Zero(2 * (NB_STEPS + 1))),
+      zmpConsVec_(Eigen::VectorXd::Zero(NB_ZMP_CONS * (NB_STEPS + 1))),
+      zmpRef_(Eigen::VectorXd::Zero(2 * (NB_STEPS + 1)))
+  {
+    jerkCost_ = std::make_shared<copra::ControlCost>(Eigen::Matrix2d::Identity(), Eigen::Vector2d::Zero());
+  }
+
+  template <unsigned NB_STEPS>
+  void CopraFormulation<NB_STEPS>::dynamics(const StateMatrix & stateMatrix, const InputMatrix & inputMatrix)
+  {
+    Eigen::VectorXd biasVector = Eigen::VectorXd::Zero(STATE_SIZE);
     previewSystem_ = std::make_shared<copra::PreviewSystem>(
-        stateMatrix, inputMatrix, biasVector, initState_, NB_STEPS);
-    mc_rtc::log::success("Initialized new ModelPredictiveControl solver");
+        Eigen::MatrixXd(stateMatrix), Eigen::MatrixXd(inputMatrix), biasVector, initState_, NB_STEPS);
+    lmpc_.reset(new copra::LMPC(previewSystem_, solver_));
+    lmpc_->addCost(jerkCost_);
+    termDCMCons_ = nullptr; // not in the new LMPC
+    termZMPCons_ = nullptr;
+    zmpCons_ = nullptr;
+    velCost_ = nullptr;
+    zmpCost_ = nullptr;
+  }
+
+  template <unsigned NB_STEPS>
+  bool CopraFormulation<NB_STEPS>::solve(const Problem & problem, InputTraj & jerkTraj, StateTraj & stateTraj)
+  {
+    copra::SolverFlag solver = copraSolver(problem.qpBackend_);
+    if (solver != solver_)
+    {
+      lmpc_->selectQPSolver(solver);
+      solver_ = solver;
+    }
+    initState_ = problem.initState_;
+    previewSystem_->xInit(initState_);
+
+    unsigned terminalStep = problem.terminalStep();
+    termDCMMat_.setZero();
+    termZMPMat_.setZero();
+    termDCMMat_.block<2, STATE_SIZE>(0, STATE_SIZE * terminalStep) = problem.dcmFromState_;
+    termZMPMat_.block<2, STATE_SIZE>(0, STATE_SIZE * terminalStep) = problem.zmpFromState_;
+    Eigen::Vector2d terminalTarget = problem.zmpRef_.template tail<2>();
+    replaceConstraint(termDCMCons_, std::make_shared<copra::TrajectoryConstraint>(termDCMMat_, terminalTarget, /* isInequalityConstraint = */ false));
+    replaceConstraint(termZMPCons_, std::make_shared<copra::TrajectoryConstraint>(termZMPMat_, terminalTarget, /* isInequalityConstraint = */ false));
+
+    long nbRows = 0;
+    zmpConsMat_.setZero();
+    for (unsigned i = 0; i <= NB_STEPS; i++)
+    {
+      unsigned hrepIndex = problem.indexToHrep_[i];
+      if (hrepIndex % 2 == 0)
+      {
+        zmpConsMat_.block<NB_ZMP_CONS, STATE_SIZE>(nbRows, STATE_SIZE * i).noalias() = problem.hrepMats_[hrepIndex] * problem.zmpFromState_;
+        zmpConsVec_.segment<NB_ZMP_CONS>(nbRows) = problem.hrepVecs_[hrepIndex];
+        nbRows += NB_ZMP_CONS;
+      }
+    }
+    replaceConstraint(zmpCons_, std::make_shared<copra::TrajectoryConstraint>(zmpConsMat_.topRows(nbRows), zmpConsVec_.head(nbRows)));
+
+    // Uniform grid: all steps have the same cost scale
+    const double costScale = problem.costScales_[0];
+    jerkCost_->weight(costScale * problem.jerkWeight);
+
+    for (unsigned i = 0; i <= NB_STEPS; i++)
+    {
+      velCostMat_.block<2, 2>(2 * i, STATE_SIZE * i + 2) = problem.velRotations_[i];
+    }
+    velRef_ = problem.velRef_;
+    replaceCost(velCost_, std::make_shared<copra::TrajectoryCost>(velCostMat_, velRef_));
+    velCost_->weights(costScale * problem.velWeights);
+
+    zmpRef_ = problem.zmpRef_;
+    replaceCost(zmpCost_, std::make_shared<copra::TrajectoryCost>(Eigen::MatrixXd(problem.zmpFromState_), zmpRef_));
+    zmpCost_->weight(costScale * problem.zmpWeight);
+    zmpCost_->autoSpan(); // repeat zmpFromState
+
+    bool solutionFound = lmpc_->solve();
+    solveTime_ = 1000. * lmpc_->solveTime();
+    if (solutionFound)
+    {
+      stateTraj = lmpc_->trajectory();
+      jerkTraj = lmpc_->control();
+    }
+    return solutionFound;
+  }
+#endif
+
+  template <unsigned NB_STEPS_>
+  ModelPredictiveControl<NB_STEPS_>::ModelPredictiveControl()
+  {
+    initState_.setZero();
+    jerkTraj_.setZero();
+    stateTraj_.setZero();
+    velRef_.setZero();
+    zmpRef_.setZero();
+    indexToHrep_.fill(0);
+    velRotations_.fill(Eigen::Matrix2d::Identity());
+    for (unsigned i = 0; i < 4; i++)
+    {
+      hrepMats_[i].setZero();
+      hrepVecs_[i].setZero();
+    }
+    riccati_.resize(NB_STEPS);
+#ifdef VHIP_WALKING_WITH_COPRA
+    copra_ = std::make_shared<CopraFormulation<NB_STEPS>>();
+#endif
+    samplingPeriod(SAMPLING_PERIOD);
+    mc_rtc::log::success("Initialized new ModelPredictiveControl solver with {} steps", NB_STEPS);
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::samplingPeriod(double samplingPeriod)
+  {
+    StepDurations stepDurations;
+    stepDurations.fill(samplingPeriod);
+    timeGrid(stepDurations);
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::timeGrid(double finePeriod, unsigned nbFineSteps, double duration)
+  {
+    nbFineSteps = std::min(nbFineSteps, NB_STEPS);
+    double fineDuration = nbFineSteps * finePeriod;
+    if (nbFineSteps < NB_STEPS && fineDuration >= duration)
+    {
+      mc_rtc::log::error("Fine MPC steps ({} x {} s) exceed horizon duration {} s, using uniform time grid", nbFineSteps, finePeriod, duration);
+      samplingPeriod(duration / NB_STEPS);
+      return;
+    }
+    StepDurations stepDurations;
+    stepDurations.fill((nbFineSteps < NB_STEPS) ? (duration - fineDuration) / (NB_STEPS - nbFineSteps) : 0.);
+    std::fill_n(stepDurations.begin(), nbFineSteps, finePeriod);
+    timeGrid(stepDurations);
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::timeGrid(const StepDurations & stepDurations)
+  {
+    stepTimes_[0] = 0.;
+    for (unsigned i = 0; i < NB_STEPS; i++)
+    {
+      const double T = stepDurations[i];
+      double S = T * T / 2; // "square"
+      double C = T * T * T / 6; // "cube"
+      stateMatrices_[i] <<
+        1, 0, T, 0, S, 0,
+        0, 1, 0, T, 0, S,
+        0, 0, 1, 0, T, 0,
+        0, 0, 0, 1, 0, T,
+        0, 0, 0, 0, 1, 0,
+        0, 0, 0, 0, 0, 1;
+      inputMatrices_[i] <<
+        C, 0,
+        0, C,
+        S, 0,
+        0, S,
+        T, 0,
+        0, T;
+      stepTimes_[i + 1] = stepTimes_[i] + T;
+      costScales_[i] = T / SAMPLING_PERIOD;
+    }
+    costScales_[NB_STEPS] = costScales_[NB_STEPS - 1];
+    if constexpr (HAS_CONDENSED)
+    {
+      condensed_.dynamics(stateMatrices_, inputMatrices_);
+    }
+#ifdef VHIP_WALKING_WITH_COPRA
+    if (isUniformGrid())
+    {
+      copra_->dynamics(stateMatrices_[0], inputMatrices_[0]);
+    }
+    else if (formulation_ == Formulation::Copra)
+    {
+      mc_rtc::log::warning("Copra MPC formulation only supports uniform time grids, using {} formulation", formulationToString(fallbackFormulation()));
+    }
+#endif
+  }
+
+  template <unsigned NB_STEPS_>
+  unsigned ModelPredictiveControl<NB_STEPS_>::stepIndex(double t) const
+  {
+    auto next = std::upper_bound(stepTimes_.begin(), stepTimes_.end(), t);
+    if (next == stepTimes_.begin())
+    {
+      return 0;
+    }
+    if (next == stepTimes_.end())
+    {
+      return NB_STEPS;
+    }
+    auto prev = next - 1;
+    return static_cast<unsigned>(((*next - t <= t - *prev) ? next : prev) - stepTimes_.begin());
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::formulation(Formulation formulation)
+  {
+    if (formulation == Formulation::Condensed && !HAS_CONDENSED)
+    {
+      mc_rtc::log::warning("Condensed MPC formulation supports up to {} sampling steps (got {}), using Riccati formulation", MAX_CONDENSED_STEPS, NB_STEPS);
+      formulation = Formulation::Riccati;
+    }
+    if (formulation == Formulation::Copra && !copra_)
+    {
+      mc_rtc::log::warning("Copra MPC formulation requires building with copra, using {} formulation", formulationToString(fallbackFormulation()));
+      formulation = fallbackFormulation();
+    }
+    else if (formulation == Formulation::Copra && !isUniformGrid())
+    {
+      mc_rtc::log::warning("Copra MPC formulation only supports uniform time grids, using {} formulation", formulationToString(fallbackFormulation()));
+    }
+    formulation_ = formulation;
+  }
+
+  template <unsigned NB_STEPS_>
+  unsigned ModelPredictiveControl<NB_STEPS_>::iterations() const
+  {
+    if constexpr (HAS_CONDENSED)
+    {
+      if (formulation_ == Formulation::Condensed)
+      {
+        return condensed_.iterations();
+      }
+    }
+    return (formulation_ == Formulation::Riccati) ? riccati_.iterations() : 0;
   }
 
-  void ModelPredictiveControl::configure(const mc_rtc::Configuration & config)
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::configure(const mc_rtc::Configuration & config)
   {
     if (config.has("weights"))
     {
@@ -72,9 +682,106 @@ namespace vhip_walking
       weights("vel", velWeights);
       weights("zmp", zmpWeight);
     }
+    if (config.has("horizon"))
+    {
+      auto horizon = config("horizon");
+      unsigned nbSteps = NB_STEPS;
+      horizon("nb_steps", nbSteps);
+      if (nbSteps != NB_STEPS)
+      {
+        mc_rtc::log::error("MPC horizon has {} steps, ignoring \"nb_steps\": {} (only read when the controller starts)", NB_STEPS, nbSteps);
+      }
+      if (horizon.has("sampling_period"))
+      {
+        samplingPeriod(horizon("sampling_period"));
+      }
+    }
+    if (config.has("time_grid"))
+    {
+      auto grid = config("time_grid");
+      double finePeriod = grid("fine_period");
+      unsigned nbFineSteps = grid("nb_fine_steps");
+      double duration = grid("duration", NB_STEPS * SAMPLING_PERIOD);
+      timeGrid(finePeriod, nbFineSteps, duration);
+    }
+    if (config.has("formulation"))
+    {
+      std::string label = config("formulation");
+      formulation(formulationFromString(label));
+    }
+    if (config.has("time_budget"))
+    {
+      double budget = config("time_budget");
+      timeBudget(budget);
+    }
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::copyProblem(const Problem & problem)
+  {
+    if (stepTimes_ != problem.stepTimes)
+    {
+      StepDurations stepDurations;
+      for (unsigned i = 0; i < NB_STEPS; i++)
+      {
+        stepDurations[i] = problem.stepTimes[i + 1] - problem.stepTimes[i];
+      }
+      timeGrid(stepDurations);
+    }
+    formulation(problem.formulation);
+    comHeight(problem.comHeight);
+    contacts(problem.initContact, problem.targetContact, problem.nextContact);
+    initState_ = problem.initState;
+    jerkWeight = problem.jerkWeight;
+    velWeights = problem.velWeights;
+    zmpWeight = problem.zmpWeight;
+    nbDoubleSupportSteps_ = problem.nbDoubleSupportSteps;
+    nbInitSupportSteps_ = problem.nbInitSupportSteps;
+    nbNextDoubleSupportSteps_ = problem.nbNextDoubleSupportSteps;
+    nbTargetSupportSteps_ = problem.nbTargetSupportSteps;
+    indexToHrep_ = problem.indexToHrep;
+    qpBackend(problem.qpBackend);
+    timeBudget_ = problem.timeBudget;
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::detachSolution()
+  {
+    if (solution_ && solution_.use_count() > 1)
+    {
+      std::shared_ptr<Solution> copy = solutionPool_.acquire();
+      if (copy)
+      {
+        *copy = *solution_;
+      }
+      solution_ = copy; // without copy, the next solve neither warm starts nor shifts it
+    }
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::getProblem(Problem & problem) const
+  {
+    problem.stepTimes = stepTimes_;
+    problem.formulation = formulation_;
+    problem.comHeight = comHeight_;
+    problem.initContact = initContact_;
+    problem.targetContact = targetContact_;
+    problem.nextContact = nextContact_;
+    problem.initState = initState_;
+    problem.jerkWeight = jerkWeight;
+    problem.velWeights = velWeights;
+    problem.zmpWeight = zmpWeight;
+    problem.nbDoubleSupportSteps = nbDoubleSupportSteps_;
+    problem.nbInitSupportSteps = nbInitSupportSteps_;
+    problem.nbNextDoubleSupportSteps = nbNextDoubleSupportSteps_;
+    problem.nbTargetSupportSteps = nbTargetSupportSteps_;
+    problem.indexToHrep = indexToHrep_;
+    problem.qpBackend = qpBackend_;
+    problem.timeBudget = timeBudget_;
   }
 
-  void ModelPredictiveControl::addGUIElements(std::shared_ptr<mc_rtc::gui::StateBuilder> gui)
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::addGUIElements(std::shared_ptr<mc_rtc::gui::StateBuilder> gui)
   {
     using namespace mc_rtc::gui;
     gui->addElement(
@@ -99,64 +806,54 @@ namespace vhip_walking
         }),
       ComboInput(
         "QP solver",
-        {"QuadProgDense", "QLD", "LSSOL"},
-        [this]() -> std::string
-        {
-          switch (solver_)
-          {
-            case copra::SolverFlag::LSSOL:
-              return "LSSOL";
-            case copra::SolverFlag::QLD:
-              return "QLD";
-            case copra::SolverFlag::QuadProgDense:
-            default:
-              return "QuadProgDense";
-          }
-        },
-        [this](const std::string & solver)
-        {
-          if (solver == "LSSOL")
-          {
-            solver_ = copra::SolverFlag::LSSOL;
-          }
-          else if (solver == "QLD")
-          {
-            solver_ = copra::SolverFlag::QLD;
-          }
-          else
-          {
-            solver_ = copra::SolverFlag::QuadProgDense;
-          }
-        }));
-  }
-
-  void ModelPredictiveControl::addLogEntries(mc_rtc::Logger & logger)
+        {QP_BACKEND_LABELS[0], QP_BACKEND_LABELS[1], QP_BACKEND_LABELS[2], QP_BACKEND_LABELS[3]},
+        [this]() { return qpBackendToString(qpBackend()); },
+        [this](const std::string & backend) { qpBackend(qpBackendFromString(backend)); }),
+      ComboInput(
+        "Formulation",
+        {FORMULATION_LABELS[0], FORMULATION_LABELS[1], FORMULATION_LABELS[2]},
+        [this]() { return formulationToString(formulation_); },
+        [this](const std::string & label) { formulation(formulationFromString(label)); }),
+      NumberInput(
+        "Time budget [ms]",
+        [this]() { return timeBudget_; },
+        [this](double budget) { timeBudget(budget); }),
+      Label(
+        "Horizon",
+        [this]() { return std::to_string(NB_STEPS) + " steps over " + std::to_string(horizonDuration()) + " s"; }));
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::addLogEntries(mc_rtc::Logger & logger)
   {
+    logger.addLogEntry("perf_MPCBuild", [this]() { return buildTime_; });
     logger.addLogEntry("perf_MPCBuildAndSolve", [this]() { return buildAndSolveTime_; });
     logger.addLogEntry("perf_MPCSolve", [this]() { return solveTime_; });
+    logger.addLogEntry("mpc_qp_iterations", [this]() { return iterations(); });
+    if constexpr (HAS_CONDENSED)
+    {
+      condensed_.addLogEntries(logger);
+    }
   }
 
-  void ModelPredictiveControl::phaseDurations(double initSupportDuration, double doubleSupportDuration, double targetSupportDuration)
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::phaseDurations(double initSupportDuration, double doubleSupportDuration, double targetSupportDuration)
   {
-    constexpr double T = SAMPLING_PERIOD;
-
     unsigned nbStepsSoFar = 0;
-    nbInitSupportSteps_ = std::min(
-        static_cast<unsigned>(std::round(initSupportDuration / T)),
-        NB_STEPS - nbStepsSoFar);
+    nbInitSupportSteps_ = stepIndex(initSupportDuration);
     nbStepsSoFar += nbInitSupportSteps_;
-    nbDoubleSupportSteps_ = std::min(
-        static_cast<unsigned>(std::round(doubleSupportDuration / T)),
-        NB_STEPS - nbStepsSoFar);
+    nbDoubleSupportSteps_ = stepIndex(stepTimes_[nbStepsSoFar] + doubleSupportDuration) - nbStepsSoFar;
     nbStepsSoFar += nbDoubleSupportSteps_;
-    nbTargetSupportSteps_ = std::min(
-        static_cast<unsigned>(std::round(targetSupportDuration / T)),
-        NB_STEPS - nbStepsSoFar);
+    nbTargetSupportSteps_ = stepIndex(stepTimes_[nbStepsSoFar] + targetSupportDuration) - nbStepsSoFar;
     nbStepsSoFar += nbTargetSupportSteps_;
     if (nbTargetSupportSteps_ > 0) // full preview
     {
       nbNextDoubleSupportSteps_ = NB_STEPS - nbStepsSoFar; // always positive
     }
+    else // half preview
+    {
+      nbNextDoubleSupportSteps_ = 0;
+    }
     for (long i = 0; i <= NB_STEPS; i++)
     {
       // NB: SSP constraint is enforced at the very first step of DSP
@@ -190,7 +887,8 @@ namespace vhip_walking
     }
   }
 
-  void ModelPredictiveControl::computeZMPRef()
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::computeZMPRef()
   {
     zmpRef_.setZero();
     Eigen::Vector2d p_0 = initContact_.anklePos().head<2>();
@@ -204,86 +902,22 @@ namespace vhip_walking
     {
       if (indexToHrep_[i] <= 1)
       {
-        long j = i - nbInitSupportSteps_;
-        double x = (nbDoubleSupportSteps_ > 0) ? static_cast<double>(j) / nbDoubleSupportSteps_ : 0.;
+        double x = phaseProgress(i, nbInitSupportSteps_, nbDoubleSupportSteps_);
         x = clamp(x, 0., 1.);
-        zmpRef_.segment<2>(2 * i) = (1. - x) * p_0 + x * p_1;
+        zmpRef_.template segment<2>(2 * i) = (1. - x) * p_0 + x * p_1;
       }
       else // (indexToHrep_[i] <= 3), which implies nbTargetSupportSteps_ > 0
       {
-        long j = i - nbInitSupportSteps_ - nbDoubleSupportSteps_ - nbTargetSupportSteps_;
-        double x = (nbNextDoubleSupportSteps_ > 0) ? static_cast<double>(j) / nbNextDoubleSupportSteps_ : 0;
+        unsigned j = nbInitSupportSteps_ + nbDoubleSupportSteps_ + nbTargetSupportSteps_;
+        double x = phaseProgress(i, j, nbNextDoubleSupportSteps_);
         x = clamp(x, 0., 1.);
-        zmpRef_.segment<2>(2 * i) = (1. - x) * p_1 + x * p_2;
-      }
-    }
-  }
-
-  void ModelPredictiveControl::updateTerminalConstraint()
-  {
-    Eigen::MatrixXd E_dcm = Eigen::MatrixXd::Zero(2, STATE_SIZE * (NB_STEPS + 1));
-    Eigen::MatrixXd E_zmp = Eigen::MatrixXd::Zero(2, STATE_SIZE * (NB_STEPS + 1));
-    if (nbTargetSupportSteps_ < 1) // half preview
-    {
-      unsigned i = nbInitSupportSteps_ + nbDoubleSupportSteps_;
-      E_dcm.block<2, 6>(0, 6 * i) = dcmFromState_;
-      E_zmp.block<2, 6>(0, 6 * i) = zmpFromState_;
-    }
-    else // full preview
-    {
-      E_dcm.rightCols<6>() = dcmFromState_;
-      E_zmp.rightCols<6>() = zmpFromState_;
-    }
-    Eigen::Vector2d dcmTarget = zmpRef_.tail<2>();
-    Eigen::Vector2d zmpTarget = zmpRef_.tail<2>();
-    termDCMCons_ = std::make_shared<copra::TrajectoryConstraint>(E_dcm, dcmTarget, /* isInequalityConstraint = */ false);
-    termZMPCons_ = std::make_shared<copra::TrajectoryConstraint>(E_zmp, zmpTarget, /* isInequalityConstraint = */ false);
-  }
-
-  void ModelPredictiveControl::updateZMPConstraint()
-  {
-    hreps_[0] = initContact_.hrep();
-    hreps_[2] = targetContact_.hrep();
-    //hreps_[1] = getDoubleSupportHrep(initContact_, targetContact_);
-    //hreps_[3] = getDoubleSupportHrep(targetContact_, nextContact_);
-    unsigned totalRows = 0;
-    for (long i = 0; i <= NB_STEPS; i++)
-    {
-      unsigned hrepIndex = indexToHrep_[i];
-      if (hrepIndex % 2 == 0)
-      {
-        const auto & hrep = hreps_[hrepIndex];
-        totalRows += static_cast<unsigned>(hrep.first.rows());
-      }
-    }
-    Eigen::MatrixXd A{totalRows, STATE_SIZE * (NB_STEPS + 1)};
-    Eigen::VectorXd b{totalRows};
-    A.setZero();
-    long nextRow = 0;
-    for (long i = 0; i <= NB_STEPS; i++)
-    {
-      unsigned hrepIndex = indexToHrep_[i];
-      if (hrepIndex % 2 == 0)
-      {
-        const auto & hrep = hreps_[indexToHrep_[i]];
-        unsigned consRows = static_cast<unsigned>(hrep.first.rows());
-        A.block(nextRow, STATE_SIZE * i, consRows, STATE_SIZE) = hrep.first * zmpFromState_;
-        b.segment(nextRow, consRows) = hrep.second;
-        nextRow += consRows;
+        zmpRef_.template segment<2>(2 * i) = (1. - x) * p_1 + x * p_2;
       }
     }
-    zmpCons_ = std::make_shared<copra::TrajectoryConstraint>(A, b);
-  }
-
-  void ModelPredictiveControl::updateJerkCost()
-  {
-    Eigen::Matrix2d jerkMat = Eigen::Matrix2d::Identity();
-    Eigen::Vector2d jerkVec = Eigen::Vector2d::Zero();
-    jerkCost_ = std::make_shared<copra::ControlCost>(jerkMat, jerkVec);
-    jerkCost_->weight(jerkWeight);
   }
 
-  void ModelPredictiveControl::updateVelCost()
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::computeVelRef()
   {
     velRef_.setZero();
     const Eigen::Matrix3d & R_0 = initContact_.pose.rotation();
@@ -302,108 +936,304 @@ namespace vhip_walking
     {
       if (indexToHrep_[i] <= 1)
       {
-        double w = static_cast<double>(i) / (nbInitSupportSteps_ + nbDoubleSupportSteps_);
+        double w = phaseProgress(i, 0, nbInitSupportSteps_ + nbDoubleSupportSteps_);
         w = clamp(w, 0., 1.);
         R = slerp(R_0, R_1, w).topLeftCorner<2, 2>();
         v = (1. - w) * v_0 + w * v_1;
       }
       else // (indexToHrep_[i] <= 3), which implies nbTargetSupportSteps_ > 0
       {
-        long i2 = i - nbInitSupportSteps_ - nbDoubleSupportSteps_; // >= 0
-        double w = static_cast<double>(i2) / (nbTargetSupportSteps_ + nbNextDoubleSupportSteps_);
+        unsigned i2 = nbInitSupportSteps_ + nbDoubleSupportSteps_; // <= i
+        double w = phaseProgress(i, i2, nbTargetSupportSteps_ + nbNextDoubleSupportSteps_);
         w = clamp(w, 0., 1.);
         R = slerp(R_1, R_2, w).topLeftCorner<2, 2>();;
         v = (1. - w) * v_1 + w * v_2;
       }
-      velCostMat_.block<2, STATE_SIZE>(2 * i, STATE_SIZE * i).block<2, 2>(0, 2) = R;
-      velRef_.segment<2>(2 * i) = R * v;
+      velRotations_[i] = R;
+      velRef_.template segment<2>(2 * i) = R * v;
     }
-    velCost_ = std::make_shared<copra::TrajectoryCost>(velCostMat_, velRef_);
-    velCost_->weights(velWeights);
-  }
-
-  void ModelPredictiveControl::updateZMPCost()
-  {
-    zmpCost_ = std::make_shared<copra::TrajectoryCost>(zmpFromState_, zmpRef_);
-    zmpCost_->weight(zmpWeight);
-    zmpCost_->autoSpan(); // repeat zmpFromState
   }
 
-  bool ModelPredictiveControl::solve()
+  template <unsigned NB_STEPS_>
+  bool ModelPredictiveControl<NB_STEPS_>::solve(double timeBudget)
   {
     using namespace std::chrono;
     auto startTime = high_resolution_clock::now();
+    auto deadline = TimePoint::max();
+    if (timeBudget > 0. && timeBudget < std::numeric_limits<double>::infinity())
+    {
+      deadline = startTime + duration_cast<high_resolution_clock::duration>(duration<double, std::milli>(timeBudget));
+    }
 
     computeZMPRef();
+    computeVelRef();
+    initContact_.hrep(hrepMats_[0], hrepVecs_[0]);
+    targetContact_.hrep(hrepMats_[2], hrepVecs_[2]);
+    //hreps_[1] = getDoubleSupportHrep(initContact_, targetContact_);
+    //hreps_[3] = getDoubleSupportHrep(targetContact_, nextContact_);
 
-    previewSystem_->xInit(initState_);
-    updateTerminalConstraint();
-    updateZMPConstraint();
-    updateJerkCost();
-    updateVelCost();
-    updateZMPCost();
-
-    // Solve times over 200 samples:
-    // |---------------------------------|
-    // | QP solver     | Solve time [ms] |
-    // |---------------------------------|
-    // | LSSOL         | 0.23 ± 0.10     |
-    // | QLD           | 0.08 ± 0.02     |
-    // | QuadProgDense | 0.10 ± 0.03     |
-    // |---------------------------------|
-
-    copra::LMPC lmpc(previewSystem_, solver_);
-
-    lmpc.addConstraint(termDCMCons_);
-    lmpc.addConstraint(termZMPCons_);
-    lmpc.addConstraint(zmpCons_);
-    lmpc.addCost(jerkCost_);
-    lmpc.addCost(velCost_);
-    lmpc.addCost(zmpCost_);
-
-    bool solutionFound = lmpc.solve();
-    if (solutionFound)
+    Formulation formulation = formulation_;
+    if (formulation == Formulation::Copra && !isUniformGrid())
+    {
+      formulation = fallbackFormulation(); // warned when the grid was set
+    }
+    bool useCondensed = false;
+    if constexpr (HAS_CONDENSED)
     {
-      solution_.reset(new ModelPredictiveControlSolution(lmpc.trajectory(), lmpc.control()));
+      useCondensed = (formulation == Formulation::Condensed);
+      if (useCondensed)
+      {
+        condensed_.build(*this);
+      }
+    }
+    if (formulation == Formulation::Riccati)
+    {
+      buildRiccati();
+    }
+    auto buildEndTime = high_resolution_clock::now();
+    buildTime_ = 1000. * duration_cast<duration<double>>(buildEndTime - startTime).count();
+
+    bool solutionFound = false;
+    bool feasibleIterate = false;
+    bool timedOut = (buildEndTime > deadline);
+    solveTime_ = 0.;
+    if (!timedOut)
+    {
+      if constexpr (HAS_CONDENSED)
+      {
+        if (useCondensed)
+        {
+          solutionFound = condensed_.solve(jerkTraj_, stateTraj_, deadline);
+          solveTime_ = condensed_.solveTime();
+          timedOut = condensed_.timedOut();
+        }
+      }
+      if (formulation == Formulation::Riccati)
+      {
+        solutionFound = solveRiccati(deadline);
+        timedOut = riccati_.timedOut();
+        feasibleIterate = riccati_.feasible();
+      }
+#ifdef VHIP_WALKING_WITH_COPRA
+      if (formulation == Formulation::Copra)
+      {
+        solutionFound = copra_->solve(*this, jerkTraj_, stateTraj_); // built and solved together, to completion
+        solveTime_ = copra_->solveTime();
+      }
+#endif
+    }
+    std::shared_ptr<Solution> previous = solution_;
+    solution_ = solutionPool_.acquire(); // not referenced by previous or by the controller
+    if (!solution_)
+    {
+      mc_rtc::log::error("All {} MPC solution slots are in use", ModelPredictiveControlSolutionPool<NB_STEPS>::SIZE);
+      solution_ = previous;
+      status_ = SolveStatus::Failed;
+    }
+    else if (solutionFound)
+    {
+      status_ = SolveStatus::Optimal;
+      *solution_ = Solution(stateTraj_, jerkTraj_, stepTimes_, zeta_);
+    }
+    else if (timedOut && feasibleIterate)
+    {
+      mc_rtc::log::warning("MPC time budget of {} ms exceeded, using best feasible iterate", timeBudget);
+      status_ = SolveStatus::BestFeasible;
+      *solution_ = Solution(stateTraj_, jerkTraj_, stepTimes_, zeta_);
+    }
+    else if (timedOut && previous && status_ != SolveStatus::Failed) // status of the previous solve
+    {
+      mc_rtc::log::warning("MPC time budget of {} ms exceeded, shifting previous solution", timeBudget);
+      status_ = SolveStatus::ShiftedPrevious;
+      *solution_ = Solution(*previous, previous->playbackTime());
     }
     else
     {
       mc_rtc::log::error("Model predictive control problem has no solution");
-      solution_.reset(new ModelPredictiveControlSolution(initState_));
+      status_ = SolveStatus::Failed;
+      *solution_ = Solution(initState_, stepTimes_, zeta_);
     }
 
     auto endTime = high_resolution_clock::now();
     buildAndSolveTime_ = 1000. * duration_cast<duration<double>>(endTime - startTime).count();
-    solveTime_ = 1000. * lmpc.solveTime();
+    return (status_ != SolveStatus::Failed);
+  }
+
+  template <unsigned NB_STEPS_>
+  void ModelPredictiveControl<NB_STEPS_>::buildRiccati()
+  {
+    const Eigen::Matrix2d velWeightMat = velWeights.asDiagonal();
+    for (unsigned i = 0; i <= NB_STEPS; i++)
+    {
+      typename Riccati::Stage & stage = riccati_.stage(i);
+      if (i < NB_STEPS)
+      {
+        stage.A = stateMatrices_[i];
+        stage.B = inputMatrices_[i];
+      }
+      stage.R = jerkWeight * Eigen::Matrix2d::Identity();
+
+      const Eigen::Matrix2d & R = velRotations_[i];
+      stage.Q.noalias() = zmpWeight * zmpFromState_.transpose() * zmpFromState_;
+      stage.Q.template block<2, 2>(2, 2).noalias() += R.transpose() * velWeightMat * R;
+      stage.q.noalias() = -zmpWeight * zmpFromState_.transpose() * zmpRef_.template segment<2>(2 * i);
+      stage.q.template segment<2>(2).noalias() -= R.transpose() * velWeightMat * velRef_.template segment<2>(2 * i);
+      stage.Q *= costScales_[i];
+      stage.q *= costScales_[i];
+      stage.R *= costScales_[i];
+
+      unsigned hrepIndex = indexToHrep_[i];
+      stage.constrained = (hrepIndex % 2 == 0);
+      if (stage.constrained)
+      {
+        stage.D.noalias() = hrepMats_[hrepIndex] * zmpFromState_;
+        stage.d = hrepVecs_[hrepIndex];
+      }
+    }
+
+    Eigen::Matrix<double, NB_TERM_CONS, STATE_SIZE> termMat;
+    Eigen::Matrix<double, NB_TERM_CONS, 1> termVec;
+    termMat << dcmFromState_, zmpFromState_;
+    termVec << zmpRef_.template tail<2>(), zmpRef_.template tail<2>(); // DCM and ZMP targets
+    riccati_.equality(terminalStep(), termMat, termVec);
+  }
+
+  template <unsigned NB_STEPS_>
+  bool ModelPredictiveControl<NB_STEPS_>::solveRiccati(TimePoint deadline)
+  {
+    riccati_.deadline(deadline);
+    bool solutionFound = riccati_.solve(initState_);
+    if (riccati_.feasible()) // solution or best feasible iterate
+    {
+      for (unsigned i = 0; i < NB_STEPS; i++)
+      {
+        jerkTraj_.template segment<INPUT_SIZE>(INPUT_SIZE * i) = riccati_.input(i);
+        stateTraj_.template segment<STATE_SIZE>(STATE_SIZE * i) = riccati_.state(i);
+      }
+      stateTraj_.template tail<STATE_SIZE>() = riccati_.state(NB_STEPS);
+    }
+    solveTime_ = riccati_.solveTime();
     return solutionFound;
   }
 
-  namespace
+  template <unsigned NB_STEPS>
+  ModelPredictiveControlSolution<NB_STEPS>::ModelPredictiveControlSolution(const ModelPredictiveControlBase::StateVector & initState, const StepTimes & stepTimes, double zeta)
+    : stepTimes_(stepTimes),
+      zeta_(zeta)
+  {
+    zeroFrom(initState);
+    indexSteps();
+  }
+
+  template <unsigned NB_STEPS>
+  ModelPredictiveControlSolution<NB_STEPS>::ModelPredictiveControlSolution(const StateTraj & stateTraj, const InputTraj & jerkTraj, const StepTimes & stepTimes, double zeta)
+    : jerkTraj_(jerkTraj),
+      stateTraj_(stateTraj),
+      stepTimes_(stepTimes),
+      zeta_(zeta)
+  {
+    indexSteps();
+  }
+
+  template <unsigned NB_STEPS>
+  ModelPredictiveControlSolution<NB_STEPS>::ModelPredictiveControlSolution(const ModelPredictiveControlSolution & previous, double playbackTime)
+    : jerkTraj_(previous.jerkTraj_),
+      stateTraj_(previous.stateTraj_),
+      stepTimes_(previous.stepTimes_),
+      shifted_(true),
+      bucketDuration_(previous.bucketDuration_),
+      zeta_(previous.zeta_),
+      bucketSteps_(previous.bucketSteps_)
+  {
+    playbackTime_ = playbackTime;
+    playbackStep_ = stepAt(playbackTime_);
+  }
+
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlSolution<NB_STEPS>::indexSteps()
+  {
+    bucketDuration_ = stepTimes_[NB_STEPS] / NB_STEPS;
+    unsigned step = 0;
+    for (unsigned bucket = 0; bucket < NB_STEPS; bucket++)
+    {
+      double startTime = bucket * bucketDuration_;
+      while (step + 1 < NB_STEPS && stepTimes_[step + 1] <= startTime)
+      {
+        step++;
+      }
+      bucketSteps_[bucket] = step;
+    }
+  }
+
+  template <unsigned NB_STEPS>
+  unsigned ModelPredictiveControlSolution<NB_STEPS>::stepAt(double t) const
   {
-    constexpr double SAMPLING_PERIOD = ModelPredictiveControl::SAMPLING_PERIOD;
-    constexpr unsigned INPUT_SIZE = ModelPredictiveControl::INPUT_SIZE;
-    constexpr unsigned NB_STEPS = ModelPredictiveControl::NB_STEPS;
-    constexpr unsigned STATE_SIZE = ModelPredictiveControl::STATE_SIZE;
+    if (t + STEP_TIME_TOL >= stepTimes_[NB_STEPS])
+    {
+      return NB_STEPS;
+    }
+    unsigned bucket = (t > 0.) ? std::min(static_cast<unsigned>(t / bucketDuration_), NB_STEPS - 1) : 0;
+    unsigned step = bucketSteps_[bucket];
+    while (t + STEP_TIME_TOL >= stepTimes_[step + 1])
+    {
+      step++;
+    }
+    return step;
+  }
+
+  template <unsigned NB_STEPS>
+  typename ModelPredictiveControlSolution<NB_STEPS>::Sample ModelPredictiveControlSolution<NB_STEPS>::sample(double t) const
+  {
+    Sample sample;
+    unsigned step = stepAt(t);
+    const auto & x = stateTraj_.template segment<STATE_SIZE>(STATE_SIZE * step);
+    if (step < NB_STEPS)
+    {
+      double tau = std::max(t - stepTimes_[step], 0.);
+      sample.comddd = jerkTraj_.template segment<INPUT_SIZE>(INPUT_SIZE * step);
+      sample.com = x.template head<2>() + tau * (x.template segment<2>(2) + tau * (x.template tail<2>() / 2 + tau * (sample.comddd / 6)));
+      sample.comd = x.template segment<2>(2) + tau * (x.template tail<2>() + tau * (sample.comddd / 2));
+      sample.comdd = x.template tail<2>() + tau * sample.comddd;
+    }
+    else // end of preview horizon
+    {
+      sample.com = x.template head<2>();
+      sample.comd = x.template segment<2>(2);
+      sample.comdd = x.template tail<2>();
+      sample.comddd.setZero();
+    }
+    sample.zmp = sample.com - zeta_ * sample.comdd;
+    return sample;
   }
 
-  ModelPredictiveControlSolution::ModelPredictiveControlSolution(const Eigen::VectorXd & initState)
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlSolution<NB_STEPS>::zeroFrom(const ModelPredictiveControlBase::StateVector & initState)
   {
-    jerkTraj_ = Eigen::VectorXd::Zero(NB_STEPS * INPUT_SIZE);
-    stateTraj_ = Eigen::VectorXd::Zero((NB_STEPS + 1) * STATE_SIZE);
-    stateTraj_.head<STATE_SIZE>() = initState;
+    jerkTraj_.setZero();
+    stateTraj_.template head<STATE_SIZE>() = initState;
+    for (unsigned i = 0; i < NB_STEPS; i++)
+    {
+      double T = stepTimes_[i + 1] - stepTimes_[i];
+      const auto x = stateTraj_.template segment<STATE_SIZE>(STATE_SIZE * i);
+      auto nextX = stateTraj_.template segment<STATE_SIZE>(STATE_SIZE * (i + 1));
+      nextX.template head<2>() = x.template head<2>() + T * (x.template segment<2>(2) + T * x.template tail<2>() / 2);
+      nextX.template segment<2>(2) = x.template segment<2>(2) + T * x.template tail<2>();
+      nextX.template tail<2>() = x.template tail<2>();
+    }
   }
 
-  ModelPredictiveControlSolution::ModelPredictiveControlSolution(const Eigen::VectorXd & stateTraj, const Eigen::VectorXd & jerkTraj)
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlSolution<NB_STEPS>::predict(Pendulum & pendulum, double dt, unsigned nbSteps) const
   {
-    if (stateTraj.size() / STATE_SIZE != 1 + jerkTraj.size() / INPUT_SIZE)
+    ModelPredictiveControlSolution playback = *this; // on the stack
+    for (unsigned i = 0; i < nbSteps; i++)
     {
-      mc_rtc::log::error("Invalid state/input sizes, respectively {} and {}", stateTraj.size(), jerkTraj.size());
+      playback.integrate(pendulum, dt);
     }
-    jerkTraj_ = jerkTraj;
-    stateTraj_ = stateTraj;
   }
 
-  void ModelPredictiveControlSolution::integrate(Pendulum & pendulum, double dt)
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlSolution<NB_STEPS>::integrate(Pendulum & pendulum, double dt)
   {
     if (playbackStep_ < NB_STEPS)
     {
@@ -415,23 +1245,31 @@ namespace vhip_walking
     }
   }
 
-  void ModelPredictiveControlSolution::integratePlayback(Pendulum & pendulum, double dt)
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlSolution<NB_STEPS>::integratePlayback(Pendulum & pendulum, double dt)
   {
-    Eigen::Vector3d comddd;
-    comddd.head<INPUT_SIZE>() = jerkTraj_.segment<INPUT_SIZE>(INPUT_SIZE * playbackStep_);
-    comddd.z() = 0.;
-    playbackTime_ += dt;
-    if (playbackTime_ >= (playbackStep_ + 1) * SAMPLING_PERIOD)
+    while (dt > 0. && playbackStep_ < NB_STEPS)
     {
-      playbackStep_++;
+      double stepDt = std::min(dt, stepTimes_[playbackStep_ + 1] - playbackTime_);
+      Eigen::Vector3d comddd;
+      comddd.head<INPUT_SIZE>() = sample(playbackTime_).comddd;
+      comddd.z() = 0.;
+      pendulum.integrateCoMJerk(comddd, stepDt);
+      playbackTime_ += stepDt;
+      playbackStep_ = stepAt(playbackTime_);
+      dt -= stepDt;
+    }
+    if (dt > 0.)
+    {
+      integratePostPlayback(pendulum, dt);
     }
-    pendulum.integrateCoMJerk(comddd, dt);
   }
 
-  void ModelPredictiveControlSolution::integratePostPlayback(Pendulum & pendulum, double dt)
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlSolution<NB_STEPS>::integratePostPlayback(Pendulum & pendulum, double dt)
   {
     Eigen::Vector3d comddd;
-    Eigen::VectorXd lastState = stateTraj_.segment<STATE_SIZE>(STATE_SIZE * NB_STEPS);
+    const ModelPredictiveControlBase::StateVector lastState = stateTraj_.template tail<STATE_SIZE>();
     Eigen::Vector2d comd_f = lastState.segment<2>(2);
     Eigen::Vector2d comdd_f = lastState.segment<2>(4);
     if (std::abs(comd_f.x() * comdd_f.y() - comd_f.y() * comdd_f.x()) > 1e-4)
@@ -444,4 +1282,62 @@ namespace vhip_walking
     comddd.z() = 0.;
     pendulum.integrateCoMJerk(comddd, dt);
   }
+
+  template <unsigned NB_STEPS>
+  ModelPredictiveControlSolutionPool<NB_STEPS>::ModelPredictiveControlSolutionPool()
+  {
+    for (auto & slot : slots_)
+    {
+      slot.reset(new Solution());
+    }
+  }
+
+  template <unsigned NB_STEPS>
+  std::shared_ptr<ModelPredictiveControlSolution<NB_STEPS>> ModelPredictiveControlSolutionPool<NB_STEPS>::acquire()
+  {
+    for (const auto & slot : slots_)
+    {
+      if (slot.use_count() == 1)
+      {
+        // Synchronize with the release of the last outside reference, which
+        // may have happened on another thread
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot;
+      }
+    }
+    return nullptr;
+  }
+
+  template <unsigned NB_STEPS>
+  bool ModelPredictiveControlProblem<NB_STEPS>::matches(const ModelPredictiveControlProblem & other, double tolerance) const
+  {
+    auto contactsMatch = [tolerance](const Contact & a, const Contact & b)
+    {
+      return a.surfaceName == b.surfaceName && a.halfLength == b.halfLength && a.halfWidth == b.halfWidth &&
+        (a.pose.translation() - b.pose.translation()).lpNorm<Eigen::Infinity>() <= tolerance &&
+        (a.pose.rotation() - b.pose.rotation()).lpNorm<Eigen::Infinity>() <= tolerance &&
+        (a.refVel - b.refVel).lpNorm<Eigen::Infinity>() <= tolerance;
+    };
+    return stepTimes == other.stepTimes && comHeight == other.comHeight &&
+      jerkWeight == other.jerkWeight && velWeights == other.velWeights && zmpWeight == other.zmpWeight &&
+      nbInitSupportSteps == other.nbInitSupportSteps && nbDoubleSupportSteps == other.nbDoubleSupportSteps &&
+      nbTargetSupportSteps == other.nbTargetSupportSteps && nbNextDoubleSupportSteps == other.nbNextDoubleSupportSteps &&
+      contactsMatch(initContact, other.initContact) && contactsMatch(targetContact, other.targetContact) &&
+      contactsMatch(nextContact, other.nextContact) &&
+      (initState - other.initState).lpNorm<Eigen::Infinity>() <= tolerance;
+  }
+
+  template struct ModelPredictiveControlSolution<16>;
+  template struct ModelPredictiveControlSolution<32>;
+  template struct ModelPredictiveControlSolution<64>;
+  template struct ModelPredictiveControlSolutionPool<16>;
+  template struct ModelPredictiveControlSolutionPool<32>;
+  template struct ModelPredictiveControlSolutionPool<64>;
+  template struct ModelPredictiveControlProblem<16>;
+  template struct ModelPredictiveControlProblem<32>;
+  template struct ModelPredictiveControlProblem<64>;
+  template struct CondensedFormulation<16>;
+  template struct ModelPredictiveControl<16>;
+  template struct ModelPredictiveControl<32>;
+  template struct ModelPredictiveControl<64>;
 }
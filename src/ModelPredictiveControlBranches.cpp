@@ -0,0 +1,111 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include <limits>
+
+#include <vhip_walking/ModelPredictiveControlBranches.h>
+
+namespace vhip_walking
+{
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlBranches<NB_STEPS>::addLogEntries(mc_rtc::Logger & logger)
+  {
+    logger.addLogEntry("mpc_branches_hits", [this]() { return nbHits_; });
+    logger.addLogEntry("mpc_branches_misses", [this]() { return nbMisses_; });
+  }
+
+  template <unsigned NB_STEPS>
+  bool ModelPredictiveControlBranches<NB_STEPS>::post(PreviewBranch branchId, const Problem & problem)
+  {
+    Branch & branch = branches_[static_cast<unsigned>(branchId)];
+    bool isWorkerBusy = collect();
+    if (branch.isSolved && branch.problem.matches(problem, MATCH_TOLERANCE))
+    {
+      return true;
+    }
+    if (isWorkerBusy)
+    {
+      return false;
+    }
+    branch.problem = problem;
+    branch.problem.timeBudget = std::numeric_limits<double>::infinity();
+    branch.isSolved = false;
+    branch.solution = nullptr;
+    branch.isPending = worker_.post(branch.problem, ++nbPosts_);
+    return branch.isPending;
+  }
+
+  template <unsigned NB_STEPS>
+  bool ModelPredictiveControlBranches<NB_STEPS>::pickUp(const Problem & problem, std::shared_ptr<Preview> & preview, SolveStatus & status)
+  {
+    collect();
+    for (auto & branch : branches_)
+    {
+      // Solutions are handed out as is, so a branch can only serve its
+      // solution again while it has not been played back
+      if (branch.solution && branch.solution->playbackTime() <= 0. && branch.problem.matches(problem, MATCH_TOLERANCE))
+      {
+        preview = branch.solution;
+        status = branch.status;
+        nbHits_++;
+        return true;
+      }
+    }
+    nbMisses_++;
+    return false;
+  }
+
+  template <unsigned NB_STEPS>
+  bool ModelPredictiveControlBranches<NB_STEPS>::collect()
+  {
+    unsigned long id;
+    for (auto & branch : branches_)
+    {
+      if (!branch.isPending)
+      {
+        continue;
+      }
+      if (!worker_.pickUp(branch.solution, branch.status, id))
+      {
+        return true;
+      }
+      branch.isPending = false;
+      branch.isSolved = true;
+      if (branch.status == SolveStatus::Failed)
+      {
+        branch.solution = nullptr;
+      }
+    }
+    return false;
+  }
+
+  template struct ModelPredictiveControlBranches<16>;
+  template struct ModelPredictiveControlBranches<32>;
+  template struct ModelPredictiveControlBranches<64>;
+}
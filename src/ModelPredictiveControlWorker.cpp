@@ -0,0 +1,124 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <vhip_walking/ModelPredictiveControlWorker.h>
+
+namespace vhip_walking
+{
+  template <unsigned NB_STEPS>
+  ModelPredictiveControlWorker<NB_STEPS>::ModelPredictiveControlWorker()
+    : thread_([this]() { run(); })
+  {
+  }
+
+  template <unsigned NB_STEPS>
+  ModelPredictiveControlWorker<NB_STEPS>::~ModelPredictiveControlWorker()
+  {
+    {
+      std::lock_guard<std::mutex> lock(wakeUpMutex_);
+      stop_ = true;
+    }
+    wakeUp_.notify_one();
+    thread_.join();
+  }
+
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlWorker<NB_STEPS>::addLogEntries(mc_rtc::Logger & logger)
+  {
+    logger.addLogEntry("perf_MPCWorker_buildAndSolve", [this]() { return buildAndSolveTime_; });
+    logger.addLogEntry("perf_MPCWorker_latency", [this]() { return latency_; });
+  }
+
+  template <unsigned NB_STEPS>
+  bool ModelPredictiveControlWorker<NB_STEPS>::post(const Problem & problem, unsigned long id)
+  {
+    if (status_.load(std::memory_order_acquire) != Status::Idle)
+    {
+      return false;
+    }
+    mpc_.copyProblem(problem);
+    mpc_.detachSolution(); // the last solution may still be played back by the caller
+    id_ = id;
+    postTime_ = std::chrono::high_resolution_clock::now();
+    {
+      // Held only while the worker checks for a request, so that the
+      // notification cannot fall between its check and its wait
+      std::lock_guard<std::mutex> lock(wakeUpMutex_);
+      status_.store(Status::Requested, std::memory_order_release);
+    }
+    wakeUp_.notify_one();
+    return true;
+  }
+
+  template <unsigned NB_STEPS>
+  bool ModelPredictiveControlWorker<NB_STEPS>::pickUp(std::shared_ptr<Preview> & preview, SolveStatus & status, unsigned long & id)
+  {
+    using namespace std::chrono;
+    if (status_.load(std::memory_order_acquire) != Status::Done)
+    {
+      return false;
+    }
+    status = solveStatus_;
+    if (status != SolveStatus::Failed)
+    {
+      preview = mpc_.solution();
+    }
+    id = id_;
+    buildAndSolveTime_ = mpc_.buildAndSolveTime();
+    latency_ = 1000. * duration_cast<duration<double>>(high_resolution_clock::now() - postTime_).count();
+    status_.store(Status::Idle, std::memory_order_release);
+    return true;
+  }
+
+  template <unsigned NB_STEPS>
+  void ModelPredictiveControlWorker<NB_STEPS>::run()
+  {
+    while (!stop_)
+    {
+      {
+        std::unique_lock<std::mutex> lock(wakeUpMutex_);
+        wakeUp_.wait(lock,
+          [this]()
+          {
+            return stop_ || status_.load(std::memory_order_acquire) == Status::Requested;
+          });
+      }
+      if (status_.load(std::memory_order_acquire) != Status::Requested)
+      {
+        continue;
+      }
+      mpc_.solve();
+      solveStatus_ = mpc_.status();
+      status_.store(Status::Done, std::memory_order_release);
+    }
+  }
+
+  template struct ModelPredictiveControlWorker<16>;
+  template struct ModelPredictiveControlWorker<32>;
+  template struct ModelPredictiveControlWorker<64>;
+}
@@ -74,6 +74,17 @@ namespace vhip_walking
     comddd_ = comddd;
   }
 
+  void Pendulum::setState(const Eigen::Vector3d & com, const Eigen::Vector3d & comd, const Eigen::Vector3d & comdd, const Eigen::Vector3d & zmp, double omega)
+  {
+    com_ = com;
+    comd_ = comd;
+    comdd_ = comdd;
+    comddd_ = Eigen::Vector3d::Zero();
+    omega_ = omega;
+    zmp_ = zmp;
+    zmpd_ = comd_ - comddd_ / (omega_ * omega_);
+  }
+
   void Pendulum::resetCoMHeight(double height, const Contact & plane)
   {
     auto n = plane.normal();
@@ -26,9 +26,11 @@
  */
 
 #include <chrono>
+#include <fstream>
 
 #include <vhip_walking/Stabilizer.h>
 #include <vhip_walking/utils/clamp.h>
+#include <vhip_walking/utils/qp_records.h>
 #include <mc_rtc/gui.h>
 
 namespace vhip_walking
@@ -66,6 +68,18 @@ namespace vhip_walking
         return TemplateModel::VariableHeightInvertedPendulum;
       }
     }
+
+    static const std::string RUN_STAGE_LABELS[8] =
+    {
+      "checkGains",
+      "checkInTheAir",
+      "updateSupportFootGains",
+      "updateSupportGeometry",
+      "computeDesiredWrench",
+      "distributeWrench",
+      "updateCoMAdmittanceControl",
+      "updateFootForceDifferenceControl"
+    };
   }
 
   Stabilizer::Stabilizer(const mc_rbdyn::Robot & controlRobot, const Pendulum & pendulum, double dt)
@@ -77,6 +91,11 @@ namespace vhip_walking
   {
   }
 
+  Stabilizer::~Stabilizer()
+  {
+    flushVHIPRecords();
+  }
+
   void Stabilizer::addLogEntries(mc_rtc::Logger & logger)
   {
     logger.addLogEntry("stabilizer_contactState",
@@ -103,6 +122,54 @@ namespace vhip_walking
     logger.addLogEntry("perf_Stabilizer_fdqp", [this]() { return fdqpRunTime_; });
     logger.addLogEntry("perf_Stabilizer_run", [this]() { return runTime_; });
     logger.addLogEntry("perf_Stabilizer_vhip", [this]() { return vhipRunTime_; });
+    for (QPBackend backend : QP_BACKENDS)
+    {
+      const std::string & label = qpBackendToString(backend);
+      logger.addLogEntry("perf_Stabilizer_fdqp_" + label,
+        [this, backend]()
+        {
+          if (fdqpBackend() != backend)
+          {
+            return 0.;
+          }
+          else if (contactState_ == ContactState::DoubleSupport)
+          {
+            return dsQP_.solveTime();
+          }
+          return (ssQPBypassed_ || ssSolvedExplicitly_) ? 0. : ssQP_.solveTime();
+        });
+      logger.addLogEntry("perf_Stabilizer_vhip_" + label,
+        [this, backend]()
+        {
+          if (vhipQP_.backend() == backend)
+          {
+            return vhipQP_.solveTime();
+          }
+          else if (compareVHIPSolvers_ && backend == QPBackend::LSSOL)
+          {
+            return vhipReferenceQP_.solveTime();
+          }
+          return 0.;
+        });
+    }
+    logger.addLogEntry("perf_Stabilizer_fdqp_fallback",
+      [this]()
+      {
+        if (contactState_ == ContactState::DoubleSupport)
+        {
+          return dsQP_.fallbackTime();
+        }
+        return (ssQPBypassed_ || ssSolvedExplicitly_) ? 0. : ssQP_.fallbackTime();
+      });
+    logger.addLogEntry("perf_Stabilizer_vhip_fallback", [this]() { return vhipQP_.fallbackTime(); });
+    for (unsigned stage = 0; stage < NB_RUN_STAGES; stage++)
+    {
+      const std::string prefix = "perf_Stabilizer_stages_" + RUN_STAGE_LABELS[stage];
+      const LatencyHistogram & latency = runStageLatency_[stage];
+      logger.addLogEntry(prefix + "_max", [&latency]() { return latency.max(); });
+      logger.addLogEntry(prefix + "_p50", [&latency]() { return latency.p50(); });
+      logger.addLogEntry(prefix + "_p99", [&latency]() { return latency.p99(); });
+    }
     logger.addLogEntry("stabilizer_admittance_com", [this]() { return comAdmittance_; });
     logger.addLogEntry("stabilizer_admittance_cop", [this]() { return copAdmittance_; });
     logger.addLogEntry("stabilizer_admittance_dfz", [this]() { return dfzAdmittance_; });
@@ -112,17 +179,31 @@ namespace vhip_walking
     logger.addLogEntry("stabilizer_altcc_error", [this]() { return altccError_; });
     logger.addLogEntry("stabilizer_altcc_leakRate", [this]() { return altccIntegrator_.rate(); });
     logger.addLogEntry("stabilizer_comOffset", [this]() { return comOffset_; });
+    logger.addLogEntry("stabilizer_contact_left", [this]() { return leftFootContact.pose; });
+    logger.addLogEntry("stabilizer_contact_left_halfLength", [this]() { return leftFootContact.halfLength; });
+    logger.addLogEntry("stabilizer_contact_left_halfWidth", [this]() { return leftFootContact.halfWidth; });
+    logger.addLogEntry("stabilizer_contact_right", [this]() { return rightFootContact.pose; });
+    logger.addLogEntry("stabilizer_contact_right_halfLength", [this]() { return rightFootContact.halfLength; });
+    logger.addLogEntry("stabilizer_contact_right_halfWidth", [this]() { return rightFootContact.halfWidth; });
     logger.addLogEntry("stabilizer_dcm_feedback_gain", [this]() { return dcmGain_; });
     logger.addLogEntry("stabilizer_dcm_feedback_integralGain", [this]() { return dcmIntegralGain_; });
     logger.addLogEntry("stabilizer_distribWrench", [this]() { return distribWrench_; });
+    logger.addLogEntry("stabilizer_fdqp_backend", [this]() { return qpBackendToString(fdqpBackend()); });
+    logger.addLogEntry("stabilizer_fdqp_factorizations", [this]() { return dsQP_.factorizations(); });
+    logger.addLogEntry("stabilizer_fdqp_fallbacks", [this]() { return dsQP_.nbFallbacks() + ssQP_.nbFallbacks(); });
+    logger.addLogEntry("stabilizer_fdqp_ss_bypassed", [this]() { return ssNbBypassed_; });
+    logger.addLogEntry("stabilizer_fdqp_ss_explicit", [this]() { return ssSolvedExplicitly_; });
+    logger.addLogEntry("stabilizer_fdqp_ss_solved", [this]() { return ssNbSolved_; });
     logger.addLogEntry("stabilizer_fdqp_weights_ankleTorque", [this]() { return std::pow(fdqpWeights_.ankleTorqueSqrt, 2); });
     logger.addLogEntry("stabilizer_fdqp_weights_netWrench", [this]() { return std::pow(fdqpWeights_.netWrenchSqrt, 2); });
     logger.addLogEntry("stabilizer_fdqp_weights_pressure", [this]() { return std::pow(fdqpWeights_.pressureSqrt, 2); });
+    logger.addLogEntry("stabilizer_imu_orientation", [this]() { return controlRobot_.bodySensor().orientation(); });
     logger.addLogEntry("stabilizer_integrator_timeConstant", [this]() { return dcmIntegrator_.timeConstant(); });
     logger.addLogEntry("stabilizer_lambda_distrib", [this]() { return distribLambda_; });
     logger.addLogEntry("stabilizer_lambda_max", [this]() { return lambdaMax_; });
     logger.addLogEntry("stabilizer_lambda_measured", [this]() { return measuredLambda_; });
     logger.addLogEntry("stabilizer_lambda_min", [this]() { return lambdaMin_; });
+    logger.addLogEntry("stabilizer_mass", [this]() { return mass_; });
     logger.addLogEntry("stabilizer_vdc_damping", [this]() { return vdcDamping_; });
     logger.addLogEntry("stabilizer_vdc_frequency", [this]() { return vdcFrequency_; });
     logger.addLogEntry("stabilizer_vdc_stiffness", [this]() { return vdcStiffness_; });
@@ -136,6 +217,14 @@ namespace vhip_walking
     logger.addLogEntry("stabilizer_vhip_lambda", [this]() { return vhipLambda_; });
     logger.addLogEntry("stabilizer_vhip_omega", [this]() { return vhipOmega_; });
     logger.addLogEntry("stabilizer_vhip_omega2", [this]() { return std::pow(vhipOmega_, 2); });
+    logger.addLogEntry("stabilizer_vhip_qp_agreementRate",
+      [this]() -> double
+      {
+        return (vhipNbComparisons_ > 0) ? static_cast<double>(vhipNbAgreements_) / vhipNbComparisons_ : 0.;
+      });
+    logger.addLogEntry("stabilizer_vhip_qp_backend", [this]() { return qpBackendToString(vhipQP_.backend()); });
+    logger.addLogEntry("stabilizer_vhip_qp_fallbacks", [this]() { return vhipQP_.nbFallbacks(); });
+    logger.addLogEntry("stabilizer_vhip_qp_iterations", [this]() { return vhipQP_.iterations(); });
     logger.addLogEntry("stabilizer_vhip_zmp", [this]() { return vhipZMP_; });
     logger.addLogEntry("stabilizer_zmp", [this]() { return zmp(); });
     logger.addLogEntry("stabilizer_zmpcc_comAccel", [this]() { return zmpccCoMAccel_; });
@@ -232,6 +321,24 @@ namespace vhip_walking
         {TEMPLATE_MODEL_LABELS[0], TEMPLATE_MODEL_LABELS[1]},
         [this]() { return templateModelToString(model_); },
         [this](const std::string & model) { model_ = templateModelFromString(model); }),
+      ComboInput(
+        "FDQP backend",
+        {QP_BACKEND_LABELS[0], QP_BACKEND_LABELS[1], QP_BACKEND_LABELS[2], QP_BACKEND_LABELS[3]},
+        [this]() { return qpBackendToString(fdqpBackend()); },
+        [this](const std::string & backend) { fdqpBackend(qpBackendFromString(backend)); }),
+      ComboInput(
+        "VHIP QP backend",
+        {QP_BACKEND_LABELS[0], QP_BACKEND_LABELS[1], QP_BACKEND_LABELS[2], QP_BACKEND_LABELS[3]},
+        [this]() { return qpBackendToString(vhipQP_.backend()); },
+        [this](const std::string & backend) { vhipQP_.backend(qpBackendFromString(backend)); }),
+      Checkbox(
+        "Compare VHIP QP with LSSOL?",
+        [this]() { return compareVHIPSolvers_; },
+        [this]() { compareVHIPSolvers_ = !compareVHIPSolvers_; }),
+      Checkbox(
+        "Explicit SS wrench distribution?",
+        [this]() { return explicitSS_; },
+        [this]() { explicitSS_ = !explicitSS_; }),
       Checkbox(
         "Use ZMPCC only in double support?",
         [this]() { return zmpccOnlyDS_; },
@@ -267,6 +374,15 @@ namespace vhip_walking
         [this]() { return roundVec({zmpccError_.x() * 100., zmpccError_.y() * 100., distribLambda_ - measuredLambda_}, /* fact = */ 10.); }),
       Label("Foot height diff [mm]",
         [this]() { return std::round(vfcZCtrl_ * 1000.); }));
+    for (unsigned stage = 0; stage < NB_RUN_STAGES; stage++)
+    {
+      const LatencyHistogram & latency = runStageLatency_[stage];
+      gui->addElement(
+        {"Stabilizer", "Status"},
+        ArrayLabel(RUN_STAGE_LABELS[stage] + " [us]",
+          {"p50", "p99", "max"},
+          [&latency]() { return roundVec({latency.p50() * 1000., latency.p99() * 1000., latency.max() * 1000.}, /* fact = */ 10.); }));
+    }
   }
 
   void Stabilizer::disable()
@@ -284,6 +400,14 @@ namespace vhip_walking
   {
     config_ = config;
     reconfigure();
+    if (config_.has("qp_backend") && config_("qp_backend").has("record_vhip"))
+    {
+      flushVHIPRecords();
+      vhipRecordPath_ = static_cast<std::string>(config_("qp_backend")("record_vhip"));
+      vhipRecords_.reserve(MAX_VHIP_RECORDS);
+      std::ofstream(vhipRecordPath_, std::ios::trunc); // start a new file, records are appended by flushVHIPRecords()
+      mc_rtc::log::info("Recording up to {} VHIP feedback QPs to {}", MAX_VHIP_RECORDS, vhipRecordPath_);
+    }
   }
 
   void Stabilizer::reconfigure()
@@ -342,6 +466,20 @@ namespace vhip_walking
     {
       zmpccIntegrator_.rate(config_("zmpcc")("integrator_leak_rate"));
     }
+    if (config_.has("qp_backend"))
+    {
+      auto qpBackend = config_("qp_backend");
+      if (qpBackend.has("fdqp"))
+      {
+        fdqpBackend(qpBackendFromString(qpBackend("fdqp")));
+      }
+      if (qpBackend.has("vhip"))
+      {
+        vhipQP_.backend(qpBackendFromString(qpBackend("vhip")));
+      }
+      qpBackend("compare_with_lssol", compareVHIPSolvers_);
+      qpBackend("explicit_ss", explicitSS_);
+    }
   }
 
   void Stabilizer::reset(const mc_rbdyn::Robots & robots)
@@ -385,6 +523,19 @@ namespace vhip_walking
     zmpccCoMOffset_.setZero();
     zmpccCoMVel_.setZero();
     zmpccError_.setZero();
+
+    dsQP_.reset();
+    ssQP_.reset();
+    vhipQP_.reset();
+    vhipReferenceQP_.reset();
+    ssNbBypassed_ = 0;
+    ssNbSolved_ = 0;
+    vhipNbAgreements_ = 0;
+    vhipNbComparisons_ = 0;
+    for (auto & latency : runStageLatency_)
+    {
+      latency.reset();
+    }
   }
 
   void Stabilizer::checkGains()
@@ -420,6 +571,9 @@ namespace vhip_walking
     footTask->setGains(contactStiffness_, contactDamping_);
     footTask->targetPose(contact.pose);
     footTask->weight(contactWeight_);
+    dsQP_.resetActiveSet(); // contact wrench cones changed
+    ssQP_.resetActiveSet();
+    support_.valid = false;
     if (footTask->surface() == "LeftFootCenter")
     {
       leftFootContact = contact;
@@ -498,13 +652,15 @@ namespace vhip_walking
     inTheAir_ = (LFz < MIN_DS_PRESSURE && RFz < MIN_DS_PRESSURE);
   }
 
-  void Stabilizer::updateZMPFrame()
+  void Stabilizer::updateSupportGeometry()
   {
     const sva::PTransformd & X_0_lc = leftFootContact.pose;
     const sva::PTransformd & X_0_rc = rightFootContact.pose;
+    sva::PTransformd & zmpFrame = support_.zmpFrame;
+    std::vector<Eigen::Vector3d> & zmpPolygon = support_.zmpPolygon;
     if (contactState_ == ContactState::DoubleSupport)
     {
-      zmpFrame_ = sva::interpolate(X_0_lc, X_0_rc, 0.5);
+      zmpFrame = sva::interpolate(X_0_lc, X_0_rc, 0.5);
       double xmin = std::min(leftFootContact.xmin(), rightFootContact.xmin());
       double xmax = std::max(leftFootContact.xmax(), rightFootContact.xmax());
       double ymin = std::min(leftFootContact.ymin(), rightFootContact.ymin());
@@ -517,44 +673,56 @@ namespace vhip_walking
         0, +1,
         0, -1;
       hrepVec <<
-        xmax - zmpFrame_.translation().x(),
-        zmpFrame_.translation().x() - xmin,
-        ymax - zmpFrame_.translation().y(),
-        zmpFrame_.translation().y() - ymin;
-      zmpArea_ = Eigen::HrepXd(hrepMat, hrepVec);
-      zmpPolygon_.clear();
-      zmpPolygon_.push_back(Eigen::Vector3d{xmax, ymax, zmpFrame_.translation().z()});
-      zmpPolygon_.push_back(Eigen::Vector3d{xmax, ymin, zmpFrame_.translation().z()});
-      zmpPolygon_.push_back(Eigen::Vector3d{xmin, ymin, zmpFrame_.translation().z()});
-      zmpPolygon_.push_back(Eigen::Vector3d{xmin, ymax, zmpFrame_.translation().z()});
+        xmax - zmpFrame.translation().x(),
+        zmpFrame.translation().x() - xmin,
+        ymax - zmpFrame.translation().y(),
+        zmpFrame.translation().y() - ymin;
+      support_.zmpArea = Eigen::HrepXd(hrepMat, hrepVec);
+      zmpPolygon.clear();
+      zmpPolygon.push_back(Eigen::Vector3d{xmax, ymax, zmpFrame.translation().z()});
+      zmpPolygon.push_back(Eigen::Vector3d{xmax, ymin, zmpFrame.translation().z()});
+      zmpPolygon.push_back(Eigen::Vector3d{xmin, ymin, zmpFrame.translation().z()});
+      zmpPolygon.push_back(Eigen::Vector3d{xmin, ymax, zmpFrame.translation().z()});
     }
     else if (contactState_ == ContactState::LeftFoot)
     {
-      zmpFrame_ = X_0_lc;
-      zmpArea_ = leftFootContact.localHrep();
-      zmpPolygon_.clear();
-      zmpPolygon_.push_back(leftFootContact.vertex0());
-      zmpPolygon_.push_back(leftFootContact.vertex1());
-      zmpPolygon_.push_back(leftFootContact.vertex2());
-      zmpPolygon_.push_back(leftFootContact.vertex3());
+      zmpFrame = X_0_lc;
+      support_.zmpArea = leftFootContact.localHrep();
+      zmpPolygon.clear();
+      zmpPolygon.push_back(leftFootContact.vertex0());
+      zmpPolygon.push_back(leftFootContact.vertex1());
+      zmpPolygon.push_back(leftFootContact.vertex2());
+      zmpPolygon.push_back(leftFootContact.vertex3());
     }
     else // (contactState_ == ContactState::RightFoot)
     {
-      zmpFrame_ = X_0_rc;
-      zmpArea_ = rightFootContact.localHrep();
-      zmpPolygon_.clear();
-      zmpPolygon_.push_back(rightFootContact.vertex0());
-      zmpPolygon_.push_back(rightFootContact.vertex1());
-      zmpPolygon_.push_back(rightFootContact.vertex2());
-      zmpPolygon_.push_back(rightFootContact.vertex3());
+      zmpFrame = X_0_rc;
+      support_.zmpArea = rightFootContact.localHrep();
+      zmpPolygon.clear();
+      zmpPolygon.push_back(rightFootContact.vertex0());
+      zmpPolygon.push_back(rightFootContact.vertex1());
+      zmpPolygon.push_back(rightFootContact.vertex2());
+      zmpPolygon.push_back(rightFootContact.vertex3());
     }
-    measuredZMP_ = computeZMP(measuredWrench_);
+
+    support_.leftAnkleDual = leftFootContact.anklePose().dualMatrix();
+    support_.leftContactDual = X_0_lc.dualMatrix();
+    transformWrenchCone(wrenchFaceMatrix_, support_.leftContactDual, support_.leftWrenchCone);
+    support_.rightAnkleDual = rightFootContact.anklePose().dualMatrix();
+    support_.rightContactDual = X_0_rc.dualMatrix();
+    transformWrenchCone(wrenchFaceMatrix_, support_.rightContactDual, support_.rightWrenchCone);
+    if (coneProjectionValid_ && contactState_ != ContactState::DoubleSupport)
+    {
+      bool isLeftFoot = (contactState_ == ContactState::LeftFoot);
+      coneProjection_.update((isLeftFoot) ? support_.leftWrenchCone : support_.rightWrenchCone);
+    }
+    support_.valid = true;
   }
 
   Eigen::Vector3d Stabilizer::computeZMP(const sva::ForceVecd & wrench) const
   {
-    Eigen::Vector3d n = zmpFrame_.rotation().row(2);
-    Eigen::Vector3d p = zmpFrame_.translation();
+    Eigen::Vector3d n = support_.zmpFrame.rotation().row(2);
+    Eigen::Vector3d p = support_.zmpFrame.translation();
     const Eigen::Vector3d & force = wrench.force();
     double pressure = n.dot(force);
     if (pressure < 1.)
@@ -572,15 +740,44 @@ namespace vhip_walking
     using namespace std::chrono;
     auto startTime = high_resolution_clock::now();
 
-    checkGains();
-    checkInTheAir();
-    updateSupportFootGains();
-    updateZMPFrame();
+    {
+      ScopedLatencyTimer timer(runStageLatency_[CHECK_GAINS]);
+      checkGains();
+    }
+    {
+      ScopedLatencyTimer timer(runStageLatency_[CHECK_IN_THE_AIR]);
+      checkInTheAir();
+    }
+    {
+      ScopedLatencyTimer timer(runStageLatency_[UPDATE_SUPPORT_FOOT_GAINS]);
+      updateSupportFootGains();
+    }
+    {
+      ScopedLatencyTimer timer(runStageLatency_[UPDATE_SUPPORT_GEOMETRY]);
+      if (!support_.valid)
+      {
+        updateSupportGeometry();
+      }
+    }
+    measuredZMP_ = computeZMP(measuredWrench_);
 
-    sva::ForceVecd desiredWrench = computeDesiredWrench();
-    distributeWrench(desiredWrench);
-    updateCoMAdmittanceControl();
-    updateFootForceDifferenceControl();
+    sva::ForceVecd desiredWrench;
+    {
+      ScopedLatencyTimer timer(runStageLatency_[COMPUTE_DESIRED_WRENCH]);
+      desiredWrench = computeDesiredWrench();
+    }
+    {
+      ScopedLatencyTimer timer(runStageLatency_[DISTRIBUTE_WRENCH]);
+      distributeWrench(desiredWrench);
+    }
+    {
+      ScopedLatencyTimer timer(runStageLatency_[UPDATE_COM_ADMITTANCE_CONTROL]);
+      updateCoMAdmittanceControl();
+    }
+    {
+      ScopedLatencyTimer timer(runStageLatency_[UPDATE_FOOT_FORCE_DIFFERENCE_CONTROL]);
+      updateFootForceDifferenceControl();
+    }
 
     auto endTime = high_resolution_clock::now();
     runTime_ = 1000. * duration_cast<duration<double>>(endTime - startTime).count();
@@ -644,26 +841,31 @@ namespace vhip_walking
     constexpr double MAX_FORCE = 500.; // [N]
     constexpr double MIN_FORCE = 1.; // [N]
 
-    double measuredHeight = measuredCoM_.z() - zmpFrame_.translation().z();
+    double measuredHeight = measuredCoM_.z() - support_.zmpFrame.translation().z();
     lambdaMax_ = MAX_FORCE / (mass_ * measuredHeight);
     lambdaMin_ = MIN_FORCE / (mass_ * measuredHeight);
     double omegaMax = std::sqrt(lambdaMax_);
     double omegaMin = std::sqrt(lambdaMin_);
 
-    constexpr unsigned NB_VARIABLES = 3 + 1 + 2 + 1 + 3;
-    Eigen::MatrixXd A;
-    Eigen::VectorXd b;
-    A.setZero(3, NB_VARIABLES);
+    constexpr unsigned NB_VARIABLES = VHIPWorkspace::NB_VAR;
+    constexpr unsigned NB_ZMP_CONS = VHIPWorkspace::NB_ZMP_CONS;
+    constexpr unsigned NB_CONSTRAINTS = VHIPWorkspace::NB_CONS;
+    auto & A = vhipWorkspace_.A;
+    auto & b = vhipWorkspace_.b;
     A <<
       0., 0., 0., 0., 0., 0., 0., 1., 0., 0.,
       0., 0., 0., 0., 0., 0., 0., 0., 1., 0.,
-      0., 0., 0., 0., 0., 0., 0., 0., 0., std::sqrt(1e-3),
-    b.setZero(3);
+      0., 0., 0., 0., 0., 0., 0., 0., 0., std::sqrt(1e-3);
+    b.setZero();
 
-    unsigned nbConstraints = 3 + 3 + 1 + zmpArea_.first.rows() + 1;
-    Eigen::VectorXd bl, bu;
-    bl.setConstant(NB_VARIABLES + nbConstraints, -1e5);
-    bu.setConstant(NB_VARIABLES + nbConstraints, +1e5);
+    if (support_.zmpArea.first.rows() != NB_ZMP_CONS)
+    {
+      mc_rtc::log::error("ZMP area should have {} rows, not {}", NB_ZMP_CONS, support_.zmpArea.first.rows());
+      return computeLIPDesiredWrench();
+    }
+
+    auto & bl = vhipWorkspace_.bl;
+    auto & bu = vhipWorkspace_.bu;
     auto blVar = bl.head<NB_VARIABLES>();
     auto buVar = bu.head<NB_VARIABLES>();
     blVar <<
@@ -689,72 +891,61 @@ namespace vhip_walking
       +1., // 8: Delta sigma_y [m]
       +1.; // 9: Delta sigma_z [m]
 
-    auto blCons = bl.tail(nbConstraints);
-    auto buCons = bu.tail(nbConstraints);
-    Eigen::MatrixXd C;
-    C.setZero(nbConstraints, NB_VARIABLES);
+    auto blCons = bl.tail<NB_CONSTRAINTS>();
+    auto buCons = bu.tail<NB_CONSTRAINTS>();
+    auto & C = vhipWorkspace_.C;
+    C.setZero();
 
-    const Eigen::Matrix3d R_zmpFrame_0 = zmpFrame_.rotation().transpose();
+    const Eigen::Matrix3d R_zmpFrame_0 = support_.zmpFrame.rotation().transpose();
     const Eigen::Matrix<double, 3, 2> R_Delta_zmp = R_zmpFrame_0.block<3, 2>(0, 0);
 
-    unsigned curRow = 0;
-    unsigned curHeight = 3;
-    C.block(curRow, 0, curHeight, 3) = -vrpGain * Eigen::Matrix3d::Identity();
-    C.block(curRow, 3, curHeight, 1) = (refDCM - refVRP) / refOmega;
-    C.block(curRow, 4, curHeight, 2) = R_Delta_zmp;
-    C.block(curRow, 6, curHeight, 1) = (refZMP - refDCM) / refLambda;
-    C.block(curRow, 7, curHeight, 3) = Eigen::Matrix3d::Identity();
-    blCons.segment(curRow, curHeight).setZero();
-    buCons.segment(curRow, curHeight).setZero();
-
-    curRow += curHeight;
-    curHeight = 3;
-    C.block(curRow, 0, curHeight, 3) = Eigen::Matrix3d::Identity();
-    C.block(curRow, 3, curHeight, 1) = measuredCoMd_ / (refOmega * refOmega);
+    constexpr unsigned DCM_ROW = 0;
+    C.block<3, 3>(DCM_ROW, 0) = -vrpGain * Eigen::Matrix3d::Identity();
+    C.block<3, 1>(DCM_ROW, 3) = (refDCM - refVRP) / refOmega;
+    C.block<3, 2>(DCM_ROW, 4) = R_Delta_zmp;
+    C.block<3, 1>(DCM_ROW, 6) = (refZMP - refDCM) / refLambda;
+    C.block<3, 3>(DCM_ROW, 7) = Eigen::Matrix3d::Identity();
+    blCons.segment<3>(DCM_ROW).setZero();
+    buCons.segment<3>(DCM_ROW).setZero();
+
+    constexpr unsigned OMEGA_DCM_ROW = DCM_ROW + 3;
+    C.block<3, 3>(OMEGA_DCM_ROW, 0) = Eigen::Matrix3d::Identity();
+    C.block<3, 1>(OMEGA_DCM_ROW, 3) = measuredCoMd_ / (refOmega * refOmega);
     Eigen::Vector3d constantOmegaDCM = comError + comdError / refOmega;
-    blCons.segment(curRow, curHeight) = constantOmegaDCM;
-    buCons.segment(curRow, curHeight) = constantOmegaDCM;
+    blCons.segment<3>(OMEGA_DCM_ROW) = constantOmegaDCM;
+    buCons.segment<3>(OMEGA_DCM_ROW) = constantOmegaDCM;
 
-    curRow += curHeight;
-    curHeight = 1;
-    C(curRow, 3) = refOmega * (1 + vrpGain);
-    C(curRow, 6) = -1.;
-    blCons[curRow] = 0.;
-    buCons[curRow] = 0.;
+    constexpr unsigned LAMBDA_ROW = OMEGA_DCM_ROW + 3;
+    C(LAMBDA_ROW, 3) = refOmega * (1 + vrpGain);
+    C(LAMBDA_ROW, 6) = -1.;
+    blCons[LAMBDA_ROW] = 0.;
+    buCons[LAMBDA_ROW] = 0.;
 
-    Eigen::Vector3d refFrameZMP = zmpFrame_.rotation() * (pendulum_.zmp() - zmpFrame_.translation());
+    Eigen::Vector3d refFrameZMP = support_.zmpFrame.rotation() * (pendulum_.zmp() - support_.zmpFrame.translation());
     if (std::abs(refFrameZMP.z()) > 1e-3)
     {
       mc_rtc::log::warning("Reference ZMP does not belong to the ZMP frame");
     }
 
-    curRow += curHeight;
-    curHeight = zmpArea_.first.rows();
-    C.block(curRow, 4, curHeight, 2) = zmpArea_.first;
-    blCons.segment(curRow, curHeight).setConstant(-1e5);
-    buCons.segment(curRow, curHeight) = zmpArea_.second - zmpArea_.first * refFrameZMP;
+    constexpr unsigned ZMP_ROW = LAMBDA_ROW + 1;
+    C.block<NB_ZMP_CONS, 2>(ZMP_ROW, 4) = support_.zmpArea.first;
+    blCons.segment<NB_ZMP_CONS>(ZMP_ROW).setConstant(-1e5);
+    buCons.segment<NB_ZMP_CONS>(ZMP_ROW) = support_.zmpArea.second;
+    buCons.segment<NB_ZMP_CONS>(ZMP_ROW).noalias() -= support_.zmpArea.first * refFrameZMP.head<2>();
 
-    curRow += curHeight;
-    curHeight = 1;
+    constexpr unsigned DCM_HEIGHT_ROW = ZMP_ROW + NB_ZMP_CONS;
     double dcmDamping = 0.5;
     double alpha = (1 + dcmDamping) * refLambda * dt_ / refOmega;
-    C(curRow, 2) = 1 + alpha * (1 - vrpGain);
-    C(curRow, 9) = alpha;
-    blCons[curRow] = MIN_DCM_HEIGHT - refDCM.z();
-    buCons[curRow] = MAX_DCM_HEIGHT - refDCM.z();
-
-    curRow += curHeight;
-    if (curRow != nbConstraints)
-    {
-      mc_rtc::log::error("Invalid number of constraints in VHIP feedback QP");
-    }
-
-    bool solverSuccess = leastSquares_.solve(A, b, C, bl, bu);
-    Eigen::VectorXd Delta_x = leastSquares_.result();
-    if (!solverSuccess)
+    C(DCM_HEIGHT_ROW, 2) = 1 + alpha * (1 - vrpGain);
+    C(DCM_HEIGHT_ROW, 9) = alpha;
+    blCons[DCM_HEIGHT_ROW] = MIN_DCM_HEIGHT - refDCM.z();
+    buCons[DCM_HEIGHT_ROW] = MAX_DCM_HEIGHT - refDCM.z();
+    static_assert(DCM_HEIGHT_ROW + 1 == NB_CONSTRAINTS, "Invalid number of constraints in VHIP feedback QP");
+
+    VHIPVector Delta_x;
+    if (!solveVHIPQP(Delta_x))
     {
       mc_rtc::log::error("VHIP feedback QP failed to run");
-      leastSquares_.print_inform();
       return computeLIPDesiredWrench();
     }
 
@@ -770,6 +961,48 @@ namespace vhip_walking
     return {vhipZMP_.cross(desiredForce), desiredForce};
   }
 
+  void Stabilizer::flushVHIPRecords()
+  {
+    if (vhipRecordPath_.empty() || vhipRecords_.empty())
+    {
+      return;
+    }
+    std::ofstream recordFile(vhipRecordPath_, std::ios::app);
+    for (const VHIPWorkspace & w : vhipRecords_)
+    {
+      writeLeastSquaresRecord(recordFile, w.A, w.b, w.C, w.bl, w.bu);
+    }
+    mc_rtc::log::info("Wrote {} VHIP feedback QPs to {}", vhipRecords_.size(), vhipRecordPath_);
+    if (vhipRecords_.size() == vhipRecords_.capacity())
+    {
+      mc_rtc::log::warning("VHIP feedback QP record was full, later problems were not recorded");
+    }
+    vhipRecords_.clear();
+  }
+
+  bool Stabilizer::solveVHIPQP(VHIPVector & Delta_x)
+  {
+    const VHIPWorkspace & w = vhipWorkspace_;
+    if (!vhipRecordPath_.empty() && vhipRecords_.size() < vhipRecords_.capacity())
+    {
+      vhipRecords_.push_back(w); // preallocated, written by flushVHIPRecords()
+    }
+    if (!vhipQP_.solve(w.A, w.b, w.C, w.bl, w.bu))
+    {
+      return false;
+    }
+    Delta_x = vhipQP_.result();
+    if (compareVHIPSolvers_ && vhipQP_.backend() != QPBackend::LSSOL && vhipReferenceQP_.solve(w.A, w.b, w.C, w.bl, w.bu))
+    {
+      vhipNbComparisons_++;
+      if ((Delta_x - vhipReferenceQP_.result()).cwiseAbs().maxCoeff() < QP_AGREEMENT_TOL)
+      {
+        vhipNbAgreements_++;
+      }
+    }
+    return true;
+  }
+
   void Stabilizer::distributeWrench(const sva::ForceVecd & desiredWrench)
   {
     using namespace std::chrono;
@@ -819,15 +1052,13 @@ namespace vhip_walking
 
     const sva::PTransformd & X_0_lc = leftFootContact.pose;
     const sva::PTransformd & X_0_rc = rightFootContact.pose;
-    sva::PTransformd X_0_lankle = leftFootContact.anklePose();
-    sva::PTransformd X_0_rankle = rightFootContact.anklePose();
 
     constexpr unsigned NB_VAR = 6 + 6;
     constexpr unsigned COST_DIM = 6 + NB_VAR + 1;
-    Eigen::MatrixXd A;
-    Eigen::VectorXd b;
-    A.setZero(COST_DIM, NB_VAR);
-    b.setZero(COST_DIM);
+    Eigen::Matrix<double, COST_DIM, NB_VAR> A;
+    Eigen::Matrix<double, COST_DIM, 1> b;
+    A.setZero();
+    b.setZero();
 
     // |w_l_0 + w_r_0 - desiredWrench|^2
     auto A_net = A.block<6, 12>(0, 0);
@@ -842,14 +1073,14 @@ namespace vhip_walking
     // anisotropic weights:  taux, tauy, tauz,   fx,   fy,   fz;
     A_lankle.diagonal() <<     1.,   1., 1e-4, 1e-3, 1e-3, 1e-4;
     A_rankle.diagonal() <<     1.,   1., 1e-4, 1e-3, 1e-3, 1e-4;
-    A_lankle *= X_0_lankle.dualMatrix();
-    A_rankle *= X_0_rankle.dualMatrix();
+    A_lankle *= support_.leftAnkleDual;
+    A_rankle *= support_.rightAnkleDual;
 
     // |(1 - lfr) * w_l_lc.force().z() - lfr * w_r_rc.force().z()|^2
     double lfr = leftFootRatio_;
     auto A_pressure = A.block<1, 12>(18, 0);
-    A_pressure.block<1, 6>(0, 0) = (1 - lfr) * X_0_lc.dualMatrix().bottomRows<1>();
-    A_pressure.block<1, 6>(0, 6) = -lfr * X_0_rc.dualMatrix().bottomRows<1>();
+    A_pressure.block<1, 6>(0, 0) = (1 - lfr) * support_.leftContactDual.bottomRows<1>();
+    A_pressure.block<1, 6>(0, 6) = -lfr * support_.rightContactDual.bottomRows<1>();
 
     // Apply weights
     A_net *= fdqpWeights_.netWrenchSqrt;
@@ -862,35 +1093,33 @@ namespace vhip_walking
     // b_pressure = 0
 
     constexpr unsigned CONS_DIM = 16 + 16 + 2;
-    Eigen::Matrix<double, CONS_DIM , NB_VAR> C;
-    Eigen::VectorXd bl, bu;
-    C.setZero(CONS_DIM, NB_VAR);
-    bl.setConstant(NB_VAR + CONS_DIM, -1e5);
-    bu.setConstant(NB_VAR + CONS_DIM, +1e5);
+    Eigen::Matrix<double, CONS_DIM, NB_VAR> C;
+    Eigen::Matrix<double, NB_VAR + CONS_DIM, 1> bl, bu;
+    C.setZero();
+    bl.setConstant(-1e5);
+    bu.setConstant(+1e5);
     auto blCons = bl.tail<CONS_DIM>();
     auto buCons = bu.tail<CONS_DIM>();
     // CWC * w_l_lc <= 0
-    C.block<16, 6>(0, 0) = wrenchFaceMatrix_ * X_0_lc.dualMatrix();
+    C.block<16, 6>(0, 0) = support_.leftWrenchCone;
     buCons.segment<16>(0).setZero();
     // CWC * w_r_rc <= 0
-    C.block<16, 6>(16, 6) = wrenchFaceMatrix_ * X_0_rc.dualMatrix();
+    C.block<16, 6>(16, 6) = support_.rightWrenchCone;
     buCons.segment<16>(16).setZero();
     // w_l_lc.force().z() >= MIN_DS_PRESSURE
     // w_r_rc.force().z() >= MIN_DS_PRESSURE
-    C.block<1, 6>(32, 0) = X_0_lc.dualMatrix().bottomRows<1>();
-    C.block<1, 6>(33, 6) = X_0_rc.dualMatrix().bottomRows<1>();
+    C.block<1, 6>(32, 0) = support_.leftContactDual.bottomRows<1>();
+    C.block<1, 6>(33, 6) = support_.rightContactDual.bottomRows<1>();
     blCons.segment<2>(32).setConstant(MIN_DS_PRESSURE);
     buCons.segment<2>(32).setConstant(+1e5);
 
-    //Eigen::MatrixXd A0 = A; // A is modified by solve()
-    //Eigen::VectorXd b0 = b; // b is modified by solve()
-    bool solverSuccess = leastSquares_.solve(A, b, C, bl, bu);
-    Eigen::VectorXd x = leastSquares_.result();
-    if (!solverSuccess)
+    static_assert(CONS_DIM == decltype(dsQP_)::NB_ROWS - NB_VAR, "Invalid number of constraints in DS force distribution QP");
+    if (!dsQP_.solve(A, b, C, bl, bu))
     {
       mc_rtc::log::error("DS force distribution QP failed to run");
       return;
     }
+    const Eigen::Matrix<double, NB_VAR, 1> & x = dsQP_.result();
 
     sva::ForceVecd w_l_0(x.segment<3>(0), x.segment<3>(3));
     sva::ForceVecd w_r_0(x.segment<3>(6), x.segment<3>(9));
@@ -918,31 +1147,50 @@ namespace vhip_walking
     //
     // Objective
     // ---------
-    // weighted minimization of |w_c - X_0_c* desiredWrench|^2
+    // minimization of |w_0 - desiredWrench|^2
     //
     // Constraints
     // -----------
     // F X_0_c* w_0 <= 0    -- contact stability
-
-    const sva::PTransformd & X_0_c = footTask->targetPose();
-
-    Eigen::Matrix6d A = Eigen::Matrix6d::Identity();
-    Eigen::Vector6d b = desiredWrench.vector();
-
-    Eigen::MatrixXd C = wrenchFaceMatrix_ * X_0_c.dualMatrix();
-    Eigen::VectorXd bl, bu;
-    bl.setConstant(NB_VAR + NB_CONS, -1e5);
-    bu.setConstant(NB_VAR + NB_CONS, +1e5);
-    bu.tail<NB_CONS>().setZero();
-
-    //Eigen::MatrixXd A0 = A; // A is modified by solve()
-    //Eigen::VectorXd b0 = b; // b is modified by solve()
-    leastSquares_.solve(A, b, C, bl, bu);
-    Eigen::VectorXd x = leastSquares_.result();
-    if (leastSquares_.inform() != Eigen::lssol::eStatus::STRONG_MINIMUM)
+    //
+    // The explicit solution enumerated in updateConeProjection() is
+    // expressed in the inertial frame of the support contact by a worker
+    // thread after each contact change. The QP is solved until all its
+    // regions are up to date.
+
+    bool isLeftFoot = (footTask == leftFootTask);
+    const sva::PTransformd & X_0_c = (isLeftFoot) ? leftFootContact.pose : rightFootContact.pose;
+    const WrenchFaceMatrix & C = (isLeftFoot) ? support_.leftWrenchCone : support_.rightWrenchCone;
+    const Eigen::Vector6d & b = desiredWrench.vector();
+
+    Eigen::Vector6d x;
+    ssQPBypassed_ = inWrenchCone(C, b);
+    ssSolvedExplicitly_ = false;
+    bool explicitReady = explicitSS_ && coneProjectionValid_ && coneProjection_.ready();
+    if (ssQPBypassed_) // desired wrench is already in the contact wrench cone
     {
-      mc_rtc::log::error("SS force distribution QP failed to run");
-      return;
+      ssNbBypassed_++;
+      x = b;
+    }
+    else if (explicitReady && coneProjection_.project(b, x))
+    {
+      ssNbSolved_++;
+      ssSolvedExplicitly_ = true;
+    }
+    else
+    {
+      Eigen::Matrix6d A = Eigen::Matrix6d::Identity();
+      Eigen::Matrix<double, NB_VAR + NB_CONS, 1> bl, bu;
+      bl.setConstant(-1e5);
+      bu.setConstant(+1e5);
+      bu.tail<NB_CONS>().setZero();
+      if (!ssQP_.solve(A, b, C, bl, bu))
+      {
+        mc_rtc::log::error("SS force distribution QP failed to run");
+        return;
+      }
+      ssNbSolved_++;
+      x = ssQP_.result();
     }
 
     sva::ForceVecd w_0(x.head<3>(), x.tail<3>());
@@ -953,6 +1201,17 @@ namespace vhip_walking
     distribWrench_ = w_0;
   }
 
+  void Stabilizer::updateConeProjection()
+  {
+    coneProjectionValid_ = coneProjection_.build(wrenchFaceMatrix_);
+    if (!coneProjectionValid_)
+    {
+      mc_rtc::log::error("Contact wrench cone is degenerate, explicit SS distribution disabled");
+      return;
+    }
+    mc_rtc::log::info("Explicit SS distribution: {} critical regions", coneProjection_.nbRegions());
+  }
+
   void Stabilizer::updateCoMZMPCC()
   {
     auto distribZMP = computeZMP(distribWrench_);
@@ -965,7 +1224,7 @@ namespace vhip_walking
     }
     else
     {
-      const Eigen::Matrix3d & R_0_c = zmpFrame_.rotation();
+      const Eigen::Matrix3d & R_0_c = support_.zmpFrame.rotation();
       const Eigen::Transpose<const Eigen::Matrix3d> R_c_0 = R_0_c.transpose();
       Eigen::Vector3d comAdmittanceZMP = {comAdmittance_.x(), comAdmittance_.y(), 0.};
       Eigen::Vector3d newVel = -R_c_0 * comAdmittanceZMP.cwiseProduct(R_0_c * zmpccError_);
@@ -979,8 +1238,8 @@ namespace vhip_walking
 
   void Stabilizer::updateCoMAltitude()
   {
-    double measuredHeight = measuredCoM_.z() - zmpFrame_.translation().z();
-    double pendulumHeight = pendulum_.com().z() - zmpFrame_.translation().z();
+    double measuredHeight = measuredCoM_.z() - support_.zmpFrame.translation().z();
+    double pendulumHeight = pendulum_.com().z() - support_.zmpFrame.translation().z();
     distribLambda_ = distribWrench_.force().z() / (mass_ * pendulumHeight);
     measuredLambda_ = measuredWrench_.force().z() / (mass_ * measuredHeight);
     if (model_ == TemplateModel::LinearInvertedPendulum)
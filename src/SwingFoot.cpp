@@ -25,6 +25,9 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <cmath>
+
 #include <mc_rbdyn/rpy_utils.h>
 
 #include <vhip_walking/SwingFoot.h>
@@ -67,9 +70,30 @@ namespace vhip_walking
     pitchAerialChunk2_.reset(0., landingPitch_, aerialDuration / 2);
     pitchLandingChunk_.reset(landingPitch_, 0., landingDuration_);
 
+    if (tablePeriod_ > 0.)
+    {
+      tabulate();
+    }
     updatePose(/* t = */ 0.);
   }
 
+  void SwingFoot::tabulate()
+  {
+    // Last knot is at or after the end of the trajectory, where it stays still
+    unsigned nbKnots = static_cast<unsigned>(std::ceil(duration_ / tablePeriod_ - TABLE_TIME_TOL)) + 1;
+    table_.resize(nbKnots);
+    for (unsigned k = 0; k < nbKnots; k++)
+    {
+      updatePose(k * tablePeriod_);
+      TableKnot & knot = table_[k];
+      knot.accel = accel_;
+      knot.ori = ori_;
+      knot.pitch = pitch_;
+      knot.pos = pos_;
+      knot.vel = vel_;
+    }
+  }
+
   void SwingFoot::addLogEntries(mc_rtc::Logger & logger)
   {
     logger.addLogEntry("swing_foot_accel", [this]() { return accel(); });
@@ -91,7 +115,32 @@ namespace vhip_walking
   void SwingFoot::integrate(double dt)
   {
     playback_ += dt;
-    updatePose(playback_);
+    if (tablePeriod_ > 0.)
+    {
+      updatePoseFromTable(playback_);
+    }
+    else
+    {
+      updatePose(playback_);
+    }
+  }
+
+  void SwingFoot::updatePoseFromTable(double t)
+  {
+    double s = std::max(0., t / tablePeriod_);
+    double k = std::round(s);
+    unsigned lastKnot = static_cast<unsigned>(table_.size()) - 1;
+    if (s < lastKnot && std::abs(s - k) > TABLE_TIME_TOL)
+    {
+      updatePose(t); // between knots, evaluate chunk polynomials
+      return;
+    }
+    const TableKnot & knot = table_[std::min(static_cast<unsigned>(k), lastKnot)];
+    accel_ = knot.accel;
+    ori_ = knot.ori;
+    pitch_ = knot.pitch;
+    pos_ = knot.pos;
+    vel_ = knot.vel;
   }
 
   void SwingFoot::updatePose(double t)
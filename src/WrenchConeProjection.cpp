@@ -0,0 +1,330 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <bitset>
+#include <random>
+
+#include <vhip_walking/LeastSquaresQP.h>
+#include <vhip_walking/WrenchConeProjection.h>
+
+namespace vhip_walking
+{
+  namespace
+  {
+    constexpr unsigned MAX_ACTIVE_FACES = 5;
+    constexpr double RANK_TOL = 1e-9;
+
+    using FaceSubMatrix = Eigen::Matrix<double, Eigen::Dynamic, 6, 0, 6, 6>;
+
+    /** Number of faces selected by a bit mask.
+     *
+     * \param mask Bit mask of faces.
+     *
+     */
+    inline unsigned nbFaces(unsigned mask)
+    {
+      return static_cast<unsigned>(std::bitset<WrenchConeProjection::NB_FACES>(mask).count());
+    }
+
+    /** Stack rows of the face matrix selected by a bit mask.
+     *
+     * \param F Face matrix.
+     *
+     * \param mask Bit mask of selected faces.
+     *
+     * \param F_S Output matrix.
+     *
+     */
+    void selectFaces(const WrenchConeProjection::FaceMatrix & F, unsigned mask, FaceSubMatrix & F_S)
+    {
+      F_S.resize(nbFaces(mask), 6);
+      unsigned row = 0;
+      for (unsigned i = 0; i < WrenchConeProjection::NB_FACES; i++)
+      {
+        if (mask & (1u << i))
+        {
+          F_S.row(row++) = F.row(i);
+        }
+      }
+    }
+
+    /** Check whether selected faces are linearly independent.
+     *
+     * \param F_S Selected faces.
+     *
+     */
+    bool isFullRank(const FaceSubMatrix & F_S)
+    {
+      if (F_S.rows() == 0)
+      {
+        return true;
+      }
+      Eigen::FullPivLU<FaceSubMatrix> lu(F_S);
+      lu.setThreshold(RANK_TOL);
+      return (lu.rank() == F_S.rows());
+    }
+
+    /** Extreme ray of a cone where five faces meet.
+     *
+     * \param F Face matrix.
+     *
+     * \param F_S Five selected faces, of full row rank.
+     *
+     * \param ray Output unit ray.
+     *
+     * \returns isRay True if the ray lies in the cone.
+     *
+     */
+    bool extremeRay(const WrenchConeProjection::FaceMatrix & F, const FaceSubMatrix & F_S, Eigen::Vector6d & ray)
+    {
+      Eigen::FullPivLU<FaceSubMatrix> lu(F_S);
+      ray = lu.kernel().col(0).normalized();
+      if ((F * ray).maxCoeff() > RANK_TOL)
+      {
+        ray *= -1.;
+      }
+      return ((F * ray).maxCoeff() <= RANK_TOL);
+    }
+  }
+
+  bool WrenchConeProjection::build(const FaceMatrix & faceMatrix)
+  {
+    faceMatrix_ = faceMatrix;
+    lastRegion_ = -1;
+    nbUpdatedRegions_ = 0;
+    regions_.clear();
+    rayMasks_.clear();
+
+    // Interior test of a cone H w <= 0: find w such that H w <= -1 row-wise
+    ActiveSetLeastSquares<6, NB_FACES> interiorLS;
+    const Eigen::Matrix6d A = Eigen::Matrix6d::Identity();
+    const Eigen::Vector6d b = Eigen::Vector6d::Zero();
+    Eigen::Matrix<double, 6 + NB_FACES, 1> bl, bu;
+    bl.setConstant(-1e5);
+
+    std::vector<unsigned> masks;
+    for (unsigned mask = 0; mask < (1u << NB_FACES); mask++)
+    {
+      if (nbFaces(mask) <= MAX_ACTIVE_FACES)
+      {
+        masks.push_back(mask);
+      }
+    }
+    std::stable_sort(masks.begin(), masks.end(),
+      [](unsigned a, unsigned b) { return nbFaces(a) < nbFaces(b); });
+
+    FaceSubMatrix F_S;
+    CriticalRegion region;
+    for (unsigned mask : masks)
+    {
+      selectFaces(faceMatrix_, mask, F_S);
+      if (!isFullRank(F_S))
+      {
+        continue;
+      }
+      computeRegion(mask, region);
+      bu.setConstant(+1e5);
+      for (unsigned i = 0; i < NB_FACES; i++)
+      {
+        bu(6 + i) = region.H.row(i).isZero() ? 0. : -1.;
+      }
+      interiorLS.resetActiveSet();
+      if (interiorLS.solve(A, b, region.H, bl, bu))
+      {
+        regions_.push_back(region);
+      }
+    }
+
+    // Apex region where all faces are active: w_d in the polar cone, i.e.
+    // r^T w_d <= 0 for all extreme rays r of the wrench cone
+    Eigen::Vector6d ray;
+    std::vector<Eigen::Vector6d, Eigen::aligned_allocator<Eigen::Vector6d>> rays;
+    for (unsigned mask : masks)
+    {
+      if (nbFaces(mask) != 5)
+      {
+        continue;
+      }
+      selectFaces(faceMatrix_, mask, F_S);
+      if (!isFullRank(F_S) || !extremeRay(faceMatrix_, F_S, ray))
+      {
+        continue;
+      }
+      bool isNewRay = true;
+      for (const auto & otherRay : rays)
+      {
+        isNewRay = isNewRay && ((otherRay - ray).norm() > RANK_TOL);
+      }
+      if (isNewRay)
+      {
+        if (rays.size() >= NB_FACES)
+        {
+          regions_.clear();
+          rayMasks_.clear();
+          return false; // more extreme rays than faces
+        }
+        rays.push_back(ray);
+        rayMasks_.push_back(mask);
+      }
+    }
+    computeApexRegion(region);
+    regions_.push_back(region);
+    nbUpdatedRegions_ = regions_.size();
+    return true;
+  }
+
+  void WrenchConeProjection::update(const FaceMatrix & faceMatrix)
+  {
+    faceMatrix_ = faceMatrix;
+    nbUpdatedRegions_ = 0;
+  }
+
+  bool WrenchConeProjection::continueUpdate(unsigned nbRegions)
+  {
+    size_t end = std::min(nbUpdatedRegions_ + nbRegions, regions_.size());
+    for (; nbUpdatedRegions_ < end; nbUpdatedRegions_++)
+    {
+      CriticalRegion & region = regions_[nbUpdatedRegions_];
+      if (region.mask == APEX_MASK)
+      {
+        computeApexRegion(region);
+      }
+      else
+      {
+        computeRegion(region.mask, region);
+      }
+    }
+    return (nbUpdatedRegions_ == regions_.size());
+  }
+
+  void WrenchConeProjection::computeApexRegion(CriticalRegion & region) const
+  {
+    FaceSubMatrix F_S;
+    Eigen::Vector6d ray;
+    region.H.setZero();
+    region.P.setZero();
+    region.mask = APEX_MASK;
+    for (unsigned j = 0; j < rayMasks_.size(); j++)
+    {
+      selectFaces(faceMatrix_, rayMasks_[j], F_S);
+      extremeRay(faceMatrix_, F_S, ray);
+      region.H.row(j) = ray.transpose();
+    }
+  }
+
+  void WrenchConeProjection::computeRegion(unsigned mask, CriticalRegion & region) const
+  {
+    FaceSubMatrix F_S;
+    FaceSubMatrix L; // multipliers are L w_d
+    selectFaces(faceMatrix_, mask, F_S);
+    region.mask = mask;
+    region.P.setIdentity();
+    if (F_S.rows() > 0)
+    {
+      L = (F_S * F_S.transpose()).llt().solve(F_S);
+      region.P.noalias() -= F_S.transpose() * L;
+    }
+    region.H.noalias() = faceMatrix_ * region.P;
+    unsigned activeRow = 0;
+    for (unsigned i = 0; i < NB_FACES; i++)
+    {
+      if (mask & (1u << i))
+      {
+        region.H.row(i) = -L.row(activeRow++);
+      }
+      double norm = region.H.row(i).norm();
+      if (norm > RANK_TOL)
+      {
+        region.H.row(i) /= norm;
+      }
+      else // 0 <= 0
+      {
+        region.H.row(i).setZero();
+      }
+    }
+  }
+
+  unsigned WrenchConeProjection::checkAgainstQP(unsigned nbSamples)
+  {
+    LeastSquaresQP<6, NB_FACES> qp; // LSSOL backend
+    const Eigen::Matrix6d A = Eigen::Matrix6d::Identity();
+    Eigen::Matrix<double, 6 + NB_FACES, 1> bl, bu;
+    bl.setConstant(-1e5);
+    bu.setConstant(+1e5);
+    bu.tail<NB_FACES>().setZero();
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> unit(-1., 1.);
+    Eigen::Vector6d scale;
+    scale << 100., 100., 100., 1000., 1000., 1000.; // [N.m], [N]
+    unsigned nbMismatches = 0;
+    Eigen::Vector6d w_d, w;
+    for (unsigned i = 0; i < nbSamples; i++)
+    {
+      for (unsigned j = 0; j < 6; j++)
+      {
+        w_d(j) = scale(j) * unit(generator);
+      }
+      if (!project(w_d, w) || !qp.solve(A, w_d, faceMatrix_, bl, bu))
+      {
+        nbMismatches++;
+        continue;
+      }
+      if ((w - qp.result()).norm() > 1e-6 * (1. + w_d.norm()))
+      {
+        nbMismatches++;
+      }
+    }
+    lastRegion_ = -1;
+    return nbMismatches;
+  }
+
+  bool WrenchConeProjection::project(const Eigen::Vector6d & desiredWrench, Eigen::Vector6d & wrench)
+  {
+    if (nbUpdatedRegions_ < regions_.size())
+    {
+      return false;
+    }
+    if (lastRegion_ >= 0 && inRegion(lastRegion_, desiredWrench))
+    {
+      wrench.noalias() = regions_[lastRegion_].P * desiredWrench;
+      return true;
+    }
+    for (unsigned i = 0; i < regions_.size(); i++)
+    {
+      if (inRegion(i, desiredWrench))
+      {
+        lastRegion_ = i;
+        wrench.noalias() = regions_[i].P * desiredWrench;
+        return true;
+      }
+    }
+    lastRegion_ = -1;
+    return false;
+  }
+}
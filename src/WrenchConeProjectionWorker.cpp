@@ -0,0 +1,120 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <vhip_walking/WrenchConeProjectionWorker.h>
+
+namespace vhip_walking
+{
+  WrenchConeProjectionWorker::WrenchConeProjectionWorker()
+    : thread_([this]() { run(); })
+  {
+  }
+
+  WrenchConeProjectionWorker::~WrenchConeProjectionWorker()
+  {
+    {
+      std::lock_guard<std::mutex> lock(wakeUpMutex_);
+      stop_ = true;
+    }
+    wakeUp_.notify_one();
+    thread_.join();
+  }
+
+  bool WrenchConeProjectionWorker::build(const FaceMatrix & faceMatrix)
+  {
+    while (status_.load(std::memory_order_acquire) == Status::Requested)
+    {
+      std::this_thread::yield();
+    }
+    status_.store(Status::Idle, std::memory_order_release); // discard a finished update
+    WrenchConeProjection & front = projections_[front_];
+    bool success = front.build(faceMatrix);
+    projections_[1 - front_] = front;
+    faceMatrix_ = faceMatrix;
+    pending_ = false;
+    upToDate_ = success;
+    return success;
+  }
+
+  void WrenchConeProjectionWorker::update(const FaceMatrix & faceMatrix)
+  {
+    faceMatrix_ = faceMatrix;
+    pending_ = true;
+    upToDate_ = false;
+    ready();
+  }
+
+  bool WrenchConeProjectionWorker::ready()
+  {
+    if (status_.load(std::memory_order_acquire) == Status::Done)
+    {
+      front_ = 1 - front_;
+      upToDate_ = !pending_;
+      status_.store(Status::Idle, std::memory_order_release);
+    }
+    if (pending_ && status_.load(std::memory_order_acquire) == Status::Idle)
+    {
+      projections_[1 - front_].update(faceMatrix_);
+      pending_ = false;
+      {
+        // Held only while the worker checks for a request, so that the
+        // notification cannot fall between its check and its wait
+        std::lock_guard<std::mutex> lock(wakeUpMutex_);
+        status_.store(Status::Requested, std::memory_order_release);
+      }
+      wakeUp_.notify_one();
+    }
+    return upToDate_;
+  }
+
+  bool WrenchConeProjectionWorker::project(const Eigen::Vector6d & desiredWrench, Eigen::Vector6d & wrench)
+  {
+    return upToDate_ && projections_[front_].project(desiredWrench, wrench);
+  }
+
+  void WrenchConeProjectionWorker::run()
+  {
+    while (!stop_)
+    {
+      {
+        std::unique_lock<std::mutex> lock(wakeUpMutex_);
+        wakeUp_.wait(lock,
+          [this]()
+          {
+            return stop_ || status_.load(std::memory_order_acquire) == Status::Requested;
+          });
+      }
+      if (status_.load(std::memory_order_acquire) != Status::Requested)
+      {
+        continue;
+      }
+      WrenchConeProjection & back = projections_[1 - front_];
+      back.continueUpdate(back.nbRegions());
+      status_.store(Status::Done, std::memory_order_release);
+    }
+  }
+}
@@ -82,7 +82,7 @@ namespace vhip_walking
         [this]() { return plan.singleSupportDuration(); },
         [this](double duration)
         {
-          constexpr double T = ModelPredictiveControl::SAMPLING_PERIOD;
+          const double T = PREVIEW_UPDATE_PERIOD;
           duration = std::round(duration / T) * T;
           plan.singleSupportDuration(duration);
         }),
@@ -91,7 +91,7 @@ namespace vhip_walking
         [this]() { return plan.doubleSupportDuration(); },
         [this](double duration)
         {
-          constexpr double T = ModelPredictiveControl::SAMPLING_PERIOD;
+          const double T = PREVIEW_UPDATE_PERIOD;
           duration = std::round(duration / T) * T;
           plan.doubleSupportDuration(duration);
         }),
@@ -81,6 +81,7 @@ namespace vhip_walking
       ctl.pauseWalking = false;
     }
 
+    ctl.discardPreviewUpdate(); // posted by SingleSupport, superseded by the update at transition
     runState(); // don't wait till next cycle to update reference and tasks
   }
 
@@ -103,10 +104,28 @@ namespace vhip_walking
     auto & ctl = controller();
     double dt = ctl.timeStep;
 
-    if (remTime_ > 0 && timeSinceLastPreviewUpdate_ > PREVIEW_UPDATE_PERIOD &&
-        !(stopDuringThisDSP_ && remTime_ < PREVIEW_UPDATE_PERIOD))
+    switch (ctl.pickUpPreviewUpdate())
     {
-      updatePreview();
+      case PreviewUpdate::Success:
+        timeSinceLastPreviewUpdate_ = 0.;
+        break;
+      case PreviewUpdate::Failure:
+        onPreviewFailure();
+        break;
+      case PreviewUpdate::None:
+        break;
+    }
+    if (stateTime_ <= 0. && needsPreviewUpdate()) // solve inline at transition
+    {
+      setMPCProblem();
+      if (ctl.updatePreview())
+      {
+        timeSinceLastPreviewUpdate_ = 0.;
+      }
+      else
+      {
+        onPreviewFailure();
+      }
     }
 
     double x = clamp(remTime_ / duration_, 0., 1.);
@@ -120,6 +139,11 @@ namespace vhip_walking
     remTime_ -= dt;
     stateTime_ += dt;
     timeSinceLastPreviewUpdate_ += dt;
+    if (needsPreviewUpdate())
+    {
+      setMPCProblem();
+      ctl.postPreviewUpdate(); // solved for the next cycle
+    }
   }
 
   bool states::DoubleSupport::checkTransitions()
@@ -142,7 +166,19 @@ namespace vhip_walking
     return false;
   }
 
-  void states::DoubleSupport::updatePreview()
+  bool states::DoubleSupport::needsPreviewUpdate() const
+  {
+    return remTime_ > 0 && timeSinceLastPreviewUpdate_ > PREVIEW_UPDATE_PERIOD &&
+      !(stopDuringThisDSP_ && remTime_ < PREVIEW_UPDATE_PERIOD);
+  }
+
+  void states::DoubleSupport::onPreviewFailure()
+  {
+    mc_rtc::log::warning("No capture trajectory, resuming walking");
+    stopDuringThisDSP_ = false;
+  }
+
+  void states::DoubleSupport::setMPCProblem()
   {
     auto & ctl = controller();
     ctl.mpc().contacts(ctl.prevContact(), ctl.supportContact(), ctl.targetContact());
@@ -154,15 +190,6 @@ namespace vhip_walking
     {
       ctl.mpc().phaseDurations(0., remTime_, ctl.singleSupportDuration());
     }
-    if (ctl.updatePreview())
-    {
-      timeSinceLastPreviewUpdate_ = 0.;
-    }
-    else
-    {
-      mc_rtc::log::warning("No capture trajectory, resuming walking");
-      stopDuringThisDSP_ = false;
-    }
   }
 }
 
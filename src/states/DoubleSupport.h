@@ -62,10 +62,20 @@ namespace vhip_walking
        */
       void runState() override;
 
-      /** Update horizontal MPC preview.
+      /** Is it time to update the horizontal MPC preview?
        *
        */
-      void updatePreview();
+      bool needsPreviewUpdate() const;
+
+      /** Resume walking when there is no capture trajectory.
+       *
+       */
+      void onPreviewFailure();
+
+      /** Set horizontal MPC problem for the current state.
+       *
+       */
+      void setMPCProblem();
 
     private:
       bool stopDuringThisDSP_;
@@ -37,6 +37,7 @@ namespace vhip_walking
 
     earlyDoubleSupportDuration_ = 0.;
     duration_ = ctl.singleSupportDuration();
+    hasPostedBranches_ = false;
     hasUpdatedMPCOnce_ = false;
     remTime_ = ctl.singleSupportDuration();
     stateTime_ = 0.;
@@ -62,6 +63,7 @@ namespace vhip_walking
     swingFoot_.takeoffDuration(ctl.plan.takeoffDuration());
     swingFoot_.takeoffOffset(ctl.plan.takeoffOffset());
     swingFoot_.takeoffPitch(ctl.plan.takeoffPitch());
+    swingFoot_.tablePeriod(ctl.tabulateSwingFoot ? ctl.timeStep : 0.);
     swingFoot_.reset(
         swingFootTask->surfacePose(), targetContact.pose,
         duration_, ctl.plan.swingHeight());
@@ -114,9 +116,10 @@ namespace vhip_walking
     double dt = ctl.timeStep;
 
     updateSwingFoot();
-    if (timeSinceLastPreviewUpdate_ > PREVIEW_UPDATE_PERIOD)
+    if (ctl.pickUpPreviewUpdate() == PreviewUpdate::Success)
     {
-      updatePreview();
+      timeSinceLastPreviewUpdate_ = 0.;
+      hasUpdatedMPCOnce_ = true;
     }
 
     ctl.preview->integrate(pendulum(), dt);
@@ -134,6 +137,16 @@ namespace vhip_walking
     remTime_ -= dt;
     stateTime_ += dt;
     timeSinceLastPreviewUpdate_ += dt;
+    if (remTime_ > 0. && timeSinceLastPreviewUpdate_ > PREVIEW_UPDATE_PERIOD)
+    {
+      setMPCProblem();
+      ctl.postPreviewUpdate(); // solved for the next cycle
+    }
+    else if (!hasPostedBranches_ && remTime_ >= 0. && timeSinceLastPreviewUpdate_ + remTime_ <= PREVIEW_UPDATE_PERIOD)
+    {
+      // no preview update in flight nor to come before the transition
+      hasPostedBranches_ = postTransitionBranches();
+    }
   }
 
   void states::SingleSupport::updateSwingFoot()
@@ -162,7 +175,37 @@ namespace vhip_walking
     }
   }
 
-  void states::SingleSupport::updatePreview()
+  bool states::SingleSupport::postTransitionBranches()
+  {
+    auto & ctl = controller();
+    double dt = ctl.timeStep;
+
+    Pendulum state = pendulum();
+    unsigned nbSteps = 0;
+    for (double t = remTime_; t >= 0.; t -= dt) // same cycles as runState() until checkTransitions()
+    {
+      nbSteps++;
+    }
+    ctl.preview->predict(state, dt, nbSteps);
+    if (hasUpdatedMPCOnce_) // height resets are projections, so a single one at the end is enough
+    {
+      state.resetCoMHeight(ctl.plan.comHeight(), ctl.supportContact());
+    }
+
+    // Contacts after FootstepPlan::goToNextFootstep(), see DoubleSupport::setMPCProblem()
+    double dspDuration = ctl.nextDoubleSupportDuration();
+    ctl.mpc().contacts(ctl.supportContact(), ctl.targetContact(), ctl.nextContact());
+    ctl.mpc().phaseDurations(0., dspDuration, 0.);
+    bool posted = ctl.postPreviewBranch(PreviewBranch::PauseWalking, state);
+    if (!ctl.isLastSSP())
+    {
+      ctl.mpc().phaseDurations(0., dspDuration, ctl.singleSupportDuration());
+      posted = ctl.postPreviewBranch(PreviewBranch::ContinueWalking, state) && posted;
+    }
+    return posted;
+  }
+
+  void states::SingleSupport::setMPCProblem()
   {
     auto & ctl = controller();
     ctl.mpc().contacts(ctl.supportContact(), ctl.targetContact(), ctl.nextContact());
@@ -175,11 +218,6 @@ namespace vhip_walking
     {
       ctl.mpc().phaseDurations(remTime_, ctl.doubleSupportDuration(), ctl.singleSupportDuration());
     }
-    if (ctl.updatePreview())
-    {
-      timeSinceLastPreviewUpdate_ = 0.;
-      hasUpdatedMPCOnce_ = true;
-    }
   }
 }
 
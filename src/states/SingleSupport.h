@@ -68,13 +68,22 @@ namespace vhip_walking
        */
       void updateSwingFoot();
 
-      /** Update horizontal MPC preview.
+      /** Set horizontal MPC problem for the current state.
        *
        */
-      void updatePreview();
+      void setMPCProblem();
+
+      /** Post MPC problems of the transition to DoubleSupport, with and
+       * without pause, for the pendulum state predicted at transition time.
+       *
+       * \returns posted False if a branch worker was busy.
+       *
+       */
+      bool postTransitionBranches();
 
     private:
       SwingFoot swingFoot_;
+      bool hasPostedBranches_;
       bool hasUpdatedMPCOnce_;
       double duration_;
       double earlyDoubleSupportDuration_;
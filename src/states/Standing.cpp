@@ -47,6 +47,7 @@ namespace vhip_walking
     leftFootRatio_ = ctl.leftFootRatio();
     releaseHeight_ = 0.05; // [m]
     startWalking_ = false;
+    timeSinceLastBranchPost_ = 2 * PREVIEW_UPDATE_PERIOD; // post at first cycle
     if (supportContact.surfaceName == "RightFootCenter")
     {
       leftFootContact_ = targetContact;
@@ -94,9 +95,10 @@ namespace vhip_walking
         ComboInput("Footstep plan",
           ctl.availablePlans(),
           [&ctl]() { return ctl.plan.name; },
-          [&ctl](const std::string & name)
+          [this, &ctl](const std::string & name)
           {
             ctl.loadFootstepPlan(name);
+            timeSinceLastBranchPost_ = 2 * PREVIEW_UPDATE_PERIOD; // post for the new plan
           }));
       gui()->addElement(
         {"Walking", "Controller"},
@@ -220,6 +222,20 @@ namespace vhip_walking
     pendulum.integrateIPM(zmp, lambda, ctl.timeStep);
     ctl.leftFootRatio(leftFootRatio_);
     ctl.stabilizer().run();
+
+    // Post at the preview update rate rather than every cycle, so that a
+    // standing robot does not keep the branch worker busy
+    timeSinceLastBranchPost_ += ctl.timeStep;
+    if (!isMakingFootContact_ && !ctl.isLastSSP() && timeSinceLastBranchPost_ > PREVIEW_UPDATE_PERIOD)
+    {
+      // Same problem as in checkTransitions(), for the state at next cycle
+      ctl.mpc().contacts(ctl.supportContact(), ctl.targetContact(), ctl.nextContact());
+      ctl.mpc().phaseDurations(0., ctl.plan.initDSPDuration(), ctl.singleSupportDuration());
+      if (ctl.postPreviewBranch(PreviewBranch::StartWalking, pendulum))
+      {
+        timeSinceLastBranchPost_ = 0.;
+      }
+    }
   }
 
   void states::Standing::updateTarget(double leftFootRatio)
@@ -132,6 +132,7 @@ namespace vhip_walking
       double freeFootGain_;
       double leftFootRatio_;
       double releaseHeight_;
+      double timeSinceLastBranchPost_;
       unsigned nbDistribFail_;
     };
   }
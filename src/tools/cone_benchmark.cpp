@@ -0,0 +1,110 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Microbenchmark of contact wrench cone kernels.
+ *
+ * Usage: vhip_walking_controller_cone_benchmark [NB_ITERATIONS]
+ *
+ * Compares the kernels from <vhip_walking/utils/cones.h> with generic Eigen
+ * products on fixed-size and dynamic-size matrices, on random but fixed data.
+ *
+ */
+
+#include <chrono>
+#include <string>
+
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/utils/cones.h>
+
+namespace
+{
+  /** Average duration of a function call in [ns].
+   *
+   * \param nbIterations Number of calls.
+   *
+   * \param f Function called with the iteration index.
+   *
+   */
+  template<typename Function>
+  double benchmark(unsigned nbIterations, Function f)
+  {
+    using namespace std::chrono;
+    auto startTime = high_resolution_clock::now();
+    for (unsigned i = 0; i < nbIterations; i++)
+    {
+      f(i);
+    }
+    auto endTime = high_resolution_clock::now();
+    return 1e9 * duration_cast<duration<double>>(endTime - startTime).count() / nbIterations;
+  }
+
+  /** Keep the compiler from optimizing a result away.
+   *
+   */
+  template<typename T>
+  inline void doNotOptimize(const T & value)
+  {
+    asm volatile("" : : "g"(&value) : "memory");
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  unsigned nbIterations = (argc > 1) ? static_cast<unsigned>(std::stoul(argv[1])) : 1000000;
+
+  WrenchFaceMatrix F = WrenchFaceMatrix::Random();
+  Eigen::Matrix6d X = Eigen::Matrix6d::Random();
+  Eigen::Vector6d w = Eigen::Vector6d::Random();
+  WrenchFaceMatrix out;
+  Eigen::MatrixXd dynamicF = F;
+  Eigen::MatrixXd dynamicX = X;
+  Eigen::MatrixXd dynamicOut;
+  Eigen::VectorXd dynamicW = w;
+
+  mc_rtc::log::info("Eigen SIMD instruction sets: {}", Eigen::SimdInstructionSetsInUse());
+
+  double dynamicTime = benchmark(nbIterations, [&](unsigned) { dynamicOut.noalias() = dynamicF * dynamicX; doNotOptimize(dynamicOut); });
+  double fixedTime = benchmark(nbIterations, [&](unsigned) { out.noalias() = F * X; doNotOptimize(out); });
+  double kernelTime = benchmark(nbIterations, [&](unsigned) { transformWrenchCone(F, X, out); doNotOptimize(out); });
+  mc_rtc::log::info("Cone transform: {:.1f} ns (dynamic), {:.1f} ns (fixed), {:.1f} ns (kernel)", dynamicTime, fixedTime, kernelTime);
+
+  double margin = 0.;
+  dynamicTime = benchmark(nbIterations, [&](unsigned) { margin = -(dynamicF * dynamicW).maxCoeff(); doNotOptimize(margin); });
+  fixedTime = benchmark(nbIterations, [&](unsigned) { margin = -(F * w).maxCoeff(); doNotOptimize(margin); });
+  kernelTime = benchmark(nbIterations, [&](unsigned) { margin = wrenchConeMargin(F, w); doNotOptimize(margin); });
+  mc_rtc::log::info("Cone margin: {:.1f} ns (dynamic), {:.1f} ns (fixed), {:.1f} ns (kernel)", dynamicTime, fixedTime, kernelTime);
+
+  transformWrenchCone(F, X, out);
+  double error = (out - F * X).norm() + std::abs(wrenchConeMargin(F, w) + (F * w).maxCoeff());
+  if (error > 1e-12)
+  {
+    mc_rtc::log::error("Kernels disagree with Eigen products (error: {})", error);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,270 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Count heap allocations in ModelPredictiveControl::solve().
+ *
+ * Usage: vhip_walking_controller_mpc_allocations [NB_SOLVES]
+ *
+ * Solves a walking sequence of MPC problems, from the beginning of a single
+ * support phase to the end of the following double support phase, with
+ * the Riccati formulation on all instantiated horizons and with the
+ * condensed formulation and active-set backend on those up to
+ * ModelPredictiveControlBase::MAX_CONDENSED_STEPS. The first solves are
+ * warm-up: allocations in them are reported but not counted as failures.
+ * After warm-up, solve() should not allocate at all, otherwise the tool
+ * returns 1. It runs as the mpc_allocations test.
+ *
+ * Allocations are counted as in the stabilizer_allocations tool, by
+ * replacing the global operator new and, with glibc, malloc, calloc and
+ * realloc.
+ *
+ */
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/ModelPredictiveControl.h>
+
+namespace
+{
+  std::atomic<bool> countAllocations{false};
+  std::atomic<unsigned> nbAllocations{0};
+
+  inline void recordAllocation()
+  {
+    if (countAllocations.load(std::memory_order_relaxed))
+    {
+      nbAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void * allocate(std::size_t size)
+  {
+#ifndef __GLIBC__
+    recordAllocation(); // otherwise counted by malloc() below
+#endif
+    void * ptr = std::malloc(size > 0 ? size : 1);
+    if (ptr == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    return ptr;
+  }
+}
+
+void * operator new(std::size_t size)
+{
+  return allocate(size);
+}
+
+void * operator new[](std::size_t size)
+{
+  return allocate(size);
+}
+
+void operator delete(void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+#ifdef __GLIBC__
+extern "C"
+{
+  void * __libc_malloc(std::size_t size);
+  void * __libc_calloc(std::size_t nmemb, std::size_t size);
+  void * __libc_realloc(void * ptr, std::size_t size);
+
+  void * malloc(std::size_t size)
+  {
+    recordAllocation();
+    return __libc_malloc(size);
+  }
+
+  void * calloc(std::size_t nmemb, std::size_t size)
+  {
+    recordAllocation();
+    return __libc_calloc(nmemb, size);
+  }
+
+  void * realloc(void * ptr, std::size_t size)
+  {
+    recordAllocation();
+    return __libc_realloc(ptr, size);
+  }
+}
+#endif
+
+namespace
+{
+  using namespace vhip_walking;
+
+  constexpr double COM_HEIGHT = 0.8; // [m]
+  constexpr double DSP_DURATION = 0.1; // [s]
+  constexpr double SSP_DURATION = 0.7; // [s]
+  constexpr double STEP_LENGTH = 0.2; // [m]
+  constexpr double STEP_WIDTH = 0.18; // [m]
+  constexpr double WALKING_SPEED = STEP_LENGTH / (SSP_DURATION + DSP_DURATION); // [m] / [s]
+  constexpr unsigned NB_WARMUP_SOLVES = 10;
+
+  /** Foot contact at a given position along the walking sequence.
+   *
+   * \param stepIndex Step index, even for left and odd for right foot.
+   *
+   */
+  Contact footContact(unsigned stepIndex)
+  {
+    double y = (stepIndex % 2 == 0) ? STEP_WIDTH / 2 : -STEP_WIDTH / 2;
+    Contact contact(sva::PTransformd(Eigen::Vector3d{stepIndex * STEP_LENGTH, y, 0.}));
+    contact.halfLength = 0.112;
+    contact.halfWidth = 0.065;
+    contact.refVel = {WALKING_SPEED, 0., 0.};
+    contact.surfaceName = (stepIndex % 2 == 0) ? "LeftFootCenter" : "RightFootCenter";
+    return contact;
+  }
+
+  /** Solve the walking sequence and count allocations in solve().
+   *
+   * \param mpc Problem with formulation already set.
+   *
+   * \param label Label of the formulation in reports.
+   *
+   * \param nbSolves Number of problems to solve, including warm-up.
+   *
+   * \returns nbSteadyAllocations Number of allocations after warm-up.
+   *
+   */
+  template <unsigned NB_STEPS>
+  unsigned runSequence(ModelPredictiveControl<NB_STEPS> & mpc, const std::string & label, unsigned nbSolves)
+  {
+    const double T = ModelPredictiveControlBase::SAMPLING_PERIOD;
+    const unsigned nbSSPSteps = static_cast<unsigned>(std::round(SSP_DURATION / T));
+    const unsigned nbDSPSteps = static_cast<unsigned>(std::round(DSP_DURATION / T));
+    mpc.comHeight(COM_HEIGHT);
+    mpc.contacts(footContact(0), footContact(1), footContact(2));
+
+    unsigned nbWarmupAllocations = 0;
+    unsigned nbSteadyAllocations = 0;
+    for (unsigned i = 0; i < nbSolves; i++)
+    {
+      unsigned step = i % (nbSSPSteps + nbDSPSteps);
+      Pendulum pendulum;
+      pendulum.reset(Eigen::Vector3d{0.01 * (i % 5), STEP_WIDTH / 2 - 0.02 * (i % 3), COM_HEIGHT});
+      mpc.initState(pendulum);
+      if (step < nbSSPSteps)
+      {
+        mpc.phaseDurations((nbSSPSteps - step) * T, DSP_DURATION, SSP_DURATION);
+      }
+      else // during double support
+      {
+        mpc.phaseDurations(0., (nbSSPSteps + nbDSPSteps - step) * T, SSP_DURATION);
+      }
+
+      nbAllocations = 0;
+      countAllocations = true;
+      mpc.solve();
+      countAllocations = false;
+      if (i < NB_WARMUP_SOLVES)
+      {
+        nbWarmupAllocations += nbAllocations;
+      }
+      else
+      {
+        nbSteadyAllocations += nbAllocations;
+      }
+    }
+
+    if (nbSteadyAllocations > 0)
+    {
+      mc_rtc::log::error("{} x {} steps: {} allocations in {} steady-state solves ({} in warm-up)", label, NB_STEPS, nbSteadyAllocations, nbSolves - NB_WARMUP_SOLVES, nbWarmupAllocations);
+    }
+    else
+    {
+      mc_rtc::log::success("{} x {} steps: no allocation in {} steady-state solves ({} in warm-up)", label, NB_STEPS, nbSolves - NB_WARMUP_SOLVES, nbWarmupAllocations);
+    }
+    return nbSteadyAllocations;
+  }
+
+  /** Count allocations in all allocation-free formulations of a horizon.
+   *
+   * \tparam NB_STEPS Number of sampling steps.
+   *
+   * \param nbSolves Number of problems to solve per formulation.
+   *
+   */
+  template <unsigned NB_STEPS>
+  unsigned checkHorizon(unsigned nbSolves)
+  {
+    using MPC = ModelPredictiveControl<NB_STEPS>;
+    unsigned nbSteadyAllocations = 0;
+    MPC mpc;
+    if constexpr (MPC::HAS_CONDENSED)
+    {
+      mpc.formulation(MPC::Formulation::Condensed);
+      mpc.qpBackend(QPBackend::ActiveSet);
+      nbSteadyAllocations += runSequence(mpc, "Condensed", nbSolves);
+    }
+    mpc.formulation(MPC::Formulation::Riccati);
+    nbSteadyAllocations += runSequence(mpc, "Riccati", nbSolves);
+    return nbSteadyAllocations;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  const unsigned nbSolves = (argc > 1) ? static_cast<unsigned>(std::stoul(argv[1])) : 200;
+  if (nbSolves <= NB_WARMUP_SOLVES)
+  {
+    mc_rtc::log::error("Number of solves should be larger than {}", NB_WARMUP_SOLVES);
+    return 2;
+  }
+
+  unsigned nbSteadyAllocations = 0;
+  nbSteadyAllocations += checkHorizon<16>(nbSolves);
+  nbSteadyAllocations += checkHorizon<32>(nbSolves);
+  nbSteadyAllocations += checkHorizon<64>(nbSolves);
+  return (nbSteadyAllocations > 0) ? 1 : 0;
+}
@@ -0,0 +1,458 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/** Benchmark of MPC solvers over the phase splits of bundled footstep plans.
+ *
+ * Usage: vhip_walking_controller_mpc_benchmark [OUTPUT] [NB_REPEATS] [ROBOT] [CONFIG]
+ *
+ * Each footstep plan of the configuration file is walked through as the FSM
+ * does, without controller: an MPC problem is set at every preview update,
+ * and its solution is played back until the next one. Problems fall into the
+ * phase-split families of the FSM states:
+ *
+ *    init_dsp      Standing: start walking with the initial DSP
+ *    dsp           DoubleSupport: remaining DSP time, then next SSP
+ *    stop_dsp      DoubleSupport: stop during this DSP
+ *    ssp           SingleSupport: remaining SSP time, DSP, then next SSP
+ *    final_dsp     SingleSupport: remaining SSP time, then final DSP
+ *
+ * The recorded problems are then solved NB_REPEATS times by every solver:
+ * the condensed formulation with each QP backend, and the Riccati
+ * formulation, for all horizons instantiated in ModelPredictiveControl.cpp.
+ * Solutions are played back between problems so that warm starts behave as
+ * in the controller. Time budgets from the configuration are disabled.
+ *
+ * Build time, solve time and iterations are reported per plan, family,
+ * horizon and solver to OUTPUT, in JSON if its name ends with ".json" and in
+ * CSV otherwise.
+ *
+ */
+
+#include <array>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <mc_rtc/Configuration.h>
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/FootstepPlan.h>
+#include <vhip_walking/ModelPredictiveControl.h>
+#include <vhip_walking/Sole.h>
+#include <vhip_walking/utils/stats.h>
+
+namespace
+{
+  using namespace vhip_walking;
+
+  constexpr double PLAYBACK_TIMESTEP = 0.005; // [s], control timestep of playback between problems
+  constexpr double PREVIEW_UPDATE_PERIOD = ModelPredictiveControlBase::SAMPLING_PERIOD; // [s], as in the controller
+
+  /** Phase-split families of the MPC problems set by FSM states.
+   *
+   */
+  enum class PhaseFamily
+  {
+    InitDSP,
+    DSP,
+    StopDSP,
+    SSP,
+    FinalDSP
+  };
+
+  constexpr unsigned NB_PHASE_FAMILIES = 5;
+
+  const char * PHASE_FAMILY_LABELS[NB_PHASE_FAMILIES] = {"init_dsp", "dsp", "stop_dsp", "ssp", "final_dsp"};
+
+  /** MPC problem recorded along a footstep plan.
+   *
+   */
+  struct Problem
+  {
+    Contact initContact;
+    Contact targetContact;
+    Contact nextContact;
+    Pendulum state;
+    PhaseFamily family;
+    double initSupportDuration;
+    double doubleSupportDuration;
+    double targetSupportDuration;
+  };
+
+  /** Statistics of a solver on a family of problems.
+   *
+   */
+  struct Result
+  {
+    AvgStdEstimator buildTime; // [ms]
+    AvgStdEstimator iterations;
+    AvgStdEstimator solveTime; // [ms]
+    AvgStdEstimator time; // [ms]
+    unsigned nbFailures = 0;
+  };
+
+  /** Results of all solvers, written to the output file.
+   *
+   */
+  struct Report
+  {
+    /** Add statistics of a solver on a footstep plan.
+     *
+     * \param plan Plan name.
+     *
+     * \param nbSteps Number of sampling steps of the MPC.
+     *
+     * \param solver Solver label.
+     *
+     * \param results Statistics for each phase family.
+     *
+     */
+    void add(const std::string & plan, unsigned nbSteps, const std::string & solver, std::array<Result, NB_PHASE_FAMILIES> & results)
+    {
+      for (unsigned i = 0; i < NB_PHASE_FAMILIES; i++)
+      {
+        Result & result = results[i];
+        if (result.time.n() + result.nbFailures < 1)
+        {
+          continue;
+        }
+        mc_rtc::Configuration row;
+        row.add("plan", plan);
+        row.add("family", std::string(PHASE_FAMILY_LABELS[i]));
+        row.add("nb_steps", nbSteps);
+        row.add("solver", solver);
+        row.add("nb_problems", result.time.n() + result.nbFailures);
+        row.add("nb_failures", result.nbFailures);
+        row.add("build_avg_ms", result.buildTime.avg());
+        row.add("build_std_ms", result.buildTime.std());
+        row.add("solve_avg_ms", result.solveTime.avg());
+        row.add("solve_std_ms", result.solveTime.std());
+        row.add("total_avg_ms", result.time.avg());
+        row.add("total_std_ms", result.time.std());
+        row.add("total_max_ms", result.time.max());
+        row.add("iterations_avg", result.iterations.avg());
+        rows.push_back(row);
+      }
+    }
+
+    /** Write report to a JSON file.
+     *
+     * \param path Output path.
+     *
+     */
+    void saveJSON(const std::string & path) const
+    {
+      mc_rtc::Configuration config;
+      auto results = config.array("results", rows.size());
+      for (const auto & row : rows)
+      {
+        results.push(row);
+      }
+      config.save(path);
+    }
+
+    /** Write report to a CSV file.
+     *
+     * \param path Output path.
+     *
+     */
+    void saveCSV(const std::string & path) const
+    {
+      std::ofstream csv(path);
+      csv << "plan,family,nb_steps,solver,nb_problems,nb_failures,build_avg_ms,build_std_ms,solve_avg_ms,solve_std_ms,total_avg_ms,total_std_ms,total_max_ms,iterations_avg\n";
+      for (const auto & row : rows)
+      {
+        csv << row("plan").operator std::string() << ","
+          << row("family").operator std::string() << ","
+          << row("nb_steps").operator unsigned() << ","
+          << row("solver").operator std::string() << ","
+          << row("nb_problems").operator unsigned() << ","
+          << row("nb_failures").operator unsigned();
+        for (const char * key : {"build_avg_ms", "build_std_ms", "solve_avg_ms", "solve_std_ms", "total_avg_ms", "total_std_ms", "total_max_ms", "iterations_avg"})
+        {
+          csv << "," << row(key).operator double();
+        }
+        csv << "\n";
+      }
+    }
+
+    std::vector<mc_rtc::Configuration> rows;
+  };
+
+  /** Configure an MPC for a footstep plan as the controller does.
+   *
+   * \param mpc MPC to configure.
+   *
+   * \param mpcConfig MPC section of the configuration file.
+   *
+   * \param plan Footstep plan.
+   *
+   */
+  template <unsigned NB_STEPS>
+  void configure(ModelPredictiveControl<NB_STEPS> & mpc, const mc_rtc::Configuration & mpcConfig, const FootstepPlan & plan)
+  {
+    mpc.configure(mpcConfig);
+    if (!plan.mpcConfig.empty())
+    {
+      mpc.configure(plan.mpcConfig);
+    }
+    mpc.timeBudget(std::numeric_limits<double>::infinity());
+    mpc.comHeight(plan.comHeight());
+  }
+
+  /** Set an MPC problem.
+   *
+   * \param mpc MPC to set the problem of.
+   *
+   * \param problem Problem description.
+   *
+   */
+  template <unsigned NB_STEPS>
+  void setProblem(ModelPredictiveControl<NB_STEPS> & mpc, const Problem & problem)
+  {
+    mpc.contacts(problem.initContact, problem.targetContact, problem.nextContact);
+    mpc.phaseDurations(problem.initSupportDuration, problem.doubleSupportDuration, problem.targetSupportDuration);
+    mpc.initState(problem.state);
+  }
+
+  /** Play back the last MPC solution until the next preview update.
+   *
+   * \param mpc MPC after a call to solve().
+   *
+   * \param pendulum State to integrate the solution upon.
+   *
+   */
+  template <unsigned NB_STEPS>
+  void playback(ModelPredictiveControl<NB_STEPS> & mpc, Pendulum & pendulum)
+  {
+    for (double t = 0.; t < PREVIEW_UPDATE_PERIOD - 0.5 * PLAYBACK_TIMESTEP; t += PLAYBACK_TIMESTEP)
+    {
+      mpc.solution()->integrate(pendulum, PLAYBACK_TIMESTEP);
+    }
+  }
+
+  /** Record the MPC problems set by FSM states along a footstep plan.
+   *
+   * \param plan Footstep plan, rewound by this function.
+   *
+   * \param mpc MPC used to play back the walk between problems.
+   *
+   */
+  std::vector<Problem> recordProblems(FootstepPlan & plan, WalkingMPC & mpc)
+  {
+    const double dspDuration = plan.doubleSupportDuration();
+    const double sspDuration = plan.singleSupportDuration();
+    std::vector<Problem> problems;
+    Pendulum pendulum;
+    auto addProblem = [&](PhaseFamily family, const Contact & initContact, const Contact & targetContact, const Contact & nextContact, double initSupportDuration, double doubleSupportDuration, double targetSupportDuration)
+    {
+      problems.push_back({initContact, targetContact, nextContact, pendulum, family, initSupportDuration, doubleSupportDuration, targetSupportDuration});
+      setProblem(mpc, problems.back());
+      if (mpc.solve())
+      {
+        playback(mpc, pendulum);
+      }
+    };
+
+    plan.rewind();
+    Eigen::Vector3d initCoM = 0.5 * (plan.supportContact().p() + plan.targetContact().p());
+    initCoM.z() += plan.comHeight();
+    pendulum.reset(initCoM);
+    addProblem(PhaseFamily::InitDSP, plan.supportContact(), plan.targetContact(), plan.nextContact(), 0., plan.initDSPDuration(), sspDuration);
+    double curDSPDuration = plan.initDSPDuration();
+    bool isFirstDSP = true;
+    while (true)
+    {
+      plan.goToNextFootstep();
+      bool stop = (plan.supportContact().id > plan.targetContact().id); // see Controller::isLastDSP()
+      for (double remTime = (isFirstDSP) ? curDSPDuration - PREVIEW_UPDATE_PERIOD : curDSPDuration; remTime > 1e-9; remTime -= PREVIEW_UPDATE_PERIOD)
+      {
+        if (stop && remTime < PREVIEW_UPDATE_PERIOD)
+        {
+          break;
+        }
+        PhaseFamily family = (stop) ? PhaseFamily::StopDSP : PhaseFamily::DSP;
+        addProblem(family, plan.prevContact(), plan.supportContact(), plan.targetContact(), 0., remTime, (stop) ? 0. : sspDuration);
+      }
+      if (stop)
+      {
+        break;
+      }
+      isFirstDSP = false;
+
+      bool isLastSSP = (plan.targetContact().id > plan.nextContact().id); // see Controller::isLastSSP()
+      for (double remTime = sspDuration - PREVIEW_UPDATE_PERIOD; remTime > 1e-9; remTime -= PREVIEW_UPDATE_PERIOD)
+      {
+        if (isLastSSP)
+        {
+          addProblem(PhaseFamily::FinalDSP, plan.supportContact(), plan.targetContact(), plan.nextContact(), remTime, plan.finalDSPDuration(), 0.);
+        }
+        else
+        {
+          addProblem(PhaseFamily::SSP, plan.supportContact(), plan.targetContact(), plan.nextContact(), remTime, dspDuration, sspDuration);
+        }
+      }
+      curDSPDuration = (isLastSSP) ? plan.finalDSPDuration() : dspDuration;
+    }
+    return problems;
+  }
+
+  /** Solve recorded problems with the current settings of an MPC.
+   *
+   * \param mpc MPC with formulation and QP backend already set.
+   *
+   * \param problems Recorded problems.
+   *
+   * \param nbRepeats Number of times the sequence of problems is solved.
+   *
+   */
+  template <unsigned NB_STEPS>
+  std::array<Result, NB_PHASE_FAMILIES> benchmark(ModelPredictiveControl<NB_STEPS> & mpc, const std::vector<Problem> & problems, unsigned nbRepeats)
+  {
+    std::array<Result, NB_PHASE_FAMILIES> results;
+    for (unsigned i = 0; i < nbRepeats; i++)
+    {
+      for (const auto & problem : problems)
+      {
+        Result & result = results[static_cast<unsigned>(problem.family)];
+        setProblem(mpc, problem);
+        if (mpc.solve())
+        {
+          result.buildTime.add(mpc.buildTime());
+          result.iterations.add(mpc.iterations());
+          result.solveTime.add(mpc.solveTime());
+          result.time.add(mpc.buildAndSolveTime());
+          Pendulum pendulum = problem.state;
+          playback(mpc, pendulum); // advance playback time for warm starting
+        }
+        else
+        {
+          result.nbFailures++;
+        }
+      }
+    }
+    return results;
+  }
+
+  /** Benchmark all solvers available for a given horizon on a plan.
+   *
+   * \tparam NB_STEPS Number of sampling steps.
+   *
+   * \param report Output report.
+   *
+   * \param mpcConfig MPC section of the configuration file.
+   *
+   * \param plan Footstep plan.
+   *
+   * \param problems Problems recorded along the plan.
+   *
+   * \param nbRepeats Number of times the sequence of problems is solved.
+   *
+   */
+  template <unsigned NB_STEPS>
+  void benchmarkHorizon(Report & report, const mc_rtc::Configuration & mpcConfig, const FootstepPlan & plan, const std::vector<Problem> & problems, unsigned nbRepeats)
+  {
+    using MPC = ModelPredictiveControl<NB_STEPS>;
+    MPC mpc;
+    configure(mpc, mpcConfig, plan);
+    if constexpr (MPC::HAS_CONDENSED)
+    {
+      mpc.formulation(MPC::Formulation::Condensed);
+      for (QPBackend backend : QP_BACKENDS)
+      {
+        mpc.qpBackend(backend);
+        auto results = benchmark(mpc, problems, nbRepeats);
+        report.add(plan.name, NB_STEPS, "Condensed/" + qpBackendToString(backend), results);
+      }
+    }
+    mpc.formulation(MPC::Formulation::Riccati);
+    auto results = benchmark(mpc, problems, nbRepeats);
+    report.add(plan.name, NB_STEPS, "Riccati", results);
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  const std::string outputPath = (argc > 1) ? argv[1] : "mpc_benchmark.csv";
+  unsigned nbRepeats = (argc > 2) ? static_cast<unsigned>(std::stoul(argv[2])) : 10;
+  const std::string robotName = (argc > 3) ? argv[3] : "hrp4";
+  const std::string configPath = (argc > 4) ? argv[4] : VHIP_WALKING_CONFIG;
+
+  mc_rtc::Configuration config(configPath);
+  auto robotConfig = config("robot_models")(robotName);
+  double comHeight = robotConfig("com")("height");
+  double stepWidth = robotConfig("step_width");
+  Sole sole = robotConfig("sole");
+  mc_rtc::Configuration mpcConfig = config("mpc");
+
+  Report report;
+  for (const auto & name : config("plans").keys())
+  {
+    // Patch CoM height and step width as in the Controller constructor
+    auto planConfig = config("plans")(name);
+    if (!planConfig.has("contacts") || planConfig("contacts").size() < 3)
+    {
+      continue;
+    }
+    if (!planConfig.has("com_height"))
+    {
+      planConfig.add("com_height", comHeight);
+    }
+    for (auto contact : planConfig("contacts"))
+    {
+      std::string surf = contact("surface");
+      Eigen::Vector3d trans = contact("pose")("translation");
+      trans.y() = ((surf == "LeftFootCenter") ? +0.5 : -0.5) * stepWidth;
+      contact("pose").add("translation", trans);
+    }
+    FootstepPlan plan = planConfig;
+    plan.name = name;
+    plan.complete(sole);
+
+    WalkingMPC recorder;
+    configure(recorder, mpcConfig, plan);
+    std::vector<Problem> problems = recordProblems(plan, recorder);
+    mc_rtc::log::info("Plan \"{}\": {} MPC problems", name, problems.size());
+
+    benchmarkHorizon<16>(report, mpcConfig, plan, problems, nbRepeats);
+    benchmarkHorizon<32>(report, mpcConfig, plan, problems, nbRepeats);
+    benchmarkHorizon<64>(report, mpcConfig, plan, problems, nbRepeats);
+  }
+
+  if (outputPath.size() >= 5 && outputPath.compare(outputPath.size() - 5, 5, ".json") == 0)
+  {
+    report.saveJSON(outputPath);
+  }
+  else
+  {
+    report.saveCSV(outputPath);
+  }
+  mc_rtc::log::success("Wrote {} results to {}", report.rows.size(), outputPath);
+  return 0;
+}
@@ -0,0 +1,173 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Comparison of the MPC with its former copra formulation.
+ *
+ * Usage: vhip_walking_controller_mpc_copra_comparison [NB_ITERATIONS]
+ *
+ * Solves the walking sequence of mpc_horizon_benchmark with the condensed
+ * formulation of WalkingMPC and with its copra formulation, which keeps its
+ * copra::LMPC across solves as the controller does. Each QP backend is
+ * matched with the copra solver of the same name, the active-set backend
+ * with QLD. Reports the build-and-solve time of both (perf_MPCBuildAndSolve)
+ * and the largest differences between their state and jerk trajectories.
+ * Returns 1 if a state trajectory differs by more than MAX_STATE_ERROR.
+ *
+ */
+
+#include <cmath>
+#include <string>
+
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/ModelPredictiveControl.h>
+#include <vhip_walking/utils/stats.h>
+
+namespace
+{
+  using namespace vhip_walking;
+
+  constexpr double COM_HEIGHT = 0.8; // [m]
+  constexpr double DSP_DURATION = 0.1; // [s]
+  constexpr double MAX_STATE_ERROR = 1e-5; // [m], [m] / [s], [m] / [s]^2
+  constexpr double SSP_DURATION = 0.7; // [s]
+  constexpr double STEP_LENGTH = 0.2; // [m]
+  constexpr double STEP_WIDTH = 0.18; // [m]
+  constexpr double WALKING_SPEED = STEP_LENGTH / (SSP_DURATION + DSP_DURATION); // [m] / [s]
+
+  /** Statistics of a backend against its copra counterpart.
+   *
+   */
+  struct Result
+  {
+    AvgStdEstimator copraTime; // [ms]
+    AvgStdEstimator time; // [ms]
+    double maxJerkError = 0.; // [m] / [s]^3
+    double maxStateError = 0.;
+    unsigned nbFailures = 0;
+  };
+
+  /** Foot contact at a given position along the walking sequence.
+   *
+   * \param stepIndex Step index, even for left and odd for right foot.
+   *
+   */
+  Contact footContact(unsigned stepIndex)
+  {
+    double y = (stepIndex % 2 == 0) ? STEP_WIDTH / 2 : -STEP_WIDTH / 2;
+    Contact contact(sva::PTransformd(Eigen::Vector3d{stepIndex * STEP_LENGTH, y, 0.}));
+    contact.halfLength = 0.112;
+    contact.halfWidth = 0.065;
+    contact.refVel = {WALKING_SPEED, 0., 0.};
+    contact.surfaceName = (stepIndex % 2 == 0) ? "LeftFootCenter" : "RightFootCenter";
+    return contact;
+  }
+
+  /** Solve the walking sequence with a QP backend and with copra.
+   *
+   * \param backend QP backend.
+   *
+   * \param nbIterations Number of problems to solve.
+   *
+   */
+  Result compare(QPBackend backend, unsigned nbIterations)
+  {
+    constexpr double T = WalkingMPC::SAMPLING_PERIOD;
+    const unsigned nbSSPSteps = static_cast<unsigned>(std::round(SSP_DURATION / T));
+    const unsigned nbDSPSteps = static_cast<unsigned>(std::round(DSP_DURATION / T));
+    Result result;
+    WalkingMPC mpc;
+    WalkingMPC copraMPC;
+    mpc.formulation(WalkingMPC::Formulation::Condensed);
+    copraMPC.formulation(WalkingMPC::Formulation::Copra);
+    for (WalkingMPC * m : {&mpc, &copraMPC})
+    {
+      m->qpBackend(backend);
+      m->comHeight(COM_HEIGHT);
+      m->contacts(footContact(0), footContact(1), footContact(2));
+    }
+    for (unsigned i = 0; i < nbIterations; i++)
+    {
+      unsigned step = i % (nbSSPSteps + nbDSPSteps);
+      Pendulum pendulum;
+      pendulum.reset(Eigen::Vector3d{0.01 * (i % 5), STEP_WIDTH / 2 - 0.02 * (i % 3), COM_HEIGHT});
+      for (WalkingMPC * m : {&mpc, &copraMPC})
+      {
+        m->initState(pendulum);
+        if (step < nbSSPSteps)
+        {
+          m->phaseDurations((nbSSPSteps - step) * T, DSP_DURATION, SSP_DURATION);
+        }
+        else // during double support
+        {
+          m->phaseDurations(0., (nbSSPSteps + nbDSPSteps - step) * T, SSP_DURATION);
+        }
+      }
+      if (!mpc.solve() || mpc.status() != WalkingMPC::SolveStatus::Optimal || !copraMPC.solve())
+      {
+        result.nbFailures++;
+        continue;
+      }
+      result.time.add(mpc.buildAndSolveTime());
+      result.copraTime.add(copraMPC.buildAndSolveTime());
+
+      auto solution = std::static_pointer_cast<WalkingMPC::Solution>(mpc.solution());
+      auto copraSolution = std::static_pointer_cast<WalkingMPC::Solution>(copraMPC.solution());
+      double jerkError = (solution->jerkTraj() - copraSolution->jerkTraj()).lpNorm<Eigen::Infinity>();
+      double stateError = (solution->stateTraj() - copraSolution->stateTraj()).lpNorm<Eigen::Infinity>();
+      result.maxJerkError = std::max(result.maxJerkError, jerkError);
+      result.maxStateError = std::max(result.maxStateError, stateError);
+    }
+    return result;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  unsigned nbIterations = (argc > 1) ? static_cast<unsigned>(std::stoul(argv[1])) : 1000;
+
+  bool success = true;
+  for (QPBackend backend : QP_BACKENDS)
+  {
+    Result result = compare(backend, nbIterations);
+    mc_rtc::log::info(
+        "{}: {:.3f} +/- {:.3f} ms, copra: {:.3f} +/- {:.3f} ms, max errors: state {:.2e}, jerk {:.2e}, {} failures",
+        qpBackendToString(backend), result.time.avg(), result.time.std(), result.copraTime.avg(), result.copraTime.std(),
+        result.maxStateError, result.maxJerkError, result.nbFailures);
+    if (result.maxStateError > MAX_STATE_ERROR)
+    {
+      success = false;
+    }
+  }
+  if (!success)
+  {
+    mc_rtc::log::error("State trajectories differ from copra by more than {}", MAX_STATE_ERROR);
+    return 1;
+  }
+  mc_rtc::log::success("State trajectories match copra within {}", MAX_STATE_ERROR);
+  return 0;
+}
@@ -0,0 +1,172 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Benchmark of MPC formulations over horizon lengths.
+ *
+ * Usage: vhip_walking_controller_mpc_horizon_benchmark [NB_ITERATIONS] [SAMPLING_PERIOD]
+ *
+ * Solves a walking sequence of MPC problems, from the beginning of a single
+ * support phase to the end of the following double support phase, for
+ * the horizons instantiated in ModelPredictiveControl.cpp. The Riccati
+ * formulation is run on all of them, the condensed formulation on those up to
+ * ModelPredictiveControlBase::MAX_CONDENSED_STEPS.
+ *
+ */
+
+#include <cmath>
+#include <string>
+
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/ModelPredictiveControl.h>
+#include <vhip_walking/utils/stats.h>
+
+namespace
+{
+  using namespace vhip_walking;
+
+  constexpr double COM_HEIGHT = 0.8; // [m]
+  constexpr double DSP_DURATION = 0.1; // [s]
+  constexpr double SSP_DURATION = 0.7; // [s]
+  constexpr double STEP_LENGTH = 0.2; // [m]
+  constexpr double STEP_WIDTH = 0.18; // [m]
+  constexpr double WALKING_SPEED = STEP_LENGTH / (SSP_DURATION + DSP_DURATION); // [m] / [s]
+
+  /** Timing statistics of a benchmark run.
+   *
+   */
+  struct Result
+  {
+    AvgStdEstimator buildTime; // [ms]
+    AvgStdEstimator iterations;
+    AvgStdEstimator time; // [ms]
+    unsigned nbFailures = 0;
+  };
+
+  /** Foot contact at a given position along the walking sequence.
+   *
+   * \param stepIndex Step index, even for left and odd for right foot.
+   *
+   */
+  Contact footContact(unsigned stepIndex)
+  {
+    double y = (stepIndex % 2 == 0) ? STEP_WIDTH / 2 : -STEP_WIDTH / 2;
+    Contact contact(sva::PTransformd(Eigen::Vector3d{stepIndex * STEP_LENGTH, y, 0.}));
+    contact.halfLength = 0.112;
+    contact.halfWidth = 0.065;
+    contact.refVel = {WALKING_SPEED, 0., 0.};
+    contact.surfaceName = (stepIndex % 2 == 0) ? "LeftFootCenter" : "RightFootCenter";
+    return contact;
+  }
+
+  /** Solve the walking sequence repeatedly.
+   *
+   * \param mpc Problem with horizon and formulation already set.
+   *
+   * \param nbIterations Number of problems to solve.
+   *
+   * \param T Time between two consecutive problems of the sequence.
+   *
+   */
+  template <unsigned NB_STEPS>
+  Result benchmark(ModelPredictiveControl<NB_STEPS> & mpc, unsigned nbIterations, double T)
+  {
+    const unsigned nbSSPSteps = static_cast<unsigned>(std::round(SSP_DURATION / T));
+    const unsigned nbDSPSteps = static_cast<unsigned>(std::round(DSP_DURATION / T));
+    Result result;
+    mpc.comHeight(COM_HEIGHT);
+    mpc.contacts(footContact(0), footContact(1), footContact(2));
+    for (unsigned i = 0; i < nbIterations; i++)
+    {
+      unsigned step = i % (nbSSPSteps + nbDSPSteps);
+      Pendulum pendulum;
+      pendulum.reset(Eigen::Vector3d{0.01 * (i % 5), STEP_WIDTH / 2 - 0.02 * (i % 3), COM_HEIGHT});
+      mpc.initState(pendulum);
+      if (step < nbSSPSteps)
+      {
+        mpc.phaseDurations((nbSSPSteps - step) * T, DSP_DURATION, SSP_DURATION);
+      }
+      else // during double support
+      {
+        mpc.phaseDurations(0., (nbSSPSteps + nbDSPSteps - step) * T, SSP_DURATION);
+      }
+      if (mpc.solve())
+      {
+        result.buildTime.add(mpc.buildTime());
+        result.iterations.add(mpc.iterations());
+        result.time.add(mpc.buildAndSolveTime());
+      }
+      else
+      {
+        result.nbFailures++;
+      }
+    }
+    return result;
+  }
+
+  void report(const std::string & label, unsigned nbSteps, Result & result)
+  {
+    mc_rtc::log::info("{} x {} steps: {:.3f} +/- {:.3f} ms (build {:.3f} ms), {:.1f} iterations, {} failures", label, nbSteps, result.time.avg(), result.time.std(), result.buildTime.avg(), result.iterations.avg(), result.nbFailures);
+  }
+
+  /** Benchmark all formulations available for a given horizon.
+   *
+   * \tparam NB_STEPS Number of sampling steps.
+   *
+   * \param nbIterations Number of problems to solve per formulation.
+   *
+   * \param samplingPeriod Duration of a sampling step.
+   *
+   */
+  template <unsigned NB_STEPS>
+  void benchmarkHorizon(unsigned nbIterations, double samplingPeriod)
+  {
+    using MPC = ModelPredictiveControl<NB_STEPS>;
+    MPC mpc;
+    mpc.samplingPeriod(samplingPeriod);
+    if constexpr (MPC::HAS_CONDENSED)
+    {
+      mpc.formulation(MPC::Formulation::Condensed);
+      Result condensed = benchmark(mpc, nbIterations, samplingPeriod);
+      report("Condensed", NB_STEPS, condensed);
+    }
+    mpc.formulation(MPC::Formulation::Riccati);
+    Result riccati = benchmark(mpc, nbIterations, samplingPeriod);
+    report("Riccati", NB_STEPS, riccati);
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  unsigned nbIterations = (argc > 1) ? static_cast<unsigned>(std::stoul(argv[1])) : 1000;
+  double samplingPeriod = (argc > 2) ? std::stod(argv[2]) : ModelPredictiveControlBase::SAMPLING_PERIOD;
+
+  benchmarkHorizon<16>(nbIterations, samplingPeriod);
+  benchmarkHorizon<32>(nbIterations, samplingPeriod);
+  benchmarkHorizon<64>(nbIterations, samplingPeriod);
+  return 0;
+}
@@ -0,0 +1,233 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Compare the active-set solver with LSSOL on recorded problems.
+ *
+ * Usage: vhip_walking_controller_qp_comparison RECORDS
+ *
+ * RECORDS is a file of least-squares problems in the format of
+ * <vhip_walking/utils/qp_records.h>, for instance VHIP feedback QPs recorded
+ * by the stabilizer with "qp_backend": {"record_vhip": RECORDS}. Problems
+ * are replayed in order through ActiveSetLeastSquares, warm-started from one
+ * problem to the next as in the controller, and through Eigen::LSSOL_LS.
+ *
+ * Solutions agree when they are within 1e-6 of each other. Working sets are
+ * compared row by row with the LSSOL constraint states. A row that is active
+ * for one solver but not the other is a degenerate difference when it is
+ * tight at the LSSOL solution (weakly active constraint), and a disagreement
+ * otherwise. The tool exits with status 1 if there is any disagreement.
+ *
+ * Problem sizes of the stabilizer QPs are supported: VHIP feedback (10
+ * variables, 12 constraints), single-support (6, 16) and double-support
+ * (12, 34) wrench distribution.
+ *
+ */
+
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+#include <eigen-lssol/LSSOL_LS.h>
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/ActiveSetLeastSquares.h>
+#include <vhip_walking/utils/qp_records.h>
+
+namespace
+{
+  using namespace vhip_walking;
+
+  constexpr double AGREEMENT_TOL = 1e-6;
+  constexpr double TIGHT_TOL = 1e-7;
+
+  /** Is a row active in the final LSSOL constraint state?
+   *
+   * \param istate LSSOL state of the row: 1 (lower bound), 2 (upper bound),
+   * 3 (equality) or 4 (temporarily fixed) for active rows.
+   *
+   */
+  inline bool isActiveLSSOL(int istate)
+  {
+    return (istate >= 1 && istate <= 4);
+  }
+
+  /** Replay problems of one size through both solvers.
+   *
+   * \param records Recorded problems, all of size (NB_VAR, NB_CONS).
+   *
+   * \returns nbDisagreements Number of problems where solutions or working
+   * sets disagree.
+   *
+   */
+  template <int NB_VAR, int NB_CONS>
+  unsigned compareSolvers(const std::vector<LeastSquaresRecord> & records)
+  {
+    using namespace std::chrono;
+    using ActiveSet = ActiveSetLeastSquares<NB_VAR, NB_CONS>;
+    constexpr int NB_ROWS = NB_VAR + NB_CONS;
+
+    ActiveSet activeSet;
+    Eigen::LSSOL_LS lssol;
+    Eigen::VectorXd rows(NB_ROWS);
+    double activeSetTime = 0.; // [s]
+    double lssolTime = 0.; // [s]
+    double maxError = 0.;
+    unsigned nbDegenerate = 0;
+    unsigned nbDisagreements = 0;
+    unsigned nbFailures = 0;
+    unsigned nbIterations = 0;
+    for (const auto & record : records)
+    {
+      auto startTime = high_resolution_clock::now();
+      bool activeSetSuccess = activeSet.solve(record.A, record.b, record.C, record.bl, record.bu);
+      auto midTime = high_resolution_clock::now();
+      bool lssolSuccess = lssol.solve(record.A, record.b, record.C, record.bl, record.bu);
+      auto endTime = high_resolution_clock::now();
+      activeSetTime += duration_cast<duration<double>>(midTime - startTime).count();
+      lssolTime += duration_cast<duration<double>>(endTime - midTime).count();
+      nbIterations += activeSet.iterations();
+      if (!activeSetSuccess || !lssolSuccess)
+      {
+        if (activeSetSuccess != lssolSuccess)
+        {
+          nbDisagreements++;
+        }
+        nbFailures++;
+        activeSet.resetActiveSet();
+        continue;
+      }
+
+      const Eigen::VectorXd & x = lssol.result();
+      double error = (activeSet.result() - x).cwiseAbs().maxCoeff();
+      maxError = std::max(maxError, error);
+      bool agree = (error < AGREEMENT_TOL);
+      rows.head<NB_VAR>() = x;
+      rows.tail<NB_CONS>() = record.C * x;
+      bool degenerate = false;
+      for (int i = 0; i < NB_ROWS; i++)
+      {
+        bool activeSetActive = (activeSet.rowStatus(i) != ActiveSet::RowStatus::Inactive);
+        if (activeSetActive == isActiveLSSOL(lssol.istate()(i)))
+        {
+          continue;
+        }
+        bool tight = (rows(i) - record.bl(i) < TIGHT_TOL || record.bu(i) - rows(i) < TIGHT_TOL);
+        if (tight)
+        {
+          degenerate = true;
+        }
+        else
+        {
+          agree = false;
+        }
+      }
+      if (!agree)
+      {
+        nbDisagreements++;
+      }
+      else if (degenerate)
+      {
+        nbDegenerate++;
+      }
+    }
+
+    const unsigned nbProblems = static_cast<unsigned>(records.size());
+    mc_rtc::log::info("({}, {}) problems: {}, failures: {}", NB_VAR, NB_CONS, nbProblems, nbFailures);
+    mc_rtc::log::info("({}, {}) average solve time: {:.2f} us (active set, {:.2f} iterations), {:.2f} us (LSSOL)", NB_VAR, NB_CONS, 1e6 * activeSetTime / nbProblems, static_cast<double>(nbIterations) / nbProblems, 1e6 * lssolTime / nbProblems);
+    mc_rtc::log::info("({}, {}) max solution difference: {}, degenerate working sets: {}", NB_VAR, NB_CONS, maxError, nbDegenerate);
+    if (nbDisagreements > 0)
+    {
+      mc_rtc::log::error("({}, {}) solvers disagree on {}/{} problems", NB_VAR, NB_CONS, nbDisagreements, nbProblems);
+    }
+    else
+    {
+      mc_rtc::log::success("({}, {}) solvers agree on all {} problems", NB_VAR, NB_CONS, nbProblems);
+    }
+    return nbDisagreements;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    mc_rtc::log::error("Usage: {} RECORDS", argv[0]);
+    return 2;
+  }
+  std::ifstream recordFile(argv[1]);
+  if (!recordFile)
+  {
+    mc_rtc::log::error("Cannot open \"{}\"", argv[1]);
+    return 2;
+  }
+
+  std::vector<LeastSquaresRecord> vhipRecords;
+  std::vector<LeastSquaresRecord> ssRecords;
+  std::vector<LeastSquaresRecord> dsRecords;
+  LeastSquaresRecord record;
+  unsigned nbSkipped = 0;
+  while (readLeastSquaresRecord(recordFile, record))
+  {
+    const auto nbVar = record.A.cols();
+    const auto nbCons = record.C.rows();
+    if (nbVar == 10 && nbCons == 12)
+    {
+      vhipRecords.push_back(record);
+    }
+    else if (nbVar == 6 && nbCons == 16)
+    {
+      ssRecords.push_back(record);
+    }
+    else if (nbVar == 12 && nbCons == 34)
+    {
+      dsRecords.push_back(record);
+    }
+    else
+    {
+      nbSkipped++;
+    }
+  }
+  if (nbSkipped > 0)
+  {
+    mc_rtc::log::warning("Skipped {} problems of unsupported size", nbSkipped);
+  }
+
+  unsigned nbDisagreements = 0;
+  if (!vhipRecords.empty())
+  {
+    nbDisagreements += compareSolvers<10, 12>(vhipRecords);
+  }
+  if (!ssRecords.empty())
+  {
+    nbDisagreements += compareSolvers<6, 16>(ssRecords);
+  }
+  if (!dsRecords.empty())
+  {
+    nbDisagreements += compareSolvers<12, 34>(dsRecords);
+  }
+  return (nbDisagreements > 0) ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Replay recorded controller logs through the stabilizer.
+ *
+ * Usage: vhip_walking_controller_replay LOG [ROBOT_MODULE] [CONFIG] [START_TIME]
+ *
+ * Inputs of Stabilizer::run() are reconstructed from each log record: measured
+ * state from realRobot_* and left_foot_ratio, reference from pendulum_*,
+ * contacts and mass from stabilizer_*, control robot kinematics from
+ * controlRobot_posW and qOut, and sensor readings from stabilizer_imu_orientation
+ * and force sensor entries. The robot model is loaded only to hold task
+ * targets and sensor readings: there is no QP solver.
+ *
+ * The stabilizer runs in every controller cycle once the initial state is
+ * done. It is replayed as fast as possible from START_TIME, by default the
+ * first record where perf_Stabilizer_run is set, to the end of the log, and
+ * its log entries are written to a new log. Records of the two logs are
+ * aligned on their "t" entry and compared bit for bit. Gains are read from
+ * the configuration file, so that recordings where they were changed from the
+ * GUI do not replay exactly.
+ *
+ */
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#include <RBDyn/FK.h>
+#include <mc_rbdyn/RobotLoader.h>
+#include <mc_rtc/log/FlatLog.h>
+#include <mc_rtc/log/Logger.h>
+
+#include <vhip_walking/Stabilizer.h>
+#include <vhip_walking/utils/LatencyHistogram.h>
+
+namespace
+{
+  using namespace vhip_walking;
+
+  const std::vector<std::string> INPUT_ENTRIES = {
+    "controlRobot_posW",
+    "left_foot_ratio",
+    "pendulum_com",
+    "pendulum_comd",
+    "pendulum_comdd",
+    "pendulum_omega",
+    "pendulum_zmp",
+    "qOut",
+    "realRobot_com",
+    "realRobot_comd",
+    "realRobot_wrench",
+    "stabilizer_contactState",
+    "stabilizer_contact_left",
+    "stabilizer_contact_left_halfLength",
+    "stabilizer_contact_left_halfWidth",
+    "stabilizer_contact_right",
+    "stabilizer_contact_right_halfLength",
+    "stabilizer_contact_right_halfWidth",
+    "stabilizer_imu_orientation",
+    "stabilizer_mass",
+    "t"
+  };
+
+  inline bool bitwiseEqual(double a, double b)
+  {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+  }
+
+  inline bool bitwiseEqual(const Eigen::Vector3d & a, const Eigen::Vector3d & b)
+  {
+    return std::memcmp(a.data(), b.data(), 3 * sizeof(double)) == 0;
+  }
+
+  inline bool bitwiseEqual(const sva::ForceVecd & a, const sva::ForceVecd & b)
+  {
+    return bitwiseEqual(a.couple(), b.couple()) && bitwiseEqual(a.force(), b.force());
+  }
+
+  inline double distance(double a, double b)
+  {
+    return std::abs(a - b);
+  }
+
+  inline double distance(const Eigen::Vector3d & a, const Eigen::Vector3d & b)
+  {
+    return (a - b).norm();
+  }
+
+  inline double distance(const sva::ForceVecd & a, const sva::ForceVecd & b)
+  {
+    return (a - b).vector().norm();
+  }
+
+  ContactState contactStateFromLog(double value)
+  {
+    if (value > 0.5)
+    {
+      return ContactState::LeftFoot;
+    }
+    else if (value < -0.5)
+    {
+      return ContactState::RightFoot;
+    }
+    return ContactState::DoubleSupport;
+  }
+
+  /** Compare a replayed entry with its recorded values.
+   *
+   * \param name Entry name.
+   *
+   * \param recorded Recorded log.
+   *
+   * \param replayed Replayed log.
+   *
+   * \param recordIndices Index of the recorded record aligned with each
+   * replayed record.
+   *
+   * \returns nbMismatches Number of cycles where values are not bit-exact.
+   *
+   */
+  template<typename T>
+  unsigned compareEntry(const std::string & name, const mc_rtc::log::FlatLog & recorded, const mc_rtc::log::FlatLog & replayed, const std::vector<size_t> & recordIndices)
+  {
+    if (!recorded.has(name) || !replayed.has(name))
+    {
+      mc_rtc::log::warning("{}: missing from {} log", name, recorded.has(name) ? "replayed" : "recorded");
+      return 0;
+    }
+    const std::vector<T> expected = recorded.get<T>(name, T{});
+    const std::vector<T> actual = replayed.get<T>(name, T{});
+    unsigned nbCycles = 0;
+    unsigned nbMismatches = 0;
+    double maxDistance = 0.;
+    for (size_t j = 0; j < recordIndices.size() && j < actual.size(); j++)
+    {
+      size_t i = recordIndices[j];
+      nbCycles++;
+      if (!bitwiseEqual(expected[i], actual[j]))
+      {
+        nbMismatches++;
+        maxDistance = std::max(maxDistance, distance(expected[i], actual[j]));
+      }
+    }
+    if (nbMismatches > 0)
+    {
+      mc_rtc::log::error("{}: {}/{} cycles bit-exact, max deviation {}", name, nbCycles - nbMismatches, nbCycles, maxDistance);
+    }
+    else
+    {
+      mc_rtc::log::success("{}: {}/{} cycles bit-exact", name, nbCycles, nbCycles);
+    }
+    return nbMismatches;
+  }
+
+  /** Update control robot kinematics.
+   *
+   * \param robot Control robot.
+   *
+   * \param posW Floating base transform.
+   *
+   * \param q Joint angles in reference joint order.
+   *
+   */
+  void updateKinematics(mc_rbdyn::Robot & robot, const sva::PTransformd & posW, const std::vector<double> & q)
+  {
+    const auto & refJointOrder = robot.refJointOrder();
+    for (unsigned i = 0; i < refJointOrder.size() && i < q.size(); i++)
+    {
+      if (robot.hasJoint(refJointOrder[i]))
+      {
+        robot.mbc().q[robot.jointIndexByName(refJointOrder[i])][0] = q[i];
+      }
+    }
+    robot.posW(posW);
+    rbd::forwardKinematics(robot.mb(), robot.mbc());
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    mc_rtc::log::error("Usage: {} LOG [ROBOT_MODULE] [CONFIG] [START_TIME]", argv[0]);
+    return 2;
+  }
+  const std::string logPath = argv[1];
+  const std::string robotModule = (argc > 2) ? argv[2] : "HRP4";
+  const std::string configPath = (argc > 3) ? argv[3] : VHIP_WALKING_CONFIG;
+
+  mc_rtc::log::FlatLog log(logPath);
+  for (const auto & entry : INPUT_ENTRIES)
+  {
+    if (!log.has(entry))
+    {
+      mc_rtc::log::error("Log has no \"{}\" entry, cannot replay", entry);
+      return 2;
+    }
+  }
+  const size_t nbRecords = log.size();
+  const std::vector<double> times = log.get<double>("t", 0.);
+  double dt = (times.size() > 1) ? times[1] - times[0] : 0.005;
+
+  size_t startIndex = 0;
+  if (argc > 4)
+  {
+    const double startTime = std::stod(argv[4]);
+    while (startIndex < nbRecords && times[startIndex] < startTime - dt / 2)
+    {
+      startIndex++;
+    }
+  }
+  else // first cycle where the stabilizer ran
+  {
+    const auto runTimes = log.get<double>("perf_Stabilizer_run", 0.);
+    while (startIndex < nbRecords && runTimes[startIndex] <= 0.)
+    {
+      startIndex++;
+    }
+  }
+  if (startIndex >= nbRecords)
+  {
+    mc_rtc::log::error("No record to replay");
+    return 2;
+  }
+
+  auto robots = mc_rbdyn::loadRobot(*mc_rbdyn::RobotLoader::get_robot_module(robotModule));
+  mc_rbdyn::Robot & robot = robots->robot();
+
+  mc_rtc::Configuration config(configPath);
+  auto robotConfig = config("robot_models")(robot.name());
+  std::vector<std::string> comActiveJoints = robotConfig("com")("active_joints");
+  auto stabilizerConfig = config("stabilizer");
+  stabilizerConfig.add("admittance", robotConfig("admittance"));
+  stabilizerConfig("tasks")("com").add("active_joints", comActiveJoints);
+  Sole sole = robotConfig("sole");
+
+  Pendulum pendulum;
+  Stabilizer stabilizer(robot, pendulum, dt);
+  stabilizer.configure(stabilizerConfig);
+  stabilizer.reset(*robots);
+  stabilizer.wrenchFaceMatrix(sole);
+
+  // Inputs
+  const auto controlPosW = log.get<sva::PTransformd>("controlRobot_posW", sva::PTransformd::Identity());
+  const auto controlQ = log.get<std::vector<double>>("qOut", {});
+  const auto imuOrientation = log.get<Eigen::Quaterniond>("stabilizer_imu_orientation", Eigen::Quaterniond::Identity());
+  const auto leftFootRatio = log.get<double>("left_foot_ratio", 0.5);
+  const auto pendulumCoM = log.get<Eigen::Vector3d>("pendulum_com", Eigen::Vector3d::Zero());
+  const auto pendulumCoMd = log.get<Eigen::Vector3d>("pendulum_comd", Eigen::Vector3d::Zero());
+  const auto pendulumCoMdd = log.get<Eigen::Vector3d>("pendulum_comdd", Eigen::Vector3d::Zero());
+  const auto pendulumOmega = log.get<double>("pendulum_omega", 0.);
+  const auto pendulumZMP = log.get<Eigen::Vector3d>("pendulum_zmp", Eigen::Vector3d::Zero());
+  const auto realCoM = log.get<Eigen::Vector3d>("realRobot_com", Eigen::Vector3d::Zero());
+  const auto realCoMd = log.get<Eigen::Vector3d>("realRobot_comd", Eigen::Vector3d::Zero());
+  const auto realWrench = log.get<sva::ForceVecd>("realRobot_wrench", sva::ForceVecd(Eigen::Vector6d::Zero()));
+  const auto contactState = log.get<double>("stabilizer_contactState", 0.);
+  const auto leftContactPose = log.get<sva::PTransformd>("stabilizer_contact_left", sva::PTransformd::Identity());
+  const auto leftContactHalfLength = log.get<double>("stabilizer_contact_left_halfLength", 0.);
+  const auto leftContactHalfWidth = log.get<double>("stabilizer_contact_left_halfWidth", 0.);
+  const auto rightContactPose = log.get<sva::PTransformd>("stabilizer_contact_right", sva::PTransformd::Identity());
+  const auto rightContactHalfLength = log.get<double>("stabilizer_contact_right_halfLength", 0.);
+  const auto rightContactHalfWidth = log.get<double>("stabilizer_contact_right_halfWidth", 0.);
+  const auto mass = log.get<double>("stabilizer_mass", 0.);
+  std::vector<std::string> sensorNames;
+  std::vector<std::vector<sva::ForceVecd>> sensorWrenches;
+  for (const auto & sensor : robot.forceSensors())
+  {
+    if (!log.has(sensor.name()))
+    {
+      mc_rtc::log::warning("Log has no \"{}\" entry, its readings will be zero", sensor.name());
+    }
+    sensorNames.push_back(sensor.name());
+    sensorWrenches.push_back(log.get<sva::ForceVecd>(sensor.name(), sva::ForceVecd(Eigen::Vector6d::Zero())));
+  }
+
+  LatencyHistogram runLatency;
+  std::string replayPath;
+  double replayTime = 0.; // [s]
+  unsigned nbCycles = 0;
+  {
+    mc_rtc::Logger logger(mc_rtc::Logger::Policy::NON_THREADED, std::filesystem::temp_directory_path().string(), "vhip-walking-replay");
+    logger.start("VHIPWalkingReplay", dt);
+    stabilizer.addLogEntries(logger);
+    for (size_t i = 0; i < nbRecords; i++)
+    {
+      // Control robot kinematics seen during cycle i are those output at the
+      // end of cycle i - 1, while sensor readings are inputs of cycle i
+      if (i > 0)
+      {
+        updateKinematics(robot, controlPosW[i - 1], controlQ[i - 1]);
+      }
+      robot.bodySensor().orientation(imuOrientation[i]);
+      for (size_t j = 0; j < sensorWrenches.size(); j++)
+      {
+        robot.forceSensor(sensorNames[j]).wrench(sensorWrenches[j][i]);
+      }
+
+      if (i == 0 || leftContactPose[i] != leftContactPose[i - 1] || leftContactHalfLength[i] != leftContactHalfLength[i - 1] || leftContactHalfWidth[i] != leftContactHalfWidth[i - 1])
+      {
+        Contact contact(leftContactPose[i]);
+        contact.halfLength = leftContactHalfLength[i];
+        contact.halfWidth = leftContactHalfWidth[i];
+        contact.surfaceName = "LeftFootCenter";
+        stabilizer.setContact(stabilizer.leftFootTask, contact);
+      }
+      if (i == 0 || rightContactPose[i] != rightContactPose[i - 1] || rightContactHalfLength[i] != rightContactHalfLength[i - 1] || rightContactHalfWidth[i] != rightContactHalfWidth[i - 1])
+      {
+        Contact contact(rightContactPose[i]);
+        contact.halfLength = rightContactHalfLength[i];
+        contact.halfWidth = rightContactHalfWidth[i];
+        contact.surfaceName = "RightFootCenter";
+        stabilizer.setContact(stabilizer.rightFootTask, contact);
+      }
+      stabilizer.contactState(contactStateFromLog(contactState[i]));
+      stabilizer.updateMass(mass[i]);
+      pendulum.setState(pendulumCoM[i], pendulumCoMd[i], pendulumCoMdd[i], pendulumZMP[i], pendulumOmega[i]);
+
+      if (i >= startIndex)
+      {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        {
+          ScopedLatencyTimer timer(runLatency);
+          stabilizer.updateState(realCoM[i], realCoMd[i], realWrench[i], leftFootRatio[i]);
+          stabilizer.run();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        replayTime += std::chrono::duration_cast<std::chrono::duration<double>>(endTime - startTime).count();
+        nbCycles++;
+      }
+      if (i >= startIndex)
+      {
+        logger.log();
+      }
+    }
+    replayPath = logger.path();
+  }
+
+  mc_rtc::log::info("Replayed {} stabilizer cycles out of {} records", nbCycles, nbRecords);
+  if (nbCycles > 0)
+  {
+    mc_rtc::log::info("Throughput: {} cycles/s (p50: {} us, p99: {} us, max: {} us)", std::round(nbCycles / replayTime), 1000. * runLatency.p50(), 1000. * runLatency.p99(), 1000. * runLatency.max());
+  }
+
+  // Replayed times start from zero at START_TIME
+  mc_rtc::log::FlatLog replayed(replayPath);
+  const std::vector<double> replayedTimes = replayed.get<double>("t", 0.);
+  std::vector<size_t> recordIndices;
+  for (size_t j = 0; j < replayedTimes.size(); j++)
+  {
+    size_t i = startIndex + j;
+    if (i >= nbRecords || std::abs(times[i] - times[startIndex] - replayedTimes[j]) > dt / 2)
+    {
+      mc_rtc::log::error("Recorded and replayed logs diverge at t = {} s", times[startIndex] + replayedTimes[j]);
+      return 1;
+    }
+    recordIndices.push_back(i);
+  }
+  unsigned nbMismatches = 0;
+  nbMismatches += compareEntry<Eigen::Vector3d>("error_dcm", log, replayed, recordIndices);
+  nbMismatches += compareEntry<Eigen::Vector3d>("stabilizer_altcc_comOffset", log, replayed, recordIndices);
+  nbMismatches += compareEntry<Eigen::Vector3d>("stabilizer_comOffset", log, replayed, recordIndices);
+  nbMismatches += compareEntry<sva::ForceVecd>("stabilizer_distribWrench", log, replayed, recordIndices);
+  nbMismatches += compareEntry<double>("stabilizer_lambda_distrib", log, replayed, recordIndices);
+  nbMismatches += compareEntry<double>("stabilizer_lambda_measured", log, replayed, recordIndices);
+  nbMismatches += compareEntry<double>("stabilizer_vdc_z_pos", log, replayed, recordIndices);
+  nbMismatches += compareEntry<double>("stabilizer_vfc_z_ctrl", log, replayed, recordIndices);
+  nbMismatches += compareEntry<Eigen::Vector3d>("stabilizer_vhip_dcm", log, replayed, recordIndices);
+  nbMismatches += compareEntry<double>("stabilizer_vhip_lambda", log, replayed, recordIndices);
+  nbMismatches += compareEntry<Eigen::Vector3d>("stabilizer_vhip_zmp", log, replayed, recordIndices);
+  nbMismatches += compareEntry<Eigen::Vector3d>("stabilizer_zmp", log, replayed, recordIndices);
+  nbMismatches += compareEntry<Eigen::Vector3d>("stabilizer_zmpcc_comOffset", log, replayed, recordIndices);
+  return (nbMismatches > 0) ? 1 : 0;
+}
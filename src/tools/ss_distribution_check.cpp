@@ -0,0 +1,139 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Check the explicit single-support wrench distribution against LSSOL.
+ *
+ * Usage: vhip_walking_controller_ss_distribution_check [NB_POSES] [NB_SAMPLES]
+ *
+ * Critical regions are enumerated for the default sole, then expressed in
+ * the inertial frame of random contact poses as in the stabilizer. For each
+ * pose, the explicit solution is compared with LSSOL on random desired
+ * wrenches, and its timings are measured on two sequences: random wrenches,
+ * which usually jump to another region and need a scan, and a smooth
+ * sequence, which usually stays in the last region found.
+ *
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+
+#include <mc_rtc/Configuration.h>
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/Sole.h>
+#include <vhip_walking/WrenchConeProjection.h>
+
+namespace
+{
+  using namespace vhip_walking;
+
+  /** Duration of a function call in [us].
+   *
+   * \param f Function to call.
+   *
+   */
+  template<typename Function>
+  double duration(Function f)
+  {
+    using namespace std::chrono;
+    auto startTime = high_resolution_clock::now();
+    f();
+    auto endTime = high_resolution_clock::now();
+    return 1e6 * duration_cast<std::chrono::duration<double>>(endTime - startTime).count();
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  const unsigned nbPoses = (argc > 1) ? static_cast<unsigned>(std::stoul(argv[1])) : 20;
+  const unsigned nbSamples = (argc > 2) ? static_cast<unsigned>(std::stoul(argv[2])) : 1000;
+
+  Sole sole;
+  WrenchFaceMatrix F = rectangularWrenchCone(sole.halfLength, sole.halfWidth, sole.friction);
+  WrenchConeProjection projection;
+  double buildTime = duration([&]() { projection.build(F); });
+  if (projection.nbRegions() == 0)
+  {
+    mc_rtc::log::error("Contact wrench cone is degenerate");
+    return 1;
+  }
+  mc_rtc::log::info("{} critical regions enumerated in {:.1f} ms", projection.nbRegions(), 1e-3 * buildTime);
+
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> unit(-1., 1.);
+  Eigen::Vector6d scale;
+  scale << 100., 100., 100., 1000., 1000., 1000.; // [N.m], [N]
+  Eigen::Vector6d w_d, w;
+  WrenchFaceMatrix G;
+  unsigned nbMismatches = 0;
+  double maxUpdateTime = 0.;
+  double maxRandomTime = 0.;
+  double maxSmoothTime = 0.;
+  double totalRandomTime = 0.;
+  double totalSmoothTime = 0.;
+  for (unsigned i = 0; i < nbPoses; i++)
+  {
+    sva::PTransformd X_0_c(sva::RotZ(M_PI * unit(generator)), Eigen::Vector3d{2. * unit(generator), 2. * unit(generator), 0.1 * unit(generator)});
+    transformWrenchCone(F, X_0_c.dualMatrix(), G);
+    double updateTime = duration([&]() { projection.update(G); projection.continueUpdate(projection.nbRegions()); });
+    maxUpdateTime = std::max(maxUpdateTime, updateTime);
+    nbMismatches += projection.checkAgainstQP(nbSamples);
+
+    for (unsigned j = 0; j < nbSamples; j++)
+    {
+      for (unsigned k = 0; k < 6; k++)
+      {
+        w_d(k) = scale(k) * unit(generator);
+      }
+      double time = duration([&]() { projection.project(w_d, w); });
+      maxRandomTime = std::max(maxRandomTime, time);
+      totalRandomTime += time;
+    }
+    for (unsigned j = 0; j < nbSamples; j++)
+    {
+      double phase = 2. * M_PI * j / nbSamples;
+      w_d << 20. * std::sin(phase), 20. * std::cos(phase), 5., 50. * std::cos(phase), 50. * std::sin(phase), 400.;
+      w_d = X_0_c.transMul(sva::ForceVecd(w_d)).vector();
+      double time = duration([&]() { projection.project(w_d, w); });
+      maxSmoothTime = std::max(maxSmoothTime, time);
+      totalSmoothTime += time;
+    }
+  }
+
+  const double nbProjections = static_cast<double>(nbPoses) * nbSamples;
+  mc_rtc::log::info("Update to a new contact: {:.0f} us max ({:.2f} us per region)", maxUpdateTime, maxUpdateTime / projection.nbRegions());
+  mc_rtc::log::info("Projection of random wrenches: {:.3f} us average, {:.3f} us max", totalRandomTime / nbProjections, maxRandomTime);
+  mc_rtc::log::info("Projection of smooth wrenches: {:.3f} us average, {:.3f} us max", totalSmoothTime / nbProjections, maxSmoothTime);
+  if (nbMismatches > 0)
+  {
+    mc_rtc::log::error("Explicit solution disagrees with LSSOL on {}/{} samples", nbMismatches, nbPoses * nbSamples);
+    return 1;
+  }
+  mc_rtc::log::success("Explicit solution agrees with LSSOL on {} samples", nbPoses * nbSamples);
+  return 0;
+}
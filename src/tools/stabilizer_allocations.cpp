@@ -0,0 +1,260 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Count heap allocations in Stabilizer::run().
+ *
+ * Usage: vhip_walking_controller_stabilizer_allocations [ROBOT_MODULE] [CONFIG] [NB_CYCLES]
+ *
+ * The stabilizer is run on synthetic inputs in double support, then in left
+ * and right single support. The measured CoM oscillates around the reference
+ * so that the feedback and distribution QPs have work to do. Each phase starts
+ * with a few warm-up cycles: allocations in these cycles are reported but not
+ * counted as failures. In steady state, run() should not allocate at all,
+ * otherwise the tool returns 1. It runs as the stabilizer_allocations test
+ * on the configuration of the build tree.
+ *
+ * Allocations are counted by replacing the global operator new. With glibc,
+ * malloc, calloc and realloc are also interposed, since Eigen allocates
+ * dynamic-size matrices with malloc.
+ *
+ */
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+#include <mc_rbdyn/RobotLoader.h>
+
+#include <vhip_walking/Stabilizer.h>
+
+namespace
+{
+  std::atomic<bool> countAllocations{false};
+  std::atomic<unsigned> nbAllocations{0};
+
+  inline void recordAllocation()
+  {
+    if (countAllocations.load(std::memory_order_relaxed))
+    {
+      nbAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void * allocate(std::size_t size)
+  {
+#ifndef __GLIBC__
+    recordAllocation(); // otherwise counted by malloc() below
+#endif
+    void * ptr = std::malloc(size > 0 ? size : 1);
+    if (ptr == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    return ptr;
+  }
+}
+
+void * operator new(std::size_t size)
+{
+  return allocate(size);
+}
+
+void * operator new[](std::size_t size)
+{
+  return allocate(size);
+}
+
+void operator delete(void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+#ifdef __GLIBC__
+extern "C"
+{
+  void * __libc_malloc(std::size_t size);
+  void * __libc_calloc(std::size_t nmemb, std::size_t size);
+  void * __libc_realloc(void * ptr, std::size_t size);
+
+  void * malloc(std::size_t size)
+  {
+    recordAllocation();
+    return __libc_malloc(size);
+  }
+
+  void * calloc(std::size_t nmemb, std::size_t size)
+  {
+    recordAllocation();
+    return __libc_calloc(nmemb, size);
+  }
+
+  void * realloc(void * ptr, std::size_t size)
+  {
+    recordAllocation();
+    return __libc_realloc(ptr, size);
+  }
+}
+#endif
+
+namespace
+{
+  using namespace vhip_walking;
+
+  constexpr unsigned NB_WARMUP_CYCLES = 10;
+
+  /** Run the stabilizer in a given contact state.
+   *
+   * \param stabilizer Stabilizer.
+   *
+   * \param pendulum Reference pendulum.
+   *
+   * \param contactState Contact state of the phase.
+   *
+   * \param refCoM Reference CoM position.
+   *
+   * \param mass Robot mass.
+   *
+   * \param nbCycles Number of cycles, including warm-up cycles.
+   *
+   * \param dt Control period in [s].
+   *
+   * \returns nbSteadyAllocations Number of allocations after warm-up.
+   *
+   */
+  unsigned runPhase(Stabilizer & stabilizer, Pendulum & pendulum, ContactState contactState, const Eigen::Vector3d & refCoM, double mass, unsigned nbCycles, double dt)
+  {
+    constexpr double AMPLITUDE = 0.01; // [m]
+    constexpr double FREQUENCY = 1.; // [Hz]
+    const double omega = std::sqrt(world::GRAVITY / refCoM.z());
+    const Eigen::Vector3d refZMP = {refCoM.x(), refCoM.y(), 0.};
+    const double leftFootRatio = (contactState == ContactState::LeftFoot) ? 1. : (contactState == ContactState::RightFoot) ? 0. : 0.5;
+    stabilizer.contactState(contactState);
+
+    unsigned nbWarmupAllocations = 0;
+    unsigned nbSteadyAllocations = 0;
+    for (unsigned i = 0; i < nbCycles; i++)
+    {
+      double phase = 2. * M_PI * FREQUENCY * i * dt;
+      Eigen::Vector3d com = refCoM + AMPLITUDE * Eigen::Vector3d{std::sin(phase), std::cos(phase), 0.};
+      Eigen::Vector3d comd = 2. * M_PI * FREQUENCY * AMPLITUDE * Eigen::Vector3d{std::cos(phase), -std::sin(phase), 0.};
+      Eigen::Vector3d force = {0., 0., mass * world::GRAVITY};
+      sva::ForceVecd wrench = {refZMP.cross(force), force};
+      pendulum.setState(refCoM, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), refZMP, omega);
+      stabilizer.updateState(com, comd, wrench, leftFootRatio);
+
+      nbAllocations = 0;
+      countAllocations = true;
+      stabilizer.run();
+      countAllocations = false;
+      if (i < NB_WARMUP_CYCLES)
+      {
+        nbWarmupAllocations += nbAllocations;
+      }
+      else
+      {
+        nbSteadyAllocations += nbAllocations;
+      }
+    }
+
+    const char * name = (contactState == ContactState::LeftFoot) ? "left foot" : (contactState == ContactState::RightFoot) ? "right foot" : "double support";
+    if (nbSteadyAllocations > 0)
+    {
+      mc_rtc::log::error("{}: {} allocations in {} steady-state cycles ({} in warm-up)", name, nbSteadyAllocations, nbCycles - NB_WARMUP_CYCLES, nbWarmupAllocations);
+    }
+    else
+    {
+      mc_rtc::log::success("{}: no allocation in {} steady-state cycles ({} in warm-up)", name, nbCycles - NB_WARMUP_CYCLES, nbWarmupAllocations);
+    }
+    return nbSteadyAllocations;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  const std::string robotModule = (argc > 1) ? argv[1] : "HRP4";
+  const std::string configPath = (argc > 2) ? argv[2] : VHIP_WALKING_CONFIG;
+  const unsigned nbCycles = (argc > 3) ? static_cast<unsigned>(std::stoul(argv[3])) : 1000;
+  if (nbCycles <= NB_WARMUP_CYCLES)
+  {
+    mc_rtc::log::error("Number of cycles should be larger than {}", NB_WARMUP_CYCLES);
+    return 2;
+  }
+  constexpr double dt = 0.005; // [s]
+
+  auto robots = mc_rbdyn::loadRobot(*mc_rbdyn::RobotLoader::get_robot_module(robotModule));
+  mc_rbdyn::Robot & robot = robots->robot();
+
+  mc_rtc::Configuration config(configPath);
+  auto robotConfig = config("robot_models")(robot.name());
+  std::vector<std::string> comActiveJoints = robotConfig("com")("active_joints");
+  auto stabilizerConfig = config("stabilizer");
+  stabilizerConfig.add("admittance", robotConfig("admittance"));
+  stabilizerConfig("tasks")("com").add("active_joints", comActiveJoints);
+  Sole sole = robotConfig("sole");
+
+  Pendulum pendulum;
+  Stabilizer stabilizer(robot, pendulum, dt);
+  stabilizer.configure(stabilizerConfig);
+  stabilizer.reset(*robots);
+  stabilizer.wrenchFaceMatrix(sole);
+
+  for (const std::string & surfaceName : {"LeftFootCenter", "RightFootCenter"})
+  {
+    Contact contact(robot.surfacePose(surfaceName));
+    contact.halfLength = sole.halfLength;
+    contact.halfWidth = sole.halfWidth;
+    contact.surfaceName = surfaceName;
+    stabilizer.setContact((surfaceName == "LeftFootCenter") ? stabilizer.leftFootTask : stabilizer.rightFootTask, contact);
+  }
+
+  const double mass = robot.mass();
+  const Eigen::Vector3d com = robot.com();
+  stabilizer.updateMass(mass);
+  pendulum.reset(com);
+
+  unsigned nbSteadyAllocations = 0;
+  nbSteadyAllocations += runPhase(stabilizer, pendulum, ContactState::DoubleSupport, com, mass, nbCycles, dt);
+  nbSteadyAllocations += runPhase(stabilizer, pendulum, ContactState::LeftFoot, com, mass, nbCycles, dt);
+  nbSteadyAllocations += runPhase(stabilizer, pendulum, ContactState::RightFoot, com, mass, nbCycles, dt);
+  return (nbSteadyAllocations > 0) ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/* 
+ * Copyright (c) 2018-2019, CNRS-UM LIRMM
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/** Benchmark of swing foot trajectory tables.
+ *
+ * Usage: vhip_walking_controller_swing_foot_benchmark [NB_SWINGS]
+ *
+ * Plays back random swing foot trajectories at the control rate, evaluating
+ * polynomials at every cycle and from tables sampled at reset, and checks
+ * that both agree, at the control rate and at a rate between table knots.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <mc_rtc/logging.h>
+
+#include <vhip_walking/SwingFoot.h>
+
+namespace
+{
+  using namespace vhip_walking;
+
+  constexpr double DT = 0.005; // [s]
+  constexpr double SWING_DURATION = 0.7; // [s]
+  constexpr double SWING_HEIGHT = 0.04; // [m]
+
+  /** Duration of a function call in [ms].
+   *
+   * \param f Function to call.
+   *
+   */
+  template<typename Function>
+  double benchmark(Function f)
+  {
+    using namespace std::chrono;
+    auto startTime = high_resolution_clock::now();
+    f();
+    auto endTime = high_resolution_clock::now();
+    return 1000. * duration_cast<duration<double>>(endTime - startTime).count();
+  }
+
+  /** Swing foot parameters with random start and target poses.
+   *
+   */
+  struct Swing
+  {
+    sva::PTransformd initPose;
+    sva::PTransformd targetPose;
+  };
+
+  /** Configure swing foot interpolator with walking plan parameters.
+   *
+   * \param swingFoot Interpolator.
+   *
+   * \param tablePeriod Table sampling period, zero to evaluate polynomials.
+   *
+   */
+  void configure(SwingFoot & swingFoot, double tablePeriod)
+  {
+    swingFoot.landingDuration(0.15);
+    swingFoot.landingPitch(0.15);
+    swingFoot.takeoffDuration(0.05);
+    swingFoot.takeoffOffset({0.01, 0., 0.});
+    swingFoot.takeoffPitch(-0.1);
+    swingFoot.tablePeriod(tablePeriod);
+  }
+
+  /** Largest deviation between two swing foot states.
+   *
+   * \param a First interpolator.
+   *
+   * \param b Second interpolator.
+   *
+   */
+  double maxError(const SwingFoot & a, const SwingFoot & b)
+  {
+    double error = (a.pose().translation() - b.pose().translation()).lpNorm<Eigen::Infinity>();
+    error = std::max(error, (a.pose().rotation() - b.pose().rotation()).lpNorm<Eigen::Infinity>());
+    error = std::max(error, (a.vel().linear() - b.vel().linear()).lpNorm<Eigen::Infinity>());
+    error = std::max(error, (a.accel().linear() - b.accel().linear()).lpNorm<Eigen::Infinity>());
+    return error;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  unsigned nbSwings = (argc > 1) ? static_cast<unsigned>(std::stoul(argv[1])) : 1000;
+  unsigned nbCycles = static_cast<unsigned>(SWING_DURATION / DT);
+
+  std::vector<Swing> swings(nbSwings);
+  for (auto & swing : swings)
+  {
+    Eigen::Vector3d yaw = 0.2 * Eigen::Vector3d::Random();
+    Eigen::Vector3d initPos = 0.1 * Eigen::Vector3d::Random();
+    Eigen::Vector3d stepPos = Eigen::Vector3d{0.2, 0.18, 0.} + 0.05 * Eigen::Vector3d::Random();
+    swing.initPose = sva::PTransformd(sva::RotZ(yaw.x()), initPos);
+    swing.targetPose = sva::PTransformd(sva::RotZ(yaw.y()), initPos + stepPos);
+  }
+
+  SwingFoot polynomialFoot, tableFoot;
+  configure(polynomialFoot, 0.);
+  configure(tableFoot, DT);
+
+  double sum = 0.; // keep playback from being optimized away
+  auto playback = [&](SwingFoot & swingFoot, double & resetTime, double & integrateTime)
+  {
+    resetTime = 0.;
+    integrateTime = 0.;
+    for (const auto & swing : swings)
+    {
+      resetTime += benchmark([&]() { swingFoot.reset(swing.initPose, swing.targetPose, SWING_DURATION, SWING_HEIGHT); });
+      integrateTime += benchmark([&]()
+        {
+          for (unsigned cycle = 0; cycle < nbCycles; cycle++)
+          {
+            swingFoot.integrate(DT);
+            sum += swingFoot.pose().translation().z();
+          }
+        });
+    }
+  };
+
+  double polynomialReset, polynomialIntegrate, tableReset, tableIntegrate;
+  playback(polynomialFoot, polynomialReset, polynomialIntegrate);
+  playback(tableFoot, tableReset, tableIntegrate);
+  double nbTotalCycles = static_cast<double>(nbSwings) * nbCycles;
+  mc_rtc::log::info("Playback of {} swings x {} cycles (checksum {})", nbSwings, nbCycles, sum);
+  mc_rtc::log::info("- polynomials: {:.3f} us per reset, {:.3f} us per cycle", 1000. * polynomialReset / nbSwings, 1000. * polynomialIntegrate / nbTotalCycles);
+  mc_rtc::log::info("- table: {:.3f} us per reset, {:.3f} us per cycle", 1000. * tableReset / nbSwings, 1000. * tableIntegrate / nbTotalCycles);
+
+  // Control-rate playback hits table knots, other rates evaluate polynomials between them
+  double onGridError = 0., offGridError = 0.;
+  for (const auto & swing : swings)
+  {
+    polynomialFoot.reset(swing.initPose, swing.targetPose, SWING_DURATION, SWING_HEIGHT);
+    tableFoot.reset(swing.initPose, swing.targetPose, SWING_DURATION, SWING_HEIGHT);
+    for (unsigned cycle = 0; cycle < nbCycles; cycle++)
+    {
+      polynomialFoot.integrate(DT);
+      tableFoot.integrate(DT);
+      onGridError = std::max(onGridError, maxError(polynomialFoot, tableFoot));
+    }
+    polynomialFoot.reset(swing.initPose, swing.targetPose, SWING_DURATION, SWING_HEIGHT);
+    tableFoot.reset(swing.initPose, swing.targetPose, SWING_DURATION, SWING_HEIGHT);
+    for (unsigned cycle = 0; cycle < 3 * nbCycles; cycle++)
+    {
+      polynomialFoot.integrate(DT / 3.);
+      tableFoot.integrate(DT / 3.);
+      offGridError = std::max(offGridError, maxError(polynomialFoot, tableFoot));
+    }
+  }
+  mc_rtc::log::info("Max deviation from polynomials: {} on knots, {} between knots", onGridError, offGridError);
+
+  if (onGridError > 1e-9 || offGridError > 1e-9)
+  {
+    mc_rtc::log::error("Swing foot table disagrees with polynomials");
+    return 1;
+  }
+  return 0;
+}